@@ -9,6 +9,7 @@
 #include "../src_cpp/one_int.hpp"
 #include "../src_cpp/two_int.hpp"
 #include "../src_cpp/mo.hpp"
+#include "../src_cpp/ri.hpp"
 #include "../src_cpp/read_json.hpp"
 
 using namespace std;
@@ -19,6 +20,9 @@ string comment, in_json, out_eigvecs, out_eigvals;
 SymmetryGroup sym;
 Molecule mole;
 SymGTOs gtos;
+SymGTOs aux; // auxiliary basis for density fitting (optional)
+double cholesky_thresh; // >0: pivoted Cholesky decomposition of ERI (optional)
+string eri_file; // ERI block file. read if exists, otherwise written (optional)
 int num_ele;
 int max_iter;
 double tol;
@@ -53,6 +57,16 @@ void Parse() {
     ReadJson_Molecule(obj, "molecule", mole);
     gtos = NewSymGTOs(mole);
     ReadJson_SymGTOs_Subs(obj, "basis", gtos);
+    if(obj.find("aux_basis") != obj.end()) {
+      aux = NewSymGTOs(mole);
+      ReadJson_SymGTOs_Subs(obj, "aux_basis", aux);
+    }
+    cholesky_thresh = 0.0;
+    if(obj.find("cholesky_thresh") != obj.end())
+      cholesky_thresh = ReadJson<double>(obj, "cholesky_thresh");
+    eri_file = "";
+    if(obj.find("eri_file") != obj.end())
+      eri_file = ReadJson<string>(obj, "eri_file");
     num_ele   = ReadJson<int>(obj, "num_ele");
     max_iter  = ReadJson<int>(obj, "max_iter");
     tol       = ReadJson<double>(obj, "tol");
@@ -70,6 +84,8 @@ void Parse() {
 
   try {
     gtos->SetUp();
+    if(aux)
+      aux->SetUp();
   } catch(exception& e) {
     cerr << "error on setup of SymGTOs" << endl;
     cerr << e.what() << endl;
@@ -88,10 +104,23 @@ void PrintIn() {
   cout << "ERIMethod_use_symmetry: " << eri_method.symmetry << endl;
   cout << "ERIMethod_use_memo: " << eri_method.coef_R_memo << endl;
   cout << "ERIMethod_use_perm: " << eri_method.perm << endl;
+  cout << "ERIMethod_num_threads: " << eri_method.num_threads << endl;
+  cout << "ERIMethod_schwarz_thresh: " << eri_method.schwarz_thresh << endl;
+  cout << "ERIMethod_kernel: " << eri_method.kernel << endl;
+  cout << "ERIMethod_direct: " << eri_method.direct << endl;
+  cout << "ERIMethod_incremental: " << eri_method.incremental << endl;
+  cout << "ERIMethod_diis: " << eri_method.diis << endl;
+  cout << "ERIMethod_storage: " << eri_method.storage << endl;
+  cout << "ERIMethod_mem_budget: " << eri_method.mem_budget << endl;
+  cout << "ERIMethod_reduced_tol: " << eri_method.reduced_tol << endl;
   cout << "symmetry: " << sym->name() << endl;
   cout << "molecule: " << endl << mole->show() << endl;
   cout << "num_ele: " << num_ele << endl;
   cout << "gtos: " << endl << gtos->show() << endl;
+  if(aux)
+    cout << "aux_basis: " << endl << aux->show() << endl;
+  cout << "cholesky_thresh: " << cholesky_thresh << endl;
+  cout << "eri_file: " << eri_file << endl;
 }
 void CalcMat() {
   
@@ -125,17 +154,67 @@ void CalcMain() {
     cerr << e.what() << endl;
     exit(1);
   }
+  if(eri_method.direct == 1) {
+    try {
+      mo = CalcRHF_Direct(gtos, mat_set, eri_method, num_ele, max_iter, tol, &conv, 1);
+    } catch(exception& e) {
+      cerr << "error on RHF" << endl;
+      cerr << e.what() << endl;
+      exit(1);
+    }
+    return;
+  }
+  if(aux || cholesky_thresh > 0.0) {
+    RI ri;
+    try {
+      if(aux)
+	ri = NewRI(gtos, aux, eri_method);
+      else
+	ri = NewRI_Cholesky(gtos, eri_method, cholesky_thresh);
+    } catch(exception& e) {
+      cerr << "error on density fitting" << endl;
+      cerr << e.what() << endl;
+      exit(1);
+    }
+    try {
+      mo = CalcRHF_RI(sym, mat_set, ri, eri_method, num_ele, max_iter, tol, &conv, 1);
+    } catch(exception& e) {
+      cerr << "error on RHF" << endl;
+      cerr << e.what() << endl;
+      exit(1);
+    }
+    return;
+  }
+  
   B2EInt  eri;
+  ERIStat eri_stat;
   try {
-    eri = CalcERI_Complex(gtos, eri_method);
+    if(eri_file != "" && ifstream(eri_file.c_str()).good()) {
+      eri = ERIRead(eri_file);
+      B2EIntSparse* blk(dynamic_cast<B2EIntSparse*>(eri.get()));
+      if(blk == NULL) {
+	THROW_ERROR("eri_file is not block ERI file");
+      }
+      vector<int> num_basis;
+      for(Irrep irrep = 0; irrep < sym->order(); irrep++)
+	num_basis.push_back(gtos->size_basis_isym(irrep));
+      if(blk->num_basis() != num_basis) {
+	THROW_ERROR("eri_file is for another basis. remove it to recompute");
+      }
+    } else if(eri_file != "")
+      eri = CalcERI_File(gtos, eri_method, eri_file, &eri_stat);
+    else
+      eri = CalcERI_Complex(gtos, eri_method, &eri_stat);
   } catch(exception& e) {
     cerr << "error on calculating eri" << endl;
     cerr << e.what() << endl;
     exit(1);
   } 
+  cout << "ERI_num_computed: " << eri_stat.num_computed << endl;
+  cout << "ERI_num_skipped: " << eri_stat.num_skipped << endl;
 
   try {
-    mo = CalcRHF(sym, mat_set, eri, num_ele, max_iter, tol, &conv, 1);
+    mo = CalcRHF(sym, mat_set, eri, eri_method, num_ele, max_iter, tol, &conv, 1);
   } catch(exception& e) {
     cerr << "error on RHF" << endl;
     cerr << e.what() << endl;
@@ -1,6 +1,14 @@
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
+#include <cstdlib>
+#include <cmath>
+#include <cfloat>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "b2eint.hpp"
 
 namespace cbasis {
@@ -32,6 +40,141 @@ namespace cbasis {
     }
     return true;
   }
+  dcomplex& IB2EInt::Ref(int, int, int, int, int, int, int, int) {
+    string msg; SUB_LOCATION(msg);
+    msg += ": Ref is not supported for this type.";
+    throw runtime_error(msg);
+  }
+  void PermImage(int g, const int *x, int *y) {
+    /*
+      g-th permutation image of index list x={ib,jb,kb,lb,i,j,k,l}
+      for (ij|kl)=(ji|kl)=(ij|lk)=(kl|ij).
+     */
+    static const int perm[8][4] = {{0,1,2,3}, {1,0,2,3}, {0,1,3,2}, {1,0,3,2},
+				   {2,3,0,1}, {3,2,0,1}, {2,3,1,0}, {3,2,1,0}};
+    for(int a = 0; a < 4; a++) {
+      y[a]   = x[perm[g][a]];
+      y[4+a] = x[4+perm[g][a]];
+    }
+  }
+  int ERIImages(int type, const int *x, int *y) {
+    if(type != ERI_TYPE_PERM8) {
+      copy(x, x+8, y);
+      return 1;
+    }
+    int num(0);
+    for(int g = 0; g < 8; g++) {
+      PermImage(g, x, &y[8*num]);
+      bool dup(false);
+      for(int h = 0; h < num; h++)
+	if(equal(&y[8*num], &y[8*num+8], &y[8*h]))
+	  dup = true;
+      if(not dup)
+	num++;
+    }
+    return num;
+  }
+  int IB2EInt::num_chunk() const {
+    return 1;
+  }
+  void IB2EInt::GetChunk(int n, ERIChunk *c) {
+    if(n != 0) {
+      THROW_ERROR("chunk index out of range");
+    }
+#pragma omp critical(b2eint_chunk)
+    {
+      int ib,jb,kb,lb,i,j,k,l,t;
+      dcomplex v;
+      c->Alloc(this->size());
+      int e(0);
+      this->Reset();
+      while(e < c->num &&
+	    this->GetPacked(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+	c->SetEntry(e, ib, jb, kb, lb, i, j, k, l, t);
+	c->v_buf[e] = v;
+	e++;
+      }
+      c->num = e;
+      this->Reset();
+    }
+  }
+  void IB2EInt::Append(const vector<IB2EInt*>& src, int) {
+    ERIChunk c;
+    for(int a = 0; a < (int)src.size(); a++)
+      for(int n = 0; n < src[a]->num_chunk(); n++) {
+	src[a]->GetChunk(n, &c);
+	for(int e = 0; e < c.num; e++)
+	  this->Set(c.ib[e], c.jb[e], c.kb[e], c.lb[e],
+		    c.i[e], c.j[e], c.k[e], c.l[e], c.t[e], c.value(e));
+      }
+  }
+  
+  // ==== Chunk ====
+  ERIChunk::ERIChunk(): num(0), ib(NULL), jb(NULL), kb(NULL), lb(NULL),
+			i(NULL), j(NULL), k(NULL), l(NULL), t(NULL), v(NULL),
+			prec(ERI_PREC_DOUBLE), raw(NULL), scale(0.0) {}
+  void ERIChunk::Alloc(int n, bool use_v_buf) {
+    num = n;
+    prec = ERI_PREC_DOUBLE;
+    raw = NULL;
+    idx_buf.resize(9 * max(n, 1));
+    int* p(&idx_buf[0]);
+    ib = p;     jb = p+n;   kb = p+2*n; lb = p+3*n;
+    i  = p+4*n; j  = p+5*n; k  = p+6*n; l  = p+7*n;
+    t  = p+8*n;
+    if(use_v_buf) {
+      v_buf.resize(max(n, 1));
+      v = &v_buf[0];
+    }
+  }
+  void ERIChunk::SetEntry(int e, int xib, int xjb, int xkb, int xlb,
+			  int xi, int xj, int xk, int xl, int xt) {
+    int* p(&idx_buf[e]);
+    p[0]     = xib; p[num]   = xjb; p[2*num] = xkb; p[3*num] = xlb;
+    p[4*num] = xi;  p[5*num] = xj;  p[6*num] = xk;  p[7*num] = xl;
+    p[8*num] = xt;
+  }
+  void ERIChunk::Entry(int e, int *x) const {
+    x[0] = ib[e]; x[1] = jb[e]; x[2] = kb[e]; x[3] = lb[e];
+    x[4] = i[e];  x[5] = j[e];  x[6] = k[e];  x[7] = l[e];
+  }
+  int ERIChunk::Images(int e, int *y) const {
+    int x[8];
+    this->Entry(e, x);
+    return ERIImages(t[e], x, y);
+  }
+  
+  void WritePacked(IB2EInt* eri, string fn) {
+
+    ofstream f;
+    f.open(fn.c_str(), ios::out|ios::binary|ios::trunc);
+    
+    if(!f) {
+      string msg; SUB_LOCATION(msg); msg+=": file not found";
+      throw runtime_error(msg);
+    }
+
+    int num(eri->size());
+    f.write((char*)&num, sizeof(int));
+
+    int ib,jb,kb,lb,i,j,k,l,t;
+    dcomplex v;
+    eri->Reset();
+    while(eri->GetPacked(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+      f.write((char*)&ib, sizeof(int));
+      f.write((char*)&jb, sizeof(int));
+      f.write((char*)&kb, sizeof(int));
+      f.write((char*)&lb, sizeof(int));
+      f.write((char*)&i,  sizeof(int));
+      f.write((char*)&j,  sizeof(int));
+      f.write((char*)&k,  sizeof(int));
+      f.write((char*)&l,  sizeof(int));
+      f.write((char*)&t,  sizeof(int));
+      f.write((char*)&v,  sizeof(dcomplex));
+    }
+    f.close();
+
+  }
 
   // ==== Mem version ====
   // ---- Constructors ----
@@ -49,22 +192,57 @@ namespace cbasis {
     capacity_ = num;
     size_ = 0;
     idx_ = 0;
-    ibs.reserve(num);
-    jbs.reserve(num);
-    kbs.reserve(num);
-    lbs.reserve(num);
+    img_ = 0;
+    ibs.clear(); ibs.reserve(num);
+    jbs.clear(); jbs.reserve(num);
+    kbs.clear(); kbs.reserve(num);
+    lbs.clear(); lbs.reserve(num);
 
-    is.reserve(num);
-    js.reserve(num);
-    ks.reserve(num);
-    ls.reserve(num);
+    is.clear(); is.reserve(num);
+    js.clear(); js.reserve(num);
+    ks.clear(); ks.reserve(num);
+    ls.clear(); ls.reserve(num);
 
-    ts.reserve(num);
-    vs.reserve(num);
+    ts.clear(); ts.reserve(num);
+    vs.clear(); vs.reserve(num);
   }
   bool B2EIntMem::Get(int *ib, int *jb, int *kb, int *lb,
 		      int *i, int *j, int *k, int *l,
 		      int *type, dcomplex *val) {
+
+    while(this->idx_ < this->size_) {
+      int n(this->idx_);
+      if(this->ts[n] != ERI_TYPE_PERM8) 
+	return this->GetPacked(ib, jb, kb, lb, i, j, k, l, type, val);
+      
+      int x[8] = {ibs[n], jbs[n], kbs[n], lbs[n], is[n], js[n], ks[n], ls[n]};
+      int y[8], z[8];
+      // -- skip images already returned for this entry. --
+      while(this->img_ < 8) {
+	PermImage(this->img_, x, y);
+	bool dup(false);
+	for(int h = 0; h < this->img_; h++) {
+	  PermImage(h, x, z);
+	  if(equal(y, y+8, z))
+	    dup = true;
+	}
+	this->img_++;
+	if(not dup) {
+	  *ib = y[0]; *jb = y[1]; *kb = y[2]; *lb = y[3];
+	  *i  = y[4]; *j  = y[5]; *k  = y[6]; *l  = y[7];
+	  *type = this->ts[n];
+	  *val  = this->vs[n];
+	  return true;
+	}
+      }
+      this->img_ = 0;
+      this->idx_++;
+    }
+    return false;
+  }
+  bool B2EIntMem::GetPacked(int *ib, int *jb, int *kb, int *lb,
+			    int *i, int *j, int *k, int *l,
+			    int *type, dcomplex *val) {
     if(this->idx_ >= this->size_ ) {
       return false;
     }
@@ -79,69 +257,1264 @@ namespace cbasis {
     *type = this->ts[this->idx_];
     *val  = this->vs[this->idx_];
     this->idx_++;
+    this->img_ = 0;
     return true;
   }
   bool B2EIntMem::Set(int ib, int jb, int kb, int lb,
 		      int i, int j, int k, int l,
 		      dcomplex val) {
-    this->ibs[this->size_] = ib;
-    this->jbs[this->size_] = jb;
-    this->kbs[this->size_] = kb;
-    this->lbs[this->size_] = lb;
-    this->is[this->size_]  = i;
-    this->js[this->size_]  = j;
-    this->ks[this->size_]  = k;
-    this->ls[this->size_]  = l;
-    this->ts[this->size_]  = 0;
-    this->vs[this->size_]  = val;
+    return this->Set(ib, jb, kb, lb, i, j, k, l, ERI_TYPE_PLAIN, val);
+  }
+  bool B2EIntMem::Set(int ib, int jb, int kb, int lb,
+		      int i, int j, int k, int l,
+		      int type, dcomplex val) {
+    // -- grows beyond Init(num) if necessary --
+    this->ibs.push_back(ib);
+    this->jbs.push_back(jb);
+    this->kbs.push_back(kb);
+    this->lbs.push_back(lb);
+    this->is.push_back(i);
+    this->js.push_back(j);
+    this->ks.push_back(k);
+    this->ls.push_back(l);
+    this->ts.push_back(type);
+    this->vs.push_back(val);
     this->size_++;
+    if(this->size_ > this->capacity_)
+      this->capacity_ = this->size_;
     return true;
   }
+  dcomplex& B2EIntMem::Ref(int ib, int jb, int kb, int lb,
+			   int i, int j, int k, int l) {
+    int x[8] = {ib, jb, kb, lb, i, j, k, l};
+    for(int n = 0; n < this->size_; n++) {
+      int y[8] = {ibs[n], jbs[n], kbs[n], lbs[n], is[n], js[n], ks[n], ls[n]};
+      int z[8];
+      int num_img(this->ts[n] == ERI_TYPE_PERM8 ? 8 : 1);
+      for(int g = 0; g < num_img; g++) {
+	PermImage(g, y, z);
+	if(equal(x, x+8, z))
+	  return this->vs[n];
+      }
+    }
+    string msg; SUB_LOCATION(msg); 
+    msg += ": failed to find given index list.";
+    throw runtime_error(msg);
+  }
+  static const int kMemChunk = 4096;
+  int B2EIntMem::num_chunk() const {
+    return (size_ + kMemChunk - 1) / kMemChunk;
+  }
+  void B2EIntMem::GetChunk(int n, ERIChunk *c) {
+    if(n < 0 || n >= this->num_chunk()) {
+      THROW_ERROR("chunk index out of range");
+    }
+    int e0(n * kMemChunk);
+    c->num = min(kMemChunk, size_ - e0);
+    c->ib = &ibs[e0]; c->jb = &jbs[e0]; c->kb = &kbs[e0]; c->lb = &lbs[e0];
+    c->i  = &is[e0];  c->j  = &js[e0];  c->k  = &ks[e0];  c->l  = &ls[e0];
+    c->t  = &ts[e0];
+    c->v  = &vs[e0];
+    c->prec = ERI_PREC_DOUBLE;
+    c->raw = NULL;
+  }
+  void B2EIntMem::Append(const vector<IB2EInt*>& src, int num_threads) {
+    /*
+      Entries of src[a] go to [offset[a], offset[a+1]), offsets being the
+      running sum of src sizes, so that the copies need no lock.
+    */
+    int num_src(src.size());
+    vector<int> offset(num_src + 1, size_);
+    for(int a = 0; a < num_src; a++)
+      offset[a+1] = offset[a] + src[a]->size();
+    int num(offset[num_src]);
+    ibs.resize(num); jbs.resize(num); kbs.resize(num); lbs.resize(num);
+    is.resize(num);  js.resize(num);  ks.resize(num);  ls.resize(num);
+    ts.resize(num);  vs.resize(num);
+
+    string err_msg;
+#pragma omp parallel for schedule(dynamic) num_threads(max(1, num_threads))
+    for(int a = 0; a < num_src; a++) {
+      ERIChunk c;
+      int e0(offset[a]);
+      try {
+	for(int n = 0; n < src[a]->num_chunk(); n++) {
+	  src[a]->GetChunk(n, &c);
+	  if(e0 + c.num > offset[a+1]) {
+	    THROW_ERROR("size of src is less than its entries");
+	  }
+	  copy(c.ib, c.ib + c.num, &ibs[e0]); copy(c.jb, c.jb + c.num, &jbs[e0]);
+	  copy(c.kb, c.kb + c.num, &kbs[e0]); copy(c.lb, c.lb + c.num, &lbs[e0]);
+	  copy(c.i,  c.i  + c.num, &is[e0]);  copy(c.j,  c.j  + c.num, &js[e0]);
+	  copy(c.k,  c.k  + c.num, &ks[e0]);  copy(c.l,  c.l  + c.num, &ls[e0]);
+	  copy(c.t,  c.t  + c.num, &ts[e0]);
+	  if(c.prec == ERI_PREC_DOUBLE)
+	    copy(c.v, c.v + c.num, &vs[e0]);
+	  else
+	    for(int e = 0; e < c.num; e++)
+	      vs[e0 + e] = c.value(e);
+	  e0 += c.num;
+	}
+	if(e0 != offset[a+1]) {
+	  THROW_ERROR("size of src is more than its entries");
+	}
+      } catch(exception& e) {
+#pragma omp critical(b2eint_err)
+	err_msg = e.what();
+      }
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+    size_ = num;
+    capacity_ = max(capacity_, num);
+  }
   void B2EIntMem::Reset() {
     idx_ = 0;
+    img_ = 0;
   }
   void B2EIntMem::Write(string fn) {
+    WritePacked(this, fn);
+  }
+  int B2EIntMem::size() const {
+    return this->size_;
+  }
+  int B2EIntMem::capacity() const {
+    return this->capacity_;
+  }
 
-    ofstream f;
-    f.open(fn.c_str(), ios::out|ios::binary|ios::trunc);
-    
-    if(!f) {
-      string msg; SUB_LOCATION(msg); msg+=": file not found";
+  // ==== Block version ====
+  // ---- Constructors ----
+  B2EIntBlock::B2EIntBlock(const vector<int>& num_basis): num_basis_(num_basis) {
+    this->Init(1);
+  }
+  B2EIntBlock::B2EIntBlock(const vector<int>& num_basis, int num):
+    num_basis_(num_basis) {
+    this->Init(num);
+  }
+  B2EIntBlock::~B2EIntBlock() {}
+
+  // ---- Index ----
+  int B2EIntBlock::Block(int ib, int jb, int kb, int lb) const {
+    int n(num_basis_.size());
+    return ((ib*n + jb)*n + kb)*n + lb;
+  }
+  long long B2EIntBlock::Pos(int ib, int jb, int kb, int lb,
+			     int i, int j, int k, int l) const {
+    int n(num_basis_.size());
+    if(ib < 0 || n <= ib || jb < 0 || n <= jb ||
+       kb < 0 || n <= kb || lb < 0 || n <= lb)
+      return -1;
+    int ni(num_basis_[ib]), nj(num_basis_[jb]);
+    int nk(num_basis_[kb]), nl(num_basis_[lb]);
+    if(i < 0 || ni <= i || j < 0 || nj <= j ||
+       k < 0 || nk <= k || l < 0 || nl <= l)
+      return -1;
+    long long off(block_offset_[this->Block(ib, jb, kb, lb)]);
+    if(off < 0)
+      return -1;
+    return off + (((long long)i*nj + j)*nk + k)*nl + l;
+  }
+  long long B2EIntBlock::NewPos(int ib, int jb, int kb, int lb,
+				int i, int j, int k, int l) {
+    int n(num_basis_.size());
+    if(ib < 0 || n <= ib || jb < 0 || n <= jb ||
+       kb < 0 || n <= kb || lb < 0 || n <= lb ||
+       i < 0 || num_basis_[ib] <= i || j < 0 || num_basis_[jb] <= j ||
+       k < 0 || num_basis_[kb] <= k || l < 0 || num_basis_[lb] <= l) {
+      string msg; SUB_LOCATION(msg);
+      msg += ": index out of range.";
       throw runtime_error(msg);
     }
+    int b(this->Block(ib, jb, kb, lb));
+    if(block_offset_[b] < 0) {
+      block_offset_[b] = vs_.size();
+      blocks_.push_back(b);
+      long long num((long long)num_basis_[ib] * num_basis_[jb] *
+		    num_basis_[kb] * num_basis_[lb]);
+      vs_.resize(vs_.size() + num, 0.0);
+      stored_.resize(stored_.size() + num, 0);
+    }
+    return this->Pos(ib, jb, kb, lb, i, j, k, l);
+  }
+  void B2EIntBlock::Index(int blk, long long p, int *x) const {
+    int n(num_basis_.size());
+    int b(blocks_[blk]);
+    x[3] = b % n; b /= n; x[2] = b % n; b /= n;
+    x[1] = b % n; b /= n; x[0] = b;
+    long long r(p - block_offset_[blocks_[blk]]);
+    x[7] = r % num_basis_[x[3]]; r /= num_basis_[x[3]];
+    x[6] = r % num_basis_[x[2]]; r /= num_basis_[x[2]];
+    x[5] = r % num_basis_[x[1]]; r /= num_basis_[x[1]];
+    x[4] = (int)r;
+  }
 
-    int num(this->size());
-    f.write((char*)&num, sizeof(int));
+  // ---- Main ----
+  void B2EIntBlock::Init(int num) {
+    int n(num_basis_.size());
+    capacity_ = num;
+    num_ = 0;
+    block_offset_.assign(n*n*n*n, -1);
+    blocks_.clear();
+    vs_.clear();
+    stored_.clear();
+    this->Reset();
+  }
+  bool B2EIntBlock::Get(int *ib, int *jb, int *kb, int *lb,
+			int *i, int *j, int *k, int *l,
+			int *type, dcomplex *val) {
+    return this->GetPacked(ib, jb, kb, lb, i, j, k, l, type, val);
+  }
+  bool B2EIntBlock::GetPacked(int *ib, int *jb, int *kb, int *lb,
+			      int *i, int *j, int *k, int *l,
+			      int *type, dcomplex *val) {
+    long long num_pos(vs_.size());
+    while(pos_ < num_pos && not stored_[pos_])
+      pos_++;
+    if(pos_ >= num_pos)
+      return false;
+    while(iblk_+1 < (int)blocks_.size() && block_offset_[blocks_[iblk_+1]] <= pos_)
+      iblk_++;
+    int x[8];
+    this->Index(iblk_, pos_, x);
+    *ib = x[0]; *jb = x[1]; *kb = x[2]; *lb = x[3];
+    *i  = x[4]; *j  = x[5]; *k  = x[6]; *l  = x[7];
+    *type = ERI_TYPE_PLAIN;
+    *val  = vs_[pos_];
+    pos_++;
+    return true;
+  }
+  bool B2EIntBlock::Set(int ib, int jb, int kb, int lb,
+			int i, int j, int k, int l,
+			dcomplex val) {
+    return this->Set(ib, jb, kb, lb, i, j, k, l, ERI_TYPE_PLAIN, val);
+  }
+  bool B2EIntBlock::Set(int ib, int jb, int kb, int lb,
+			int i, int j, int k, int l,
+			int type, dcomplex val) {
+    int x[8] = {ib, jb, kb, lb, i, j, k, l};
+    int num_img(type == ERI_TYPE_PERM8 ? 8 : 1);
+    for(int g = 0; g < num_img; g++) {
+      int y[8];
+      PermImage(g, x, y);
+      long long p(this->NewPos(y[0], y[1], y[2], y[3], y[4], y[5], y[6], y[7]));
+      if(not stored_[p]) {
+	stored_[p] = 1;
+	num_++;
+      }
+      vs_[p] = val;
+    }
+    return true;
+  }
+  dcomplex B2EIntBlock::At(int ib, int jb, int kb, int lb,
+			   int i, int j, int k, int l) {
+    long long p(this->Pos(ib, jb, kb, lb, i, j, k, l));
+    if(p < 0 || not stored_[p]) {
+      string msg; SUB_LOCATION(msg); 
+      msg += ": failed to find given index list.";
+      throw runtime_error(msg);
+    }
+    return vs_[p];
+  }
+  bool B2EIntBlock::Exist(int ib, int jb, int kb, int lb,
+			  int i, int j, int k, int l) {
+    long long p(this->Pos(ib, jb, kb, lb, i, j, k, l));
+    return p >= 0 && stored_[p];
+  }
+  dcomplex& B2EIntBlock::Ref(int ib, int jb, int kb, int lb,
+			     int i, int j, int k, int l) {
+    if(!this->Exist(ib, jb, kb, lb, i, j, k, l))
+      this->Set(ib, jb, kb, lb, i, j, k, l, 0.0);
+    return vs_[this->Pos(ib, jb, kb, lb, i, j, k, l)];
+  }
+  int B2EIntBlock::num_chunk() const {
+    /* kMemChunk positions (stored or not) for each chunk */
+    return (vs_.size() + kMemChunk - 1) / kMemChunk;
+  }
+  void B2EIntBlock::GetChunk(int n, ERIChunk *c) {
+    if(n < 0 || n >= this->num_chunk()) {
+      THROW_ERROR("chunk index out of range");
+    }
+    long long p0((long long)n * kMemChunk);
+    long long p1(min(p0 + kMemChunk, (long long)vs_.size()));
+    int blk(0);
+    while(blk+1 < (int)blocks_.size() && block_offset_[blocks_[blk+1]] <= p0)
+      blk++;
+    c->Alloc((int)(p1 - p0));
+    int e(0), x[8];
+    for(long long p = p0; p < p1; p++) {
+      while(blk+1 < (int)blocks_.size() && block_offset_[blocks_[blk+1]] <= p)
+	blk++;
+      if(not stored_[p])
+	continue;
+      this->Index(blk, p, x);
+      c->SetEntry(e, x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7], ERI_TYPE_PLAIN);
+      c->v_buf[e] = vs_[p];
+      e++;
+    }
+    c->num = e;
+  }
+  void B2EIntBlock::Reset() {
+    iblk_ = 0;
+    pos_ = 0;
+  }
+  void B2EIntBlock::Write(string fn) {
+    WritePacked(this, fn);
+  }
+  int B2EIntBlock::size() const {
+    return num_;
+  }
+  int B2EIntBlock::capacity() const {
+    return capacity_;
+  }
+
+  // ==== Block sparse version ====
+  // ---- Constructors ----
+  B2EIntSparse::B2EIntSparse(): vs_(NULL), num_(0) {}
+  B2EIntSparse::B2EIntSparse(SymmetryGroup sym, const vector<int>& num_basis, bool fold) {
+    this->SetLayout(num_basis, fold, Non0Blocks(sym, num_basis.size(), fold));
+    data_.resize(num_, 0.0);
+    vs_ = num_ > 0 ? &data_[0] : NULL;
+  }
+  B2EIntSparse::~B2EIntSparse() {}
+  vector<int> B2EIntSparse::Non0Blocks(SymmetryGroup sym, int n, bool fold) {
+    vector<int> blocks;
+    for(int ib = 0; ib < n; ib++)
+    for(int jb = 0; jb < n; jb++)
+    for(int kb = 0; kb < n; kb++)
+    for(int lb = 0; lb < n; lb++) {
+      if(not sym->Non0_4(ib, jb, kb, lb))
+	continue;
+      if(fold && (ib < jb || kb < lb || ib < kb || (ib == kb && jb < lb)))
+	continue;
+      blocks.push_back(((ib*n + jb)*n + kb)*n + lb);
+    }
+    return blocks;
+  }
+  void B2EIntSparse::SetLayout(const vector<int>& num_basis, bool fold,
+			       const vector<int>& blocks) {
+    num_basis_ = num_basis;
+    fold_ = fold;
+    blocks_ = blocks;
+    
+    int n(num_basis_.size());
+    pairs_.clear();
+    pairs_.resize(n*n);
+    for(int ib = 0; ib < n; ib++)
+      for(int jb = 0; jb < n; jb++) 
+	for(int i = 0; i < num_basis_[ib]; i++)
+	  for(int j = 0; j < num_basis_[jb]; j++)
+	    if(not fold_ || ib != jb || i >= j)
+	      pairs_[ib*n+jb].push_back(i*num_basis_[jb]+j);
 
+    block_offset_.assign(n*n*n*n, -1);
+    num_ = 0;
+    for(vector<int>::const_iterator it = blocks_.begin(); it != blocks_.end(); ++it) {
+      int b(*it);
+      int lb(b % n); b /= n; int kb(b % n); b /= n;
+      int jb(b % n); b /= n; int ib(b);
+      int nij(this->NumPair(ib, jb)), nkl(this->NumPair(kb, lb));
+      block_offset_[*it] = num_;
+      if(fold_ && ib == kb && jb == lb)
+	num_ += nij*(nij+1)/2;
+      else
+	num_ += nij*nkl;
+    }
     this->Reset();
-    int ib,jb,kb,lb,i,j,k,l,t;
-    dcomplex v;
+  }
+  int B2EIntSparse::block_size(int blk) const {
+    int end(blk+1 < (int)blocks_.size() ? block_offset_[blocks_[blk+1]] : num_);
+    return end - block_offset_[blocks_[blk]];
+  }
+
+  // ---- Index ----
+  int B2EIntSparse::NumPair(int ib, int jb) const {
+    return pairs_[ib*num_basis_.size() + jb].size();
+  }
+  int B2EIntSparse::PairIdx(int ib, int jb, int i, int j) const {
+    if(fold_ && ib == jb)
+      return i*(i+1)/2 + j;
+    return i*num_basis_[jb] + j;
+  }
+  void B2EIntSparse::Canonical(int *x) const {
+    if(x[0] < x[1] || (x[0] == x[1] && x[4] < x[5])) {
+      swap(x[0], x[1]); swap(x[4], x[5]);
+    }
+    if(x[2] < x[3] || (x[2] == x[3] && x[6] < x[7])) {
+      swap(x[2], x[3]); swap(x[6], x[7]);
+    }
+    if(x[0] < x[2] || (x[0] == x[2] && x[1] < x[3]) ||
+       (x[0] == x[2] && x[1] == x[3] &&
+	this->PairIdx(x[0], x[1], x[4], x[5]) < this->PairIdx(x[2], x[3], x[6], x[7]))) {
+      for(int a = 0; a < 2; a++) {
+	swap(x[a], x[2+a]); swap(x[4+a], x[6+a]);
+      }
+    }
+  }
+  int B2EIntSparse::Pos(int ib, int jb, int kb, int lb,
+			int i, int j, int k, int l) const {
+    int n(num_basis_.size());
+    if(ib < 0 || n <= ib || jb < 0 || n <= jb ||
+       kb < 0 || n <= kb || lb < 0 || n <= lb ||
+       i < 0 || num_basis_[ib] <= i || j < 0 || num_basis_[jb] <= j ||
+       k < 0 || num_basis_[kb] <= k || l < 0 || num_basis_[lb] <= l)
+      return -1;
+    int x[8] = {ib, jb, kb, lb, i, j, k, l};
+    if(fold_)
+      this->Canonical(x);
+    int off(block_offset_[((x[0]*n + x[1])*n + x[2])*n + x[3]]);
+    if(off < 0)
+      return -1;
+    int ij(this->PairIdx(x[0], x[1], x[4], x[5]));
+    int kl(this->PairIdx(x[2], x[3], x[6], x[7]));
+    if(fold_ && x[0] == x[2] && x[1] == x[3])
+      return off + ij*(ij+1)/2 + kl;
+    return off + ij*this->NumPair(x[2], x[3]) + kl;
+  }
+  dcomplex B2EIntSparse::Value(int p) {
+    return vs_[p];
+  }
+  bool B2EIntSparse::Current(int *x, int *p) {
+    /* index list and position of value at cursor. false if end. */
+    int n(num_basis_.size()), nblk(blocks_.size());
+    while(iblk_ < nblk) {
+      int b(blocks_[iblk_]);
+      x[3] = b % n; b /= n; x[2] = b % n; b /= n;
+      x[1] = b % n; b /= n; x[0] = b;
+      int nij(this->NumPair(x[0], x[1])), nkl(this->NumPair(x[2], x[3]));
+      bool tri(fold_ && x[0] == x[2] && x[1] == x[3]);
+      if(ij_ < nij && kl_ < nkl) {
+	int pij(pairs_[x[0]*n + x[1]][ij_]), pkl(pairs_[x[2]*n + x[3]][kl_]);
+	x[4] = pij / num_basis_[x[1]]; x[5] = pij % num_basis_[x[1]];
+	x[6] = pkl / num_basis_[x[3]]; x[7] = pkl % num_basis_[x[3]];
+	*p = block_offset_[blocks_[iblk_]] + (tri ? ij_*(ij_+1)/2 : ij_*nkl) + kl_;
+	return true;
+      }
+      iblk_++; ij_ = 0; kl_ = 0; img_ = 0;
+    }
+    return false;
+  }
+  void B2EIntSparse::Advance() {
+    int n(num_basis_.size());
+    int b(blocks_[iblk_]);
+    int lb(b % n); b /= n; int kb(b % n); b /= n;
+    int jb(b % n); b /= n; int ib(b);
+    bool tri(fold_ && ib == kb && jb == lb);
+    kl_++;
+    img_ = 0;
+    if(kl_ == (tri ? ij_+1 : this->NumPair(kb, lb))) {
+      kl_ = 0; ij_++;
+    }
+    if(ij_ == this->NumPair(ib, jb)) {
+      ij_ = 0; iblk_++;
+    }
+  }
+
+  // ---- Main ----
+  void B2EIntSparse::Init(int) {
+    fill(vs_, vs_ + num_, dcomplex(0.0));
     this->Reset();
-    while(this->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-      f.write((char*)&ib, sizeof(int));
-      f.write((char*)&jb, sizeof(int));
-      f.write((char*)&kb, sizeof(int));
-      f.write((char*)&lb, sizeof(int));
-      f.write((char*)&i,  sizeof(int));
-      f.write((char*)&j,  sizeof(int));
-      f.write((char*)&k,  sizeof(int));
-      f.write((char*)&l,  sizeof(int));
-      f.write((char*)&t,  sizeof(int));
-      f.write((char*)&v,  sizeof(dcomplex));
+  }
+  bool B2EIntSparse::Get(int *ib, int *jb, int *kb, int *lb,
+			 int *i, int *j, int *k, int *l,
+			 int *type, dcomplex *val) {
+    if(not fold_) 
+      return this->GetPacked(ib, jb, kb, lb, i, j, k, l, type, val);
+
+    int x[8], y[8], z[8], p;
+    while(this->Current(x, &p)) {
+      // -- skip images already returned for this value. --
+      while(img_ < 8) {
+	PermImage(img_, x, y);
+	bool dup(false);
+	for(int h = 0; h < img_; h++) {
+	  PermImage(h, x, z);
+	  if(equal(y, y+8, z))
+	    dup = true;
+	}
+	img_++;
+	if(not dup) {
+	  *ib = y[0]; *jb = y[1]; *kb = y[2]; *lb = y[3];
+	  *i  = y[4]; *j  = y[5]; *k  = y[6]; *l  = y[7];
+	  *type = ERI_TYPE_PERM8;
+	  *val  = this->Value(p);
+	  return true;
+	}
+      }
+      this->Advance();
+    }
+    return false;
+  }
+  bool B2EIntSparse::GetPacked(int *ib, int *jb, int *kb, int *lb,
+			       int *i, int *j, int *k, int *l,
+			       int *type, dcomplex *val) {
+    int x[8], p;
+    if(not this->Current(x, &p))
+      return false;
+    *ib = x[0]; *jb = x[1]; *kb = x[2]; *lb = x[3];
+    *i  = x[4]; *j  = x[5]; *k  = x[6]; *l  = x[7];
+    *type = fold_ ? ERI_TYPE_PERM8 : ERI_TYPE_PLAIN;
+    *val  = this->Value(p);
+    this->Advance();
+    return true;
+  }
+  bool B2EIntSparse::Set(int ib, int jb, int kb, int lb,
+			 int i, int j, int k, int l,
+			 dcomplex val) {
+    return this->Set(ib, jb, kb, lb, i, j, k, l, ERI_TYPE_PLAIN, val);
+  }
+  bool B2EIntSparse::Set(int ib, int jb, int kb, int lb,
+			 int i, int j, int k, int l,
+			 int type, dcomplex val) {
+    int x[8] = {ib, jb, kb, lb, i, j, k, l};
+    int num_img(type == ERI_TYPE_PERM8 && not fold_ ? 8 : 1);
+    for(int g = 0; g < num_img; g++) {
+      int y[8];
+      PermImage(g, x, y);
+      int p(this->Pos(y[0], y[1], y[2], y[3], y[4], y[5], y[6], y[7]));
+      if(p >= 0)
+	vs_[p] = val;
+    }
+    return true;
+  }
+  dcomplex B2EIntSparse::At(int ib, int jb, int kb, int lb,
+			    int i, int j, int k, int l) {
+    int p(this->Pos(ib, jb, kb, lb, i, j, k, l));
+    if(p < 0) {
+      string msg; SUB_LOCATION(msg); 
+      msg += ": given index list is not stored.";
+      throw runtime_error(msg);
+    }
+    return this->Value(p);
+  }
+  bool B2EIntSparse::Exist(int ib, int jb, int kb, int lb,
+			   int i, int j, int k, int l) {
+    return this->Pos(ib, jb, kb, lb, i, j, k, l) >= 0;
+  }
+  dcomplex& B2EIntSparse::Ref(int ib, int jb, int kb, int lb,
+			      int i, int j, int k, int l) {
+    int p(this->Pos(ib, jb, kb, lb, i, j, k, l));
+    if(p < 0) {
+      string msg; SUB_LOCATION(msg); 
+      msg += ": given index list is not stored.";
+      throw runtime_error(msg);
+    }
+    return vs_[p];
+  }
+  int B2EIntSparse::num_chunk() const {
+    return blocks_.size();
+  }
+  void B2EIntSparse::GetChunk(int n, ERIChunk *c) {
+    if(n < 0 || n >= this->num_chunk()) {
+      THROW_ERROR("chunk index out of range");
     }
+    int nir(num_basis_.size());
+    int b(blocks_[n]);
+    int lb(b % nir); b /= nir; int kb(b % nir); b /= nir;
+    int jb(b % nir); b /= nir; int ib(b);
+    const vector<int>& pij(pairs_[ib*nir + jb]);
+    const vector<int>& pkl(pairs_[kb*nir + lb]);
+    bool tri(fold_ && ib == kb && jb == lb);
+    int t(fold_ ? ERI_TYPE_PERM8 : ERI_TYPE_PLAIN);
+    
+    // -- values are in order of (IJ, KL) in block --
+    c->Alloc(this->block_size(n), false);
+    c->v = vs_ + block_offset_[blocks_[n]];
+    int e(0);
+    for(int ij = 0; ij < (int)pij.size(); ij++) {
+      int i(pij[ij] / num_basis_[jb]), j(pij[ij] % num_basis_[jb]);
+      int nkl(tri ? ij+1 : (int)pkl.size());
+      for(int kl = 0; kl < nkl; kl++) {
+	c->SetEntry(e, ib, jb, kb, lb, i, j,
+		    pkl[kl] / num_basis_[lb], pkl[kl] % num_basis_[lb], t);
+	e++;
+      }
+    }
+  }
+  void B2EIntSparse::Reset() {
+    iblk_ = 0;
+    ij_ = 0;
+    kl_ = 0;
+    img_ = 0;
+  }
+  void B2EIntSparse::Write(string fn) {
+    this->WriteHeader(fn);
+    ofstream f(fn.c_str(), ios::out|ios::binary|ios::in);
+    f.seekp(this->value_offset());
+    f.write((char*)vs_, sizeof(dcomplex)*num_);
     f.close();
+  }
+  void B2EIntSparse::Append(const vector<IB2EInt*>& src, int num_threads) {
+    string err_msg;
+#pragma omp parallel for schedule(dynamic) num_threads(max(1, num_threads))
+    for(int a = 0; a < (int)src.size(); a++) {
+      ERIChunk c;
+      try {
+	for(int n = 0; n < src[a]->num_chunk(); n++) {
+	  src[a]->GetChunk(n, &c);
+	  for(int e = 0; e < c.num; e++)
+	    this->Set(c.ib[e], c.jb[e], c.kb[e], c.lb[e],
+		      c.i[e], c.j[e], c.k[e], c.l[e], c.t[e], c.value(e));
+	}
+      } catch(exception& e) {
+#pragma omp critical(b2eint_err)
+	err_msg = e.what();
+      }
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+  }
+  int B2EIntSparse::size() const {
+    return num_;
+  }
+  int B2EIntSparse::capacity() const {
+    return num_;
+  }
+  
+  // ---- File ----
+  /*
+    Block file format (version 1)
+    header     : char magic[8]="CBERIBLK", int version, int num_irrep,
+                 int fold, int num_block, long long num_value,
+                 long long value_offset
+    num_basis  : int[num_irrep]
+    block index: {int b, int dummy, long long offset, long long size}[num_block]
+                 with b=((ib*n+jb)*n+kb)*n+lb. offset is counted in values.
+    values     : dcomplex[num_value] at byte value_offset (multiple of 16)
+   */
+  static const char ERI_FILE_MAGIC[8] = {'C','B','E','R','I','B','L','K'};
+  static const int  ERI_FILE_VERSION = 1;
+  struct ERIFileHeader {
+    char magic[8];
+    int version;
+    int num_irrep;
+    int fold;
+    int num_block;
+    long long num_value;
+    long long value_offset;
+  };
+  struct ERIFileBlock {
+    int b;
+    int dummy;
+    long long offset;
+    long long size;
+  };
+  long long B2EIntSparse::value_offset() const {
+    long long n(sizeof(ERIFileHeader) + sizeof(int) * num_basis_.size() +
+		sizeof(ERIFileBlock) * blocks_.size());
+    return (n + 15) / 16 * 16;
+  }
+  void B2EIntSparse::WriteHeader(string fn) const {
+    /* header and block index. values are filled by 0. */
+    ofstream f(fn.c_str(), ios::out|ios::binary|ios::trunc);
+    if(!f) {
+      string msg; SUB_LOCATION(msg); msg+=": failed to open file";
+      throw runtime_error(msg);
+    }
+    ERIFileHeader h;
+    copy(ERI_FILE_MAGIC, ERI_FILE_MAGIC+8, h.magic);
+    h.version = ERI_FILE_VERSION;
+    h.num_irrep = num_basis_.size();
+    h.fold = fold_ ? 1 : 0;
+    h.num_block = blocks_.size();
+    h.num_value = num_;
+    h.value_offset = this->value_offset();
+    f.write((char*)&h, sizeof(h));
+    f.write((char*)&num_basis_[0], sizeof(int)*num_basis_.size());
+    for(int blk = 0; blk < (int)blocks_.size(); blk++) {
+      ERIFileBlock fb;
+      fb.b = blocks_[blk]; fb.dummy = 0;
+      fb.offset = block_offset_[blocks_[blk]];
+      fb.size = this->block_size(blk);
+      f.write((char*)&fb, sizeof(fb));
+    }
+    // -- extend file to full size. --
+    long long end(h.value_offset + sizeof(dcomplex)*num_);
+    if(end > f.tellp()) {
+      f.seekp(end - 1);
+      f.put(0);
+    }
+    f.close();
+  }
+  bool IsERIBlockFile(string fn) {
+    ifstream f(fn.c_str(), ios::in|ios::binary);
+    char magic[8];
+    if(!f || !f.read(magic, 8))
+      return false;
+    return equal(magic, magic+8, ERI_FILE_MAGIC);
+  }
+
+  // ==== Reduced precision ====
+  // ---- Constructors ----
+  B2EIntReduced::B2EIntReduced(SymmetryGroup sym, const vector<int>& num_basis,
+			       bool fold, double tol):
+    B2EIntSparse(sym, num_basis, fold), tol_(tol), compressed_(false),
+    max_err_(0.0), blk_(0) {}
+  B2EIntReduced::~B2EIntReduced() {}
+
+  // ---- Compression ----
+  void B2EIntReduced::Compress() {
+    if(compressed_)
+      return;
+    int nblk(blocks_.size());
+    prec_.resize(nblk);
+    scale_.assign(nblk, 0.0);
+    byte_offset_.resize(nblk);
+    start_.resize(nblk);
+    max_err_ = 0.0;
+
+    // -- precision of each block --
+    size_t nbyte(0);
+    for(int blk = 0; blk < nblk; blk++) {
+      int n(this->block_size(blk));
+      const dcomplex* v(vs_ + block_offset_[blocks_[blk]]);
+      double m(0.0);
+      for(int a = 0; a < n; a++) 
+	m = max(m, max(abs(v[a].real()), abs(v[a].imag())));
+      double scale(m > 0.0 ? ldexp(1.0, (int)ceil(log(m / 32767.0) / log(2.0))) : 0.0);
+      while(m > 0.0 && m / scale > 32767.0)
+	scale *= 2.0;
+      size_t elem;
+      if(scale * 0.5 <= tol_) {
+	prec_[blk] = ERI_PREC_INT16;
+	scale_[blk] = scale;
+	max_err_ = max(max_err_, scale * 0.5);
+	elem = 2*sizeof(short);
+      } else if(m * pow(2.0, -24) <= tol_ && m < FLT_MAX) {
+	prec_[blk] = ERI_PREC_FLOAT;
+	max_err_ = max(max_err_, m * pow(2.0, -24));
+	elem = 2*sizeof(float);
+      } else {
+	prec_[blk] = ERI_PREC_DOUBLE;
+	elem = sizeof(dcomplex);
+      }
+      start_[blk] = block_offset_[blocks_[blk]];
+      byte_offset_[blk] = nbyte;
+      nbyte += (elem * n + 15) / 16 * 16;
+    }
 
+    // -- encode --
+    bytes_.assign(max(nbyte, (size_t)1), 0);
+    for(int blk = 0; blk < nblk; blk++) {
+      int n(this->block_size(blk));
+      const dcomplex* v(vs_ + block_offset_[blocks_[blk]]);
+      char* dst(&bytes_[byte_offset_[blk]]);
+      if(prec_[blk] == ERI_PREC_INT16) {
+	short* q((short*)dst);
+	double inv(scale_[blk] > 0.0 ? 1.0 / scale_[blk] : 0.0);
+	for(int a = 0; a < n; a++) {
+	  q[2*a]   = (short)floor(v[a].real() * inv + 0.5);
+	  q[2*a+1] = (short)floor(v[a].imag() * inv + 0.5);
+	}
+      } else if(prec_[blk] == ERI_PREC_FLOAT) {
+	float* f((float*)dst);
+	for(int a = 0; a < n; a++) {
+	  f[2*a]   = (float)v[a].real();
+	  f[2*a+1] = (float)v[a].imag();
+	}
+      } else 
+	copy(v, v+n, (dcomplex*)dst);
+    }
+    vector<dcomplex>().swap(data_);
+    vs_ = NULL;
+    blk_ = 0;
+    compressed_ = true;
   }
-  int B2EIntMem::size() const {
-    return this->size_;
+  int B2EIntReduced::BlockOf(int p) {
+    /* block containing position p. blocks are sequential in Get. */
+    if(blk_ < (int)start_.size() && start_[blk_] <= p &&
+       (blk_+1 == (int)start_.size() || p < start_[blk_+1]))
+      return blk_;
+    blk_ = upper_bound(start_.begin(), start_.end(), p) - start_.begin() - 1;
+    return blk_;
   }
-  int B2EIntMem::capacity() const {
-    return this->capacity_;
+  void B2EIntReduced::Decode(int blk, dcomplex* v) const {
+    int n(this->block_size(blk));
+    const char* src(&bytes_[byte_offset_[blk]]);
+    if(prec_[blk] == ERI_PREC_INT16) {
+      const short* q((const short*)src);
+      double scale(scale_[blk]);
+      for(int a = 0; a < n; a++)
+	v[a] = dcomplex(q[2*a] * scale, q[2*a+1] * scale);
+    } else if(prec_[blk] == ERI_PREC_FLOAT) {
+      const float* f((const float*)src);
+      for(int a = 0; a < n; a++)
+	v[a] = dcomplex(f[2*a], f[2*a+1]);
+    } else {
+      const dcomplex* d((const dcomplex*)src);
+      copy(d, d+n, v);
+    }
+  }
+  dcomplex B2EIntReduced::Value(int p) {
+    if(not compressed_)
+      return vs_[p];
+    int blk(this->BlockOf(p));
+    int a(p - start_[blk]);
+    const char* src(&bytes_[byte_offset_[blk]]);
+    if(prec_[blk] == ERI_PREC_INT16) {
+      const short* q((const short*)src);
+      return dcomplex(q[2*a] * scale_[blk], q[2*a+1] * scale_[blk]);
+    } else if(prec_[blk] == ERI_PREC_FLOAT) {
+      const float* f((const float*)src);
+      return dcomplex(f[2*a], f[2*a+1]);
+    }
+    return ((const dcomplex*)src)[a];
+  }
+  int B2EIntReduced::num_block(int prec) const {
+    return count(prec_.begin(), prec_.end(), prec);
+  }
+  size_t B2EIntReduced::value_bytes() const {
+    return compressed_ ? bytes_.size() : sizeof(dcomplex) * num_;
+  }
+
+  // ---- Main ----
+  void B2EIntReduced::Init(int num) {
+    if(compressed_) {
+      vector<char>().swap(bytes_);
+      data_.resize(num_);
+      vs_ = num_ > 0 ? &data_[0] : NULL;
+      compressed_ = false;
+      max_err_ = 0.0;
+    }
+    B2EIntSparse::Init(num);
+  }
+  bool B2EIntReduced::Set(int ib, int jb, int kb, int lb,
+			  int i, int j, int k, int l, dcomplex val) {
+    return this->Set(ib, jb, kb, lb, i, j, k, l, ERI_TYPE_PLAIN, val);
+  }
+  bool B2EIntReduced::Set(int ib, int jb, int kb, int lb,
+			  int i, int j, int k, int l, int type, dcomplex val) {
+    if(compressed_) {
+      THROW_ERROR("B2EIntReduced is compressed. call Init before Set");
+    }
+    return B2EIntSparse::Set(ib, jb, kb, lb, i, j, k, l, type, val);
+  }
+  dcomplex& B2EIntReduced::Ref(int ib, int jb, int kb, int lb,
+			       int i, int j, int k, int l) {
+    if(compressed_) {
+      THROW_ERROR("Ref is not supported for compressed B2EIntReduced");
+    }
+    return B2EIntSparse::Ref(ib, jb, kb, lb, i, j, k, l);
+  }
+  void B2EIntReduced::GetChunk(int n, ERIChunk *c) {
+    /* encoded values are read by ERIChunk::value. chunk n is block n. */
+    B2EIntSparse::GetChunk(n, c);
+    if(not compressed_)
+      return;
+    const char* src(&bytes_[byte_offset_[n]]);
+    c->prec = prec_[n];
+    if(prec_[n] == ERI_PREC_DOUBLE) {
+      c->v = (const dcomplex*)src;
+    } else {
+      c->v = NULL;
+      c->raw = src;
+      c->scale = scale_[n];
+    }
+  }
+  void B2EIntReduced::Write(string fn) {
+    if(not compressed_) {
+      B2EIntSparse::Write(fn);
+      return;
+    }
+    this->WriteHeader(fn);
+    ofstream f(fn.c_str(), ios::out|ios::binary|ios::in);
+    f.seekp(this->value_offset());
+    vector<dcomplex> v;
+    for(int blk = 0; blk < (int)blocks_.size(); blk++) {
+      v.resize(max(this->block_size(blk), 1));
+      this->Decode(blk, &v[0]);
+      f.write((char*)&v[0], sizeof(dcomplex)*this->block_size(blk));
+    }
+    f.close();
+  }
+
+  // ==== Memory mapped block file ====
+  B2EIntMapped::B2EIntMapped(string fn): base_(NULL), len_(0) {
+
+    int fd(open(fn.c_str(), O_RDONLY));
+    if(fd < 0) {
+      string msg; SUB_LOCATION(msg); msg += ": file not found";
+      throw runtime_error(msg);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    len_ = st.st_size;
+    if(len_ < sizeof(ERIFileHeader)) {
+      close(fd);
+      string msg; SUB_LOCATION(msg); msg += ": file too short";
+      throw runtime_error(msg);
+    }
+    // -- private mapping: Set changes values in memory only. --
+    void* p(mmap(NULL, len_, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0));
+    close(fd);
+    if(p == MAP_FAILED) {
+      string msg; SUB_LOCATION(msg); msg += ": mmap failed";
+      throw runtime_error(msg);
+    }
+    base_ = (char*)p;
+
+    /*
+      Every size and offset read from the file is checked against len_
+      before the part of the file it refers is accessed.
+     */
+    const ERIFileHeader& h(*(ERIFileHeader*)base_);
+    long long len(len_);
+    long long index_end(0);
+    string err;
+    if(not equal(h.magic, h.magic+8, ERI_FILE_MAGIC))
+      err = "not block ERI file";
+    else if(h.version != ERI_FILE_VERSION)
+      err = "unsupported version";
+    else if(h.num_irrep <= 0 || h.num_irrep > 64 || h.num_block < 0 ||
+	    (h.fold != 0 && h.fold != 1))
+      err = "invalid header";
+    else if(h.num_value < 0 || h.value_offset < 0 || h.value_offset % 16 != 0 ||
+	    h.value_offset > len ||
+	    h.num_value > (len - h.value_offset) / (long long)sizeof(dcomplex))
+      err = "value region out of file";
+    if(err == "") {
+      index_end = (sizeof(ERIFileHeader) + sizeof(int) * (long long)h.num_irrep +
+		   sizeof(ERIFileBlock) * (long long)h.num_block);
+      if(index_end > h.value_offset)
+	err = "block index out of file";
+    }
+    if(err == "") {
+      const int* nb((int*)(base_ + sizeof(ERIFileHeader)));
+      const ERIFileBlock* fb((ERIFileBlock*)(nb + h.num_irrep));
+      int n(h.num_irrep);
+      vector<int> num_basis(nb, nb + n), blocks;
+      // -- pair index i*nj+j must fit in int --
+      for(int ib = 0; ib < n; ib++)
+	if(num_basis[ib] < 0 || num_basis[ib] > 46340)
+	  err = "invalid number of basis";
+      for(int blk = 0; blk < h.num_block && err == ""; blk++) {
+	if(fb[blk].b < 0 || fb[blk].b >= n*n*n*n ||
+	   (blk > 0 && fb[blk].b <= fb[blk-1].b))
+	  err = "invalid block index";
+	else if(fb[blk].offset < 0 || fb[blk].size < 0 ||
+		fb[blk].offset + fb[blk].size > h.num_value)
+	  err = "block out of value region";
+	blocks.push_back(fb[blk].b);
+      }
+      if(err == "") {
+	this->SetLayout(num_basis, h.fold == 1, blocks);
+	for(int blk = 0; blk < h.num_block; blk++)
+	  if(fb[blk].offset != block_offset_[blocks[blk]] ||
+	     fb[blk].size != this->block_size(blk))
+	    err = "inconsistent block index";
+	if(num_ != h.num_value || this->value_offset() != h.value_offset)
+	  err = "inconsistent header";
+      }
+    }
+    if(err != "") {
+      munmap(base_, len_);
+      base_ = NULL;
+      THROW_ERROR(err);
+    }
+    vs_ = (dcomplex*)(base_ + h.value_offset);
+  }
+  B2EIntMapped::~B2EIntMapped() {
+    if(base_ != NULL)
+      munmap(base_, len_);
+  }
+
+  // ==== Streaming writer ====
+  B2EIntStreamWriter::B2EIntStreamWriter(SymmetryGroup sym, const vector<int>& num_basis,
+					 bool fold, string fn, int chunk):
+    fn_(fn), chunk_(chunk) {
+    this->SetLayout(num_basis, fold, Non0Blocks(sym, num_basis.size(), fold));
+    this->WriteHeader(fn_);
+    f_.open(fn_.c_str(), ios::out|ios::binary|ios::in);
+    buf_.reserve(chunk_);
+  }
+  B2EIntStreamWriter::~B2EIntStreamWriter() {
+    if(f_.is_open())
+      this->Close();
+  }
+  bool B2EIntStreamWriter::Set(int ib, int jb, int kb, int lb,
+			       int i, int j, int k, int l, int type, dcomplex val) {
+    int x[8] = {ib, jb, kb, lb, i, j, k, l};
+    int num_img(type == ERI_TYPE_PERM8 && not fold_ ? 8 : 1);
+    for(int g = 0; g < num_img; g++) {
+      int y[8];
+      PermImage(g, x, y);
+      int p(this->Pos(y[0], y[1], y[2], y[3], y[4], y[5], y[6], y[7]));
+      if(p >= 0)
+	buf_.push_back(make_pair(p, val));
+    }
+    if((int)buf_.size() >= chunk_)
+      this->Flush();
+    return true;
+  }
+  bool B2EIntStreamWriter::Set(int ib, int jb, int kb, int lb,
+			       int i, int j, int k, int l, dcomplex val) {
+    return this->Set(ib, jb, kb, lb, i, j, k, l, ERI_TYPE_PLAIN, val);
+  }
+  void B2EIntStreamWriter::Append(const vector<IB2EInt*>& src, int num_threads) {
+    /* Set buffers values, so that it is not thread safe. */
+    IB2EInt::Append(src, num_threads);
+  }
+  bool PosLess(const pair<int, dcomplex>& a, const pair<int, dcomplex>& b) {
+    return a.first < b.first;
+  }
+  void B2EIntStreamWriter::Flush() {
+    /* write buffered values. consecutive positions are written at once. */
+    if(not f_.is_open()) {
+      string msg; SUB_LOCATION(msg); msg += ": writer is closed";
+      throw runtime_error(msg);
+    }
+    stable_sort(buf_.begin(), buf_.end(), PosLess);
+    long long off(this->value_offset());
+    vector<dcomplex> run;
+    int n(buf_.size());
+    for(int a = 0; a < n; ) {
+      int b(a);
+      run.clear();
+      while(b < n && buf_[b].first == buf_[a].first + (int)run.size()) {
+	run.push_back(buf_[b].second);
+	b++;
+	// -- same position Set twice: last one wins. --
+	while(b < n && buf_[b].first == buf_[b-1].first) {
+	  run.back() = buf_[b].second;
+	  b++;
+	}
+      }
+      f_.seekp(off + sizeof(dcomplex) * buf_[a].first);
+      f_.write((char*)&run[0], sizeof(dcomplex) * run.size());
+      a = b;
+    }
+    buf_.clear();
+  }
+  void B2EIntStreamWriter::Close() {
+    this->Flush();
+    f_.close();
+  }
+  void B2EIntStreamWriter::Init(int) {}
+  bool B2EIntStreamWriter::Get(int*, int*, int*, int*, int*, int*, int*, int*, int*, dcomplex*) {
+    THROW_ERROR("B2EIntStreamWriter is write only. use ERIRead after Close");
+  }
+  bool B2EIntStreamWriter::GetPacked(int*, int*, int*, int*, int*, int*, int*, int*,
+				     int*, dcomplex*) {
+    THROW_ERROR("B2EIntStreamWriter is write only. use ERIRead after Close");
+  }
+  dcomplex B2EIntStreamWriter::At(int, int, int, int, int, int, int, int) {
+    THROW_ERROR("B2EIntStreamWriter is write only. use ERIRead after Close");
+  }
+  dcomplex& B2EIntStreamWriter::Ref(int, int, int, int, int, int, int, int) {
+    THROW_ERROR("B2EIntStreamWriter is write only. use ERIRead after Close");
+  }
+  void B2EIntStreamWriter::GetChunk(int, ERIChunk*) {
+    THROW_ERROR("B2EIntStreamWriter is write only. use ERIRead after Close");
+  }
+  void B2EIntStreamWriter::Write(string) {
+    THROW_ERROR("B2EIntStreamWriter writes to the file given in constructor");
+  }
+  
+  // ==== Paged version ====
+  // ---- Constructors ----
+  B2EIntPaged::B2EIntPaged(size_t mem_budget, int page_size, int read_ahead,
+			   string scratch_dir):
+    mem_budget_(mem_budget), page_size_(page_size), read_ahead_(read_ahead),
+    scratch_dir_(scratch_dir) {
+    if(page_size_ < 1 || read_ahead_ < 1) {
+      THROW_ERROR("page_size and read_ahead must be positive");
+    }
+    if(scratch_dir_ == "") {
+      const char* tmp(getenv("TMPDIR"));
+      scratch_dir_ = tmp != NULL ? tmp : "/tmp";
+    }
+    this->Init(1);
+  }
+  B2EIntPaged::~B2EIntPaged() {
+    if(f_.is_open())
+      f_.close();
+  }
+
+  // ---- Paging ----
+  void B2EIntPaged::Spill() {
+    /* write oldest resident full page to scratch file. */
+    if(not f_.is_open()) {
+      string fn(scratch_dir_ + "/b2eint_XXXXXX");
+      vector<char> name(fn.begin(), fn.end());
+      name.push_back('\0');
+      int fd(mkstemp(&name[0]));
+      if(fd < 0) {
+	THROW_ERROR("failed to create scratch file in " + scratch_dir_);
+      }
+      close(fd);
+      f_.open(&name[0], ios::in|ios::out|ios::binary|ios::trunc);
+      unlink(&name[0]); // removed when f_ is closed
+      if(!f_) {
+	THROW_ERROR("failed to open scratch file");
+      }
+    }
+    vector<Entry>& page(pages_[num_spilled_]);
+    f_.seekp((streamoff)num_spilled_ * page_size_ * sizeof(Entry));
+    f_.write((char*)&page[0], sizeof(Entry) * page_size_);
+    vector<Entry>().swap(page);
+    num_spilled_++;
+  }
+  const B2EIntPaged::Entry& B2EIntPaged::GetEntry(int n) {
+    int p(n / page_size_), m(n % page_size_);
+    if(p >= num_spilled_)
+      return pages_[p][m];
+    // -- rbuf_ holds only the pages spilled when it was read. --
+    if(rbuf_page_ < 0 || p < rbuf_page_ ||
+       (int)rbuf_.size() / page_size_ <= p - rbuf_page_) {
+      // -- read p and following spilled pages at once --
+      int np(min(read_ahead_, num_spilled_ - p));
+      rbuf_.resize(np * page_size_);
+      f_.clear();
+      f_.seekg((streamoff)p * page_size_ * sizeof(Entry));
+      f_.read((char*)&rbuf_[0], sizeof(Entry) * np * page_size_);
+      if(!f_) {
+	THROW_ERROR("failed to read scratch file");
+      }
+      rbuf_page_ = p;
+    }
+    return rbuf_[(p - rbuf_page_) * page_size_ + m];
+  }
+  
+  // ---- Main ----
+  void B2EIntPaged::Init(int) {
+    pages_.clear();
+    num_spilled_ = 0;
+    size_ = 0;
+    capacity_ = 0;
+    rbuf_.clear();
+    rbuf_page_ = -1;
+    idx_ = 0;
+    img_ = 0;
+    if(f_.is_open())
+      f_.close();
+  }
+  bool B2EIntPaged::Get(int *ib, int *jb, int *kb, int *lb,
+			int *i, int *j, int *k, int *l,
+			int *type, dcomplex *val) {
+
+    while(this->idx_ < this->size_) {
+      const Entry& e(this->GetEntry(this->idx_));
+      if(e.t != ERI_TYPE_PERM8) 
+	return this->GetPacked(ib, jb, kb, lb, i, j, k, l, type, val);
+      
+      int x[8] = {e.ib, e.jb, e.kb, e.lb, e.i, e.j, e.k, e.l};
+      int y[8], z[8];
+      // -- skip images already returned for this entry. --
+      while(this->img_ < 8) {
+	PermImage(this->img_, x, y);
+	bool dup(false);
+	for(int h = 0; h < this->img_; h++) {
+	  PermImage(h, x, z);
+	  if(equal(y, y+8, z))
+	    dup = true;
+	}
+	this->img_++;
+	if(not dup) {
+	  *ib = y[0]; *jb = y[1]; *kb = y[2]; *lb = y[3];
+	  *i  = y[4]; *j  = y[5]; *k  = y[6]; *l  = y[7];
+	  *type = e.t;
+	  *val  = e.v;
+	  return true;
+	}
+      }
+      this->img_ = 0;
+      this->idx_++;
+    }
+    return false;
+  }
+  bool B2EIntPaged::GetPacked(int *ib, int *jb, int *kb, int *lb,
+			      int *i, int *j, int *k, int *l,
+			      int *type, dcomplex *val) {
+    if(this->idx_ >= this->size_)
+      return false;
+    const Entry& e(this->GetEntry(this->idx_));
+    *ib = e.ib; *jb = e.jb; *kb = e.kb; *lb = e.lb;
+    *i  = e.i;  *j  = e.j;  *k  = e.k;  *l  = e.l;
+    *type = e.t;
+    *val  = e.v;
+    this->idx_++;
+    this->img_ = 0;
+    return true;
+  }
+  bool B2EIntPaged::Set(int ib, int jb, int kb, int lb,
+			int i, int j, int k, int l,
+			dcomplex val) {
+    return this->Set(ib, jb, kb, lb, i, j, k, l, ERI_TYPE_PLAIN, val);
+  }
+  bool B2EIntPaged::Set(int ib, int jb, int kb, int lb,
+			int i, int j, int k, int l,
+			int type, dcomplex val) {
+    if(size_ == capacity_) {
+      // -- new page. spill old pages if over budget. --
+      size_t page_bytes(sizeof(Entry) * page_size_);
+      while(num_spilled_ < (int)pages_.size() &&
+	    (pages_.size() + 1 - num_spilled_) * page_bytes > mem_budget_)
+	this->Spill();
+      pages_.push_back(vector<Entry>(page_size_));
+      capacity_ += page_size_;
+    }
+    Entry& e(pages_[size_ / page_size_][size_ % page_size_]);
+    e.ib = ib; e.jb = jb; e.kb = kb; e.lb = lb;
+    e.i  = i;  e.j  = j;  e.k  = k;  e.l  = l;
+    e.t = type;
+    e.v = val;
+    size_++;
+    return true;
+  }
+  int B2EIntPaged::num_chunk() const {
+    return (size_ + page_size_ - 1) / page_size_;
+  }
+  void B2EIntPaged::GetChunk(int n, ERIChunk *c) {
+    if(n < 0 || n >= this->num_chunk()) {
+      THROW_ERROR("chunk index out of range");
+    }
+    vector<Entry> buf;
+    const Entry* page(NULL);
+    if(n < num_spilled_) {
+      buf.resize(page_size_);
+      bool ok;
+#pragma omp critical(b2eint_scratch)
+      {
+	f_.clear();
+	f_.seekg((streamoff)n * page_size_ * sizeof(Entry));
+	f_.read((char*)&buf[0], sizeof(Entry) * page_size_);
+	ok = !f_.fail();
+      }
+      if(not ok) {
+	THROW_ERROR("failed to read scratch file");
+      }
+      page = &buf[0];
+    } else
+      page = &pages_[n][0];
+    
+    c->Alloc(min(page_size_, size_ - n * page_size_));
+    for(int e = 0; e < c->num; e++) {
+      const Entry& x(page[e]);
+      c->SetEntry(e, x.ib, x.jb, x.kb, x.lb, x.i, x.j, x.k, x.l, x.t);
+      c->v_buf[e] = x.v;
+    }
+  }
+  void B2EIntPaged::Reset() {
+    idx_ = 0;
+    img_ = 0;
+  }
+  void B2EIntPaged::Write(string fn) {
+    WritePacked(this, fn);
+  }
+  int B2EIntPaged::size() const {
+    return size_;
+  }
+  int B2EIntPaged::capacity() const {
+    return capacity_;
   }
 
   // ==== ERI read ====
   B2EInt ERIRead(string fn) {
 
+    if(IsERIBlockFile(fn))
+      return B2EInt(new B2EIntMapped(fn));
+
     B2EInt eri(new B2EIntMem);
 
     ifstream f(fn.c_str(), ios::in|ios::binary);
@@ -173,7 +1546,7 @@ namespace cbasis {
 
       f.read((char*)&t, sizeof(int));
       f.read((char*)&v, sizeof(dcomplex));
-      eri->Set(ib, jb, kb, lb, i, j, k, l, v);
+      eri->Set(ib, jb, kb, lb, i, j, k, l, t, v);
     }
 
     return eri;
@@ -4,14 +4,77 @@
 //#include "symmolint.hpp"
 #include <vector>
 #include <string>
+#include <fstream>
+#include <stdexcept>
 #include <boost/shared_ptr.hpp>
 #include "../utils/macros.hpp"
 #include "../utils/typedef.hpp"
+#include "symgroup.hpp"
 
 using namespace std;
 
 namespace cbasis {
 
+  /*
+    Type of stored integral.
+    ERI_TYPE_PLAIN : value for the given index list only.
+    ERI_TYPE_PERM8 : value for the given index list and for its images
+                     under (ij|kl)=(ji|kl)=(ij|lk)=(kl|ij).
+   */
+  static const int ERI_TYPE_PLAIN = 0;
+  static const int ERI_TYPE_PERM8 = 1;
+
+  /*
+    Distinct index lists {ib,jb,kb,lb,i,j,k,l} which stored entry x of
+    given type stands for. They are written to y[8*n],...,y[8*n+7] and
+    the number of them (1 for ERI_TYPE_PLAIN, at most 8) is returned.
+   */
+  int ERIImages(int type, const int *x, int *y);
+
+  /*
+    Precision of values stored in B2EIntReduced and in ERIChunk.
+   */
+  static const int ERI_PREC_DOUBLE = 0;
+  static const int ERI_PREC_FLOAT  = 1;
+  static const int ERI_PREC_INT16  = 2;
+
+  /*
+    Contiguous span of num stored (not unfolded) entries. Entry e has index
+    list {ib[e],jb[e],kb[e],lb[e],i[e],j[e],k[e],l[e]}, type t[e] and value
+    value(e). Arrays point either into the store or into the buffers of this
+    object, and are valid until next GetChunk call with this object.
+    Values of reduced precision are not decoded to a buffer: raw points to
+    (Re, Im) pairs of float or of int16 times scale, and v is NULL.
+   */
+  struct ERIChunk {
+    int num;
+    const int *ib, *jb, *kb, *lb, *i, *j, *k, *l, *t;
+    const dcomplex *v;  // values for ERI_PREC_DOUBLE
+    int prec;           // ERI_PREC_*
+    const void *raw;    // encoded values for ERI_PREC_FLOAT/INT16
+    double scale;       // unit of int16 values
+    std::vector<int> idx_buf;
+    std::vector<dcomplex> v_buf;
+    ERIChunk();
+    inline dcomplex value(int e) const {
+      if(prec == ERI_PREC_INT16) {
+	const short* q((const short*)raw);
+	return dcomplex(q[2*e] * scale, q[2*e+1] * scale);
+      } else if(prec == ERI_PREC_FLOAT) {
+	const float* f((const float*)raw);
+	return dcomplex(f[2*e], f[2*e+1]);
+      }
+      return v[e];
+    }
+    // -- point arrays to buffers of n entries. v is set only if use_v_buf. --
+    // -- num may be decreased after entries are set.                       --
+    void Alloc(int n, bool use_v_buf=true);
+    void SetEntry(int e, int ib, int jb, int kb, int lb,
+		  int i, int j, int k, int l, int t);
+    void Entry(int e, int *x) const; // x = index list of entry e
+    int Images(int e, int *y) const; // ERIImages of entry e
+  };
+
   /**
     Interface for store of two electron integrals.
    */
@@ -21,29 +84,63 @@ namespace cbasis {
     virtual ~IB2EInt();
 
     /*
-      Obtain next index list and value.
+      Obtain next index list and value. Entries of type ERI_TYPE_PERM8
+      are unfolded, i.e. each distinct permutation image is returned.
+      Order of entries depends on the store.
      */
     virtual bool Get(int *ib, int *jb, int *kb, int *lb,
 		     int *i, int *j, int *k, int *l, int *type, dcomplex *val) = 0;
+    /*
+      Obtain next stored entry without unfolding.
+     */
+    virtual bool GetPacked(int *ib, int *jb, int *kb, int *lb,
+			   int *i, int *j, int *k, int *l, int *type, dcomplex *val) = 0;
     /*
       Set value at given index list.
      */
     virtual bool Set(int ib, int jb, int kb, int lb,
 	     int i, int j, int k, int l, dcomplex val) = 0;
+    virtual bool Set(int ib, int jb, int kb, int lb,
+		     int i, int j, int k, int l, int type, dcomplex val) = 0;
     /*
       Reset internal index counter "idx_".
      */
     virtual void Reset() = 0;
     virtual void Init(int num) = 0;
     /*
-      Obtain value at given index list. This function is for debug and
-      very slow for numerical calcualtion. 
-      Additionaly, in this function Reset method is called.
+      Obtain value at given index list. Default implementation scans
+      all entries by Get, so that it is very slow for numerical calculation.
+      Additionaly, in this default Reset method is called.
+      B2EIntBlock overrides them with O(1) lookup.
      */    
-    dcomplex At(int ib, int jb, int kb, int lb,
-		int i, int j, int k, int l);
-    bool Exist(int ib, int jb, int kb, int lb,
-	       int i, int j, int k, int l);
+    virtual dcomplex At(int ib, int jb, int kb, int lb,
+			int i, int j, int k, int l);
+    virtual bool Exist(int ib, int jb, int kb, int lb,
+		       int i, int j, int k, int l);
+    /*
+      Reference to stored value at given index list. Default implementation
+      throws exception.
+     */
+    virtual dcomplex& Ref(int ib, int jb, int kb, int lb,
+			  int i, int j, int k, int l);
+    /*
+      Cursor free iteration. Stored entries are divided into num_chunk()
+      chunks and GetChunk(n, c) sets c to n-th of them. It does not touch
+      the cursor of Get, so that chunks can be read from several threads
+      at once, each with its own ERIChunk. Entries are not unfolded; use
+      ERIImages for ERI_TYPE_PERM8.
+      Default implementation returns one chunk filled by GetPacked in
+      a critical section, which resets the cursor of Get.
+     */
+    virtual int num_chunk() const;
+    virtual void GetChunk(int n, ERIChunk *chunk);
+    /*
+      Add all stored entries of src[0], src[1], ... in this order. Stores
+      whose entries are independent override it so that each src is copied
+      by one of num_threads threads into its own precomputed range.
+      Default implementation Sets them one by one.
+     */
+    virtual void Append(const std::vector<IB2EInt*>& src, int num_threads);
     /*
       Write to file
      */
@@ -66,6 +163,7 @@ namespace cbasis {
     int capacity_; // capacity of each array.
     int size_;     // size of data
     int idx_;      // used for Get function.
+    int img_;      // permutation image of entry idx_ returned next by Get.
     std::vector<int> ibs, jbs, kbs, lbs;
     std::vector<int> is, js, ks, ls;
     std::vector<int> ts;
@@ -78,19 +176,343 @@ namespace cbasis {
     void Init(int num);
     bool Get(int *ib, int *jb, int *kb, int *lb,
 	     int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool GetPacked(int *ib, int *jb, int *kb, int *lb,
+		   int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, dcomplex val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, int type, dcomplex val);
+    dcomplex& Ref(int ib, int jb, int kb, int lb,
+		  int i, int j, int k, int l); // linear scan
+    int num_chunk() const;
+    void GetChunk(int n, ERIChunk *chunk); // arrays in store
+    void Append(const std::vector<IB2EInt*>& src, int num_threads); // parallel copy
+    void Reset();
+    void Write(std::string fn);
+    int size() const;     // number of stored (not unfolded) entries
+    int capacity() const;
+    
+  };
+
+  /*
+    Values are stored in dense blocks for each irrep quartet (ib,jb,kb,lb)
+    at offset ((i*nj+j)*nk+k)*nl+l. Blocks are allocated at first Set and
+    one flag per element tells if it is stored; index lists are implicit
+    from the position. Set of ERI_TYPE_PERM8 entry stores value on all of
+    its images, so that Get/GetPacked return each stored element as
+    ERI_TYPE_PLAIN, in order of block allocation and of position in block.
+    This is not the order of Set; keeping it would need a position per
+    entry, which the implicit layout avoids.
+   */
+  class B2EIntBlock :public IB2EInt {
+  private:
+    std::vector<int> num_basis_;   // number of basis for each irrep
+    std::vector<long long> block_offset_; // offset of block in vs_ (-1 : not allocated)
+    std::vector<int> blocks_;      // allocated blocks in order of offset
+    std::vector<dcomplex> vs_;     // values
+    std::vector<char> stored_;     // 1 if element is stored
+    int num_;      // number of stored elements
+    int capacity_;
+    int iblk_;      // block returned next by Get
+    long long pos_; // position returned next by Get
+    int Block(int ib, int jb, int kb, int lb) const;
+    long long Pos(int ib, int jb, int kb, int lb,
+		  int i, int j, int k, int l) const;  // -1 if out of range or not allocated
+    long long NewPos(int ib, int jb, int kb, int lb,
+		     int i, int j, int k, int l);     // allocate block if necessary
+    void Index(int blk, long long p, int *x) const; // index list at position p in blocks_[blk]
+  public:
+    B2EIntBlock(const std::vector<int>& num_basis);
+    B2EIntBlock(const std::vector<int>& num_basis, int num);
+    ~B2EIntBlock();
+
+    void Init(int num);
+    bool Get(int *ib, int *jb, int *kb, int *lb,
+	     int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool GetPacked(int *ib, int *jb, int *kb, int *lb,
+		   int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, dcomplex val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, int type, dcomplex val);
+    dcomplex At(int ib, int jb, int kb, int lb,
+		int i, int j, int k, int l);
+    bool Exist(int ib, int jb, int kb, int lb,
+	       int i, int j, int k, int l);
+    /*
+      Element is created with value 0 if it does not exist.
+     */
+    dcomplex& Ref(int ib, int jb, int kb, int lb,
+		  int i, int j, int k, int l);
+    int num_chunk() const;
+    void GetChunk(int n, ERIChunk *chunk);
+    void Reset();
+    void Write(std::string fn);
+    int size() const;     // number of stored elements (images are counted)
+    int capacity() const;
+  };
+
+  /*
+    Only values are stored. Dense blocks are allocated in constructor for
+    each irrep quartet with sym->Non0_4 and indices are implicit from the
+    block layout, (ij|kl) at IJ*num_pair(kb,lb)+KL with IJ=i*nj+j.
+    Values Set to blocks which are zero by symmetry are dropped.
+    
+    fold=true : only canonical (ij|kl) under (ij|kl)=(ji|kl)=(ij|lk)=(kl|ij)
+                is stored, i.e. (ib,i)>=(jb,j), (kb,k)>=(lb,l) and
+                ((ib,jb),IJ)>=((kb,lb),KL), with triangular IJ and block
+                index for equal irreps. Set of any image sets the value
+                and Get returns all images with type ERI_TYPE_PERM8.
+    Get returns values in order of block and of index in block, including
+    elements not Set (0).
+   */
+  class B2EIntSparse :public IB2EInt {
+  protected:
+    std::vector<int> num_basis_;    // number of basis for each irrep
+    bool fold_;
+    std::vector<int> block_offset_; // offset of irrep quartet block (-1 : not stored)
+    std::vector<int> blocks_;       // stored irrep quartets, ((ib*n+jb)*n+kb)*n+lb
+    std::vector<std::vector<int> > pairs_; // (ib*n+jb) => i*nj+j for each pair index
+    std::vector<dcomplex> data_;    // values owned by this object
+    dcomplex* vs_;                  // values (data_ or mapped file)
+    int num_;                       // number of values
+    int iblk_, ij_, kl_, img_; // used for Get function.
+    B2EIntSparse();
+    static std::vector<int> Non0Blocks(SymmetryGroup sym, int num_irrep, bool fold);
+    void SetLayout(const std::vector<int>& num_basis, bool fold,
+		   const std::vector<int>& blocks);
+    int block_size(int blk) const;
+    int NumPair(int ib, int jb) const;
+    int PairIdx(int ib, int jb, int i, int j) const;
+    int Pos(int ib, int jb, int kb, int lb,
+	    int i, int j, int k, int l) const; // -1 if not stored
+    void Canonical(int *x) const;
+    virtual dcomplex Value(int p); // value at position p
+    bool Current(int *x, int *p); // index list and position at cursor
+    void Advance();
+    long long value_offset() const;     // byte offset of values in block file
+    void WriteHeader(std::string fn) const;
+  public:
+    B2EIntSparse(SymmetryGroup sym, const std::vector<int>& num_basis, bool fold);
+    ~B2EIntSparse();
+    
+    void Init(int num); // set 0 to all values. num is not used.
+    bool Get(int *ib, int *jb, int *kb, int *lb,
+	     int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool GetPacked(int *ib, int *jb, int *kb, int *lb,
+		   int *i, int *j, int *k, int *l, int *type, dcomplex *val);
     bool Set(int ib, int jb, int kb, int lb,
 	     int i, int j, int k, int l, dcomplex val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, int type, dcomplex val);
     dcomplex At(int ib, int jb, int kb, int lb,
-		int i, int j, int k, int l);    
+		int i, int j, int k, int l);
+    bool Exist(int ib, int jb, int kb, int lb,
+	       int i, int j, int k, int l);
+    dcomplex& Ref(int ib, int jb, int kb, int lb,
+		  int i, int j, int k, int l);
+    int num_chunk() const;
+    void GetChunk(int n, ERIChunk *chunk); // one irrep quartet block. values in store
+    // -- values of distinct entries are at distinct positions, so that Set runs in parallel --
+    void Append(const std::vector<IB2EInt*>& src, int num_threads);
     void Reset();
+    // -- block file format (see b2eint.cpp). ERIRead returns B2EIntMapped for it. --
     void Write(std::string fn);
-    int size() const;
+    int size() const;     // number of stored values
     int capacity() const;
+    const std::vector<int>& num_basis() const { return num_basis_; }
+  };
+
+  /*
+    B2EIntSparse whose values are stored with reduced precision after
+    Compress. For each irrep quartet block, with m the largest |Re| or |Im|,
+    values are stored as
+      int16 scaled by 2^e (e per block) if 2^e/2 <= tol,
+      float                             if m 2^-24 <= tol,
+      double                            otherwise,
+    so that error of Re and Im of each value is at most tol.
+    Before Compress it is same as B2EIntSparse. After Compress, Set and Ref
+    are not supported and Init returns to double storage with all 0.
+   */
+  class B2EIntReduced :public B2EIntSparse {
+  private:
+    double tol_;
+    bool compressed_;
+    std::vector<int> prec_;         // ERI_PREC_* for each block
+    std::vector<double> scale_;     // 2^e for ERI_PREC_INT16 block
+    std::vector<size_t> byte_offset_; // offset of block in bytes_
+    std::vector<char> bytes_;       // compressed values
+    std::vector<int> start_;        // position of first value for each block
+    double max_err_;
+    int blk_;                       // last block used by Value
+    int BlockOf(int p);
+    void Decode(int blk, dcomplex* v) const;
+    dcomplex Value(int p);
+  public:
+    B2EIntReduced(SymmetryGroup sym, const std::vector<int>& num_basis, bool fold,
+		  double tol);
+    ~B2EIntReduced();
+    void Compress();
+    bool compressed() const { return compressed_; }
+    double tol() const { return tol_; }
+    double max_error() const { return max_err_; } // bound achieved by Compress
+    int num_block(int prec) const;                  // number of blocks with ERI_PREC_*
+    size_t value_bytes() const;                     // bytes used for values
     
+    void Init(int num);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, dcomplex val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, int type, dcomplex val);
+    dcomplex& Ref(int ib, int jb, int kb, int lb,
+		  int i, int j, int k, int l);
+    void GetChunk(int n, ERIChunk *chunk); // values are not decoded
+    void Write(std::string fn);            // values are written as double
+  };
+
+  /*
+    Block file written by B2EIntSparse::Write or B2EIntStreamWriter mapped
+    to memory. Values are not copied. Mapping is private, so Set changes
+    values in memory only.
+   */
+  class B2EIntMapped :public B2EIntSparse {
+  private:
+    char* base_;
+    size_t len_;
+  public:
+    B2EIntMapped(std::string fn);
+    ~B2EIntMapped();
+  };
+
+  /*
+    Write only store which writes values to block file fn. Set values are
+    buffered and written when chunk values are collected, so that the
+    file can be written while CalcERI is running. Call Close (or delete)
+    before reading the file by ERIRead. Values not Set are 0.
+   */
+  class B2EIntStreamWriter :public B2EIntSparse {
+  private:
+    std::string fn_;
+    int chunk_;
+    std::ofstream f_;
+    std::vector<std::pair<int, dcomplex> > buf_; // (position, value)
+  public:
+    B2EIntStreamWriter(SymmetryGroup sym, const std::vector<int>& num_basis,
+		       bool fold, std::string fn, int chunk=65536);
+    ~B2EIntStreamWriter();
+    void Flush();
+    void Close();
+    
+    void Init(int num); // do nothing
+    bool Get(int *ib, int *jb, int *kb, int *lb,
+	     int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool GetPacked(int *ib, int *jb, int *kb, int *lb,
+		   int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, dcomplex val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, int type, dcomplex val);
+    dcomplex At(int ib, int jb, int kb, int lb,
+		int i, int j, int k, int l);
+    dcomplex& Ref(int ib, int jb, int kb, int lb,
+		  int i, int j, int k, int l);
+    void GetChunk(int n, ERIChunk *chunk);
+    void Append(const std::vector<IB2EInt*>& src, int num_threads); // serial
+    void Write(std::string fn);
+  };
+
+  /*
+    Growable store for ERI_TYPE_PLAIN/PERM8 entries in pages of page_size
+    entries. When resident pages exceed mem_budget bytes, the oldest pages
+    are written to a scratch file in dir (removed automatically) and
+    released. Get reads spilled pages read_ahead pages at a time.
+    Entries are returned in order of Set, as B2EIntMem.
+   */
+  class B2EIntPaged :public IB2EInt {
+  private:
+    struct Entry {
+      int ib, jb, kb, lb, i, j, k, l, t;
+      dcomplex v;
+    };
+    size_t mem_budget_;
+    int page_size_;
+    int read_ahead_;
+    std::string scratch_dir_;
+    std::vector<std::vector<Entry> > pages_; // empty if spilled
+    int num_spilled_;  // pages [0, num_spilled_) are in scratch file
+    int size_;
+    int capacity_;
+    std::fstream f_;   // scratch file
+    std::vector<Entry> rbuf_;  // pages read from scratch file
+    int rbuf_page_;    // first page in rbuf_ (-1 : none)
+    int idx_;      // used for Get function.
+    int img_;      // permutation image of entry idx_ returned next by Get.
+    void Spill();
+    const Entry& GetEntry(int n);
+  public:
+    B2EIntPaged(size_t mem_budget, int page_size=65536, int read_ahead=4,
+		std::string scratch_dir="");
+    ~B2EIntPaged();
+    
+    void Init(int num); // remove all entries. num is not used.
+    bool Get(int *ib, int *jb, int *kb, int *lb,
+	     int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool GetPacked(int *ib, int *jb, int *kb, int *lb,
+		   int *i, int *j, int *k, int *l, int *type, dcomplex *val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, dcomplex val);
+    bool Set(int ib, int jb, int kb, int lb,
+	     int i, int j, int k, int l, int type, dcomplex val);
+    int num_chunk() const;
+    void GetChunk(int n, ERIChunk *chunk); // one page
+    void Reset();
+    void Write(std::string fn);
+    int size() const;     // number of stored (not unfolded) entries
+    int capacity() const; // entries in allocated pages
+    int num_spilled() const { return num_spilled_; }
   };
 
   typedef boost::shared_ptr<IB2EInt> B2EInt;
 
   B2EInt ERIRead(std::string fn);
+
+  /*
+    Call f(x, v) for each unfolded entry of eri, x being its index list
+    {ib,jb,kb,lb,i,j,k,l} and v its value. Chunks are distributed over
+    threads when there are more than one. Each thread visits with its own
+    copy of f, and the copies are added to f by f.Merge(copy) one at a time
+    at end, so that f must hold zero accumulators when it is passed.
+   */
+  template<class F>
+  void VisitERI(IB2EInt* eri, F& f) {
+    int num_chunk(eri->num_chunk());
+    std::string err_msg;
+#pragma omp parallel if(num_chunk > 1)
+    {
+      F g(f);
+      ERIChunk c;
+      int y[64];
+#pragma omp for schedule(dynamic)
+      for(int n = 0; n < num_chunk; n++) {
+	try {
+	  eri->GetChunk(n, &c);
+	} catch(std::exception& e) {
+#pragma omp critical(b2eint_err)
+	  err_msg = e.what();
+	  continue;
+	}
+	for(int e = 0; e < c.num; e++) {
+	  dcomplex v(c.value(e));
+	  for(int a = 0, na = c.Images(e, y); a < na; a++)
+	    g(&y[8*a], v);
+	}
+      }
+#pragma omp critical(b2eint_visit)
+      f.Merge(g);
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+  }
 }
 #endif
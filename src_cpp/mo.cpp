@@ -9,7 +9,7 @@
 using namespace Eigen;
 
 namespace cbasis {
-  _MO::_MO() {}
+  _MO::_MO(): num_iter(0) {}
 
   typedef pair<Irrep, dcomplex> IrrepComplex;
   struct Compare_IrrepEig {
@@ -57,9 +57,9 @@ namespace cbasis {
   }
   vector<Irrep> CalcIrrepList(const BMat& bmat) {
     vector<Irrep> irrep_list;
-    int num_block(bmat.size());
-    for(Irrep irrep = 0; irrep < num_block; irrep++) {
-      if(bmat.has_block(irrep, irrep))
+    for(BMat::const_iterator it = bmat.begin(); it != bmat.end(); ++it) {
+      Irrep irrep(it->first.first);
+      if(irrep == it->first.second && bmat.has_block(irrep, irrep))
 	irrep_list.push_back(irrep);
     }
     return irrep_list;
@@ -126,6 +126,47 @@ namespace cbasis {
     }
     return mo;
   }
+  struct JK_Orb {
+    /*
+      Visitor for VisitERI. H[ib] += cJ (ij|kl) a_k b_l for kb=A, lb=B and
+                           H[ib] += cK (ij|kl) a_k b_j for jb=B, kb=A,
+      H being zero blocks indexed by irrep (size 0 if not needed).
+    */
+    Irrep A, B;
+    const VectorXcd *a, *b;
+    dcomplex cJ, cK;
+    vector<MatrixXcd> H;
+    void operator()(const int* x, dcomplex v) {
+      int ib(x[0]), jb(x[1]), kb(x[2]), lb(x[3]), i(x[4]), j(x[5]), k(x[6]), l(x[7]);
+      if(kb != A || ib >= (int)H.size() || H[ib].size() == 0)
+	return;
+      if(ib == jb && lb == B && cJ != 0.0)
+	H[ib](i, j) += cJ * (*a)(k) * (*b)(l) * v;
+      if(ib == lb && jb == B && cK != 0.0)
+	H[ib](i, l) += cK * (*a)(k) * (*b)(j) * v;
+    }
+    void Merge(const JK_Orb& o) {
+      for(int ir = 0; ir < (int)H.size(); ir++)
+	H[ir] += o.H[ir];
+    }
+  };
+  void AddJK_Orb(IB2EInt* eri, Irrep A, const VectorXcd& a, Irrep B, const VectorXcd& b,
+		 dcomplex coef_J, dcomplex coef_K, BMat& H) {
+    JK_Orb f;
+    f.A = A; f.B = B; f.a = &a; f.b = &b; f.cJ = coef_J; f.cK = coef_K;
+    for(BMat::iterator it = H.begin(); it != H.end(); ++it) {
+      Irrep ir(it->first.first);
+      if(ir != it->first.second)
+	continue;
+      if(ir >= (int)f.H.size())
+	f.H.resize(ir + 1);
+      f.H[ir] = MatrixXcd::Zero(it->second.rows(), it->second.cols());
+    }
+    VisitERI(eri, f);
+    for(int ir = 0; ir < (int)f.H.size(); ir++)
+      if(f.H[ir].size() > 0)
+	H[make_pair(ir, ir)] += f.H[ir];
+  }
   void AddJK(B2EInt eri, BMat& C, int I0, int i0,
 	     dcomplex coef_J, dcomplex coef_K, BMat& H) {
 
@@ -135,24 +176,8 @@ namespace cbasis {
       eri is assumed from CalcERIComplex or CalcERIHermite.
     */
     
-    int ib,jb,kb,lb,i,j,k,l,t;
-    dcomplex v;
-    eri->Reset();
-    const MatrixXcd& CC = C[make_pair(I0, I0)];
-    while(eri->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-      
-      if(ib == jb && kb == I0 && lb == I0) {
-	// Add J
-	pair<Irrep, Irrep> ij(ib, jb);
-	H[ij](i, j) += coef_J * CC(k, i0) * CC(l, i0) * v;
-      }
-	
-      if(ib == lb && jb == I0 && kb == I0) {
-	// Add K
-	pair<Irrep, Irrep> il(ib, lb);
-	H[il](i, l) += coef_K * CC(j, i0) * CC(k, i0) * v;
-      }
-    }      
+    VectorXcd c0 = C[make_pair(I0, I0)].col(i0);
+    AddJK_Orb(eri.get(), I0, c0, I0, c0, coef_J, coef_K, H);
 
   }
   void AddJK_Slow(B2EInt eri, BMat& C, int I0, int i0,
@@ -198,17 +223,7 @@ namespace cbasis {
        eri is calculated from
        .     eri = CalcERI(g_u, g_a, g_v, g_a, method)
      */
-    int ib,jb,kb,lb,i,j,k,l,t;
-    dcomplex v;
-
-    eri->Reset();
-
-    while(eri->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-      if(ib == jb && kb == ir_a && lb == ir_a) {
-	pair<Irrep, Irrep> ij(ib, jb);
-	J[ij](i, j) += v * Ca(k) * Ca(l) * coef;
-      }
-    }
+    AddJK_Orb(eri.get(), ir_a, Ca, ir_a, Ca, coef, 0.0, J);
 
   }
   void AddK(B2EInt eri, Eigen::VectorXcd& Ca, Irrep ir_a, dcomplex coef, BMat& K) {
@@ -218,20 +233,12 @@ namespace cbasis {
        (u_i | K_a | v_l) = (u_i(1)* phi_a(1) phi_a(2)* v_l(2) )
        .                 = (u_i(1)* w_j(1) w_k(2)* v_l(2)) C_ja C_ka
      */
-    
-    int ib,jb,kb,lb,i,j,k,l,t;
-    dcomplex v;
-
-    eri->Reset();
-    while(eri->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-
-      if(ib == lb && jb == ir_a && kb == ir_a) {
-	pair<Irrep, Irrep> il(ib, lb);
-	K[il](i, l) += v * Ca(j) * Ca(k) * coef;
-      }
-    }    
+    AddJK_Orb(eri.get(), ir_a, Ca, ir_a, Ca, 0.0, coef, K);
 
   }
+  MO CalcRHF_Main(SymmetryGroup sym, BMatSet mat_set, B2EInt eri, RI ri,
+		  SymGTOs gtos, ERIMethod method,
+		  int nele, int max_iter, double eps, bool *is_conv, int debug_lvl);
   MO CalcRHF(SymGTOs gtos, int nele, int max_iter, double eps, bool *is_conv,
 	     int debug_lvl) {
 
@@ -245,6 +252,90 @@ namespace cbasis {
   }
   MO CalcRHF(SymmetryGroup sym, BMatSet mat_set, B2EInt eri,
 	     int nele, int max_iter, double eps, bool *is_conv, int debug_lvl) {
+    return CalcRHF_Main(sym, mat_set, eri, RI(), SymGTOs(), ERIMethod(),
+			nele, max_iter, eps, is_conv, debug_lvl);
+  }
+  MO CalcRHF(SymmetryGroup sym, BMatSet mat_set, B2EInt eri, ERIMethod method,
+	     int nele, int max_iter, double eps, bool *is_conv, int debug_lvl) {
+    return CalcRHF_Main(sym, mat_set, eri, RI(), SymGTOs(), method,
+			nele, max_iter, eps, is_conv, debug_lvl);
+  }
+  MO CalcRHF_Direct(SymGTOs gtos, BMatSet mat_set, ERIMethod method,
+		    int nele, int max_iter, double eps, bool *is_conv, int debug_lvl) {
+    return CalcRHF_Main(gtos->sym_group(), mat_set, B2EInt(), RI(), gtos, method,
+			nele, max_iter, eps, is_conv, debug_lvl);
+  }
+  MO CalcRHF_RI(SymmetryGroup sym, BMatSet mat_set, RI ri, ERIMethod method,
+		int nele, int max_iter, double eps, bool *is_conv, int debug_lvl) {
+    return CalcRHF_Main(sym, mat_set, B2EInt(), ri, SymGTOs(), method,
+			nele, max_iter, eps, is_conv, debug_lvl);
+  }
+  double DIISError(MO mo, BMat& err) {
+    /*
+      err = FPS - SPF for each irrep. For complex symmetric F, P and S it is
+      zero at self consistency. Returns max |err|.
+    */
+    double res(0.0);
+    for(vector<Irrep>::iterator it = mo->irrep_list.begin();
+	it != mo->irrep_list.end(); ++it) {
+      pair<Irrep, Irrep> ii(make_pair(*it, *it));
+      MatrixXcd FPS = mo->F[ii] * mo->P[ii] * mo->S[ii];
+      err[ii] = FPS - FPS.transpose();
+      if(err[ii].size() > 0)
+	res = max(res, err[ii].cwiseAbs().maxCoeff());
+    }
+    return res;
+  }
+  void DIISExtrapolate(const vector<Irrep>& irrep_list,
+		       const vector<BMat>& Fs, const vector<BMat>& errs, BMat& F) {
+    /*
+      F = sum_i c_i Fs[i] with c minimizing |sum_i c_i errs[i]| under
+      sum_i c_i = 1. Inner product of error is bilinear (no conjugate)
+      as the complex symmetric case.
+    */
+    int m(Fs.size());
+    MatrixXcd B = MatrixXcd::Zero(m+1, m+1);
+    VectorXcd rhs = VectorXcd::Zero(m+1);
+    for(int i = 0; i < m; i++) {
+      for(int j = 0; j <= i; j++) {
+	dcomplex bij(0.0);
+	for(vector<Irrep>::const_iterator it = irrep_list.begin();
+	    it != irrep_list.end(); ++it) {
+	  pair<Irrep, Irrep> ii(make_pair(*it, *it));
+	  bij += (errs[i][ii].array() * errs[j][ii].array()).sum();
+	}
+	B(i, j) = B(j, i) = bij;
+      }
+      B(i, m) = B(m, i) = -1.0;
+    }
+    rhs(m) = -1.0;
+    VectorXcd c = B.colPivHouseholderQr().solve(rhs);
+
+    for(vector<Irrep>::const_iterator it = irrep_list.begin();
+	it != irrep_list.end(); ++it) {
+      pair<Irrep, Irrep> ii(make_pair(*it, *it));
+      F[ii] = c(0) * Fs[0][ii];
+      for(int i = 1; i < m; i++)
+	F[ii] += c(i) * Fs[i][ii];
+    }
+  }
+  MO CalcRHF_Main(SymmetryGroup sym, BMatSet mat_set, B2EInt eri, RI ri,
+		  SymGTOs gtos, ERIMethod method,
+		  int nele, int max_iter, double eps, bool *is_conv, int debug_lvl) {
+    /*
+      If ri is given, J and K are contracted directly from its B tensors
+      and fitted (ij|kl) are never formed. Otherwise if eri is null, J and K
+      are built by AddJK_Direct from gtos in each iteration.
+      If method.incremental == 1, only the change of the density matrix is
+      contracted and added to the two electron part G of the previous
+      iteration. G is rebuilt from the full density every num_reset
+      iterations to remove accumulated round off. The change is screened
+      by method.schwarz_thresh: Schwarz estimate times density for direct
+      J/K, and max |ERI| of each chunk times max |dD| for stored eri.
+      If method.diis > 1, Fock matrix to be diagonalized is extrapolated by
+      DIIS from the last method.diis Fock matrices and their FPS-SPF.
+    */
+    static const int num_reset = 10;
     
     if(nele == 1) {
       *is_conv = true;
@@ -265,7 +356,15 @@ namespace cbasis {
     mo->irrep_list = CalcIrrepList(mat_set);
 
     // ---- initilize ----
-    BMat FOld;    
+    BMat G, DOld; // two electron part of Fock matrix and its density
+    BMat FDIIS;   // extrapolated Fock matrix
+    vector<BMat> diis_F, diis_err;
+    Schwarz schwarz; // Schwarz table for integral direct J/K
+    if(not eri && not ri)
+      schwarz = NewSchwarz(gtos, method);
+    vector<double> chunk_max; // max |ERI| of each chunk for incremental build
+    if(eri && method.incremental == 1 && method.schwarz_thresh > 0.0)
+      chunk_max = ChunkMaxAbs(eri);
     vector<int> num_irrep(sym->num_class(), 0);
     typedef vector<Irrep>::iterator It;
     for(It it = mo->irrep_list.begin(); it != mo->irrep_list.end(); ++it ) {
@@ -279,7 +378,8 @@ namespace cbasis {
       num_irrep[irrep] = n;
       mo->C[ii] = MatrixXcd::Zero(n, n);
       mo->P[ii] = MatrixXcd::Zero(n, n);
-      FOld[ii] = MatrixXcd::Zero( n, n);
+      G[ii] = MatrixXcd::Zero(n, n);
+      DOld[ii] = MatrixXcd::Zero(n, n);
       mo->eigs[*it] = VectorXcd::Zero(n);
     }
 
@@ -287,9 +387,11 @@ namespace cbasis {
     for(int iter = 0; iter < max_iter; iter++) {
       
       // -- solve --
+      mo->num_iter = iter + 1;
+      BMat& FSolve(diis_F.size() > 1 ? FDIIS : mo->F);
       for(It it = mo->irrep_list.begin(); it != mo->irrep_list.end(); ++it) {
 	pair<Irrep, Irrep> ii(make_pair(*it, *it));
-	generalizedComplexEigenSolve(mo->F[ii], mo->S[ii],
+	generalizedComplexEigenSolve(FSolve[ii], mo->S[ii],
 				     &mo->C[ii], &mo->eigs[*it]);
       }
 
@@ -302,10 +404,11 @@ namespace cbasis {
 	int n_irrep(num_irrep[*it]);
 	MatrixXcd& P_ii = mo->P[ii];
 	MatrixXcd& C_ii = mo->C[ii];
+	P_ii.setZero();
 	for(int i = 0; i < mo->num_occ_irrep[*it]; i++) {
 	  for(int k = 0; k < n_irrep; k++)
 	    for(int l = 0; l < n_irrep; l++)
-	      P_ii(k, l) = 2.0 * C_ii(k, i) * C_ii(l, i);
+	      P_ii(k, l) += 2.0 * C_ii(k, i) * C_ii(l, i);
 	}
       }
       
@@ -313,12 +416,46 @@ namespace cbasis {
       for(It it = mo->irrep_list.begin(); it != mo->irrep_list.end(); ++it) {
 	Irrep irrep(*it);
 	pair<Irrep, Irrep> ii(make_pair(irrep, irrep));
-	FOld[ii].swap(mo->F[ii]);
 	mo->F[ii] = mo->H[ii];
       }
-      VectorXcd ca = mo->C[make_pair(0,0)].col(0);
-      AddJ(eri, ca, 0, 2.0,  mo->F);
-      AddK(eri, ca, 0, -1.0, mo->F);
+      // -- F = H + 2J[D] - K[D] with D = P/2 of all occupied orbitals --
+      BMat D;
+      for(It it = mo->irrep_list.begin(); it != mo->irrep_list.end(); ++it) {
+	pair<Irrep, Irrep> ii(make_pair(*it, *it));
+	D[ii] = 0.5 * mo->P[ii];
+      }
+      if(method.incremental == 1) {
+	BMat dD;
+	for(It it = mo->irrep_list.begin(); it != mo->irrep_list.end(); ++it) {
+	  pair<Irrep, Irrep> ii(make_pair(*it, *it));
+	  if(iter % num_reset == 0) {
+	    G[ii].setZero();
+	    dD[ii] = D[ii];
+	  } else 
+	    dD[ii] = D[ii] - DOld[ii];
+	  DOld[ii] = D[ii];
+	}
+	if(ri)
+	  ri->AddJK(dD, 2.0, -1.0, G);
+	else if(eri)
+	  AddJK_Dens(eri, dD, 2.0, -1.0, chunk_max, method.schwarz_thresh, G);
+	else
+	  AddJK_Direct(gtos, schwarz, dD, 2.0, -1.0, method, G);
+	for(It it = mo->irrep_list.begin(); it != mo->irrep_list.end(); ++it) {
+	  pair<Irrep, Irrep> ii(make_pair(*it, *it));
+	  mo->F[ii] += G[ii];
+	}
+      } else if(ri) {
+	ri->AddJK(D, 2.0, -1.0, mo->F);
+      } else if(eri) {
+	CalcJK_Dens(eri, D, mo->J, mo->K);
+	for(It it = mo->irrep_list.begin(); it != mo->irrep_list.end(); ++it) {
+	  pair<Irrep, Irrep> ii(make_pair(*it, *it));
+	  mo->F[ii] += 2.0 * mo->J[ii] - mo->K[ii];
+	}
+      } else {
+	AddJK_Direct(gtos, schwarz, D, 2.0, -1.0, method, mo->F);
+      }
       /*
       int ib,jb,kb,lb,i,j,k,l,t;
       dcomplex v;
@@ -337,15 +474,22 @@ namespace cbasis {
       }
       */
 
-      // -- Convergence check --
-      bool conv(true);
-      for(It it = mo->irrep_list.begin(); it != mo->irrep_list.end(); ++it) {
-	pair<Irrep, Irrep> ii(make_pair(*it, *it));
-	if(abs((FOld[ii] - mo->F[ii]).mean()) > eps) {
-	  conv = false;
+      // -- Convergence check by max |FPS-SPF| --
+      BMat err;
+      mo->err_history.push_back(DIISError(mo, err));
+      bool conv(mo->err_history.back() < eps);
+
+      // -- DIIS --
+      if(method.diis > 1) {
+	if((int)diis_F.size() == method.diis) {
+	  diis_F.erase(diis_F.begin());
+	  diis_err.erase(diis_err.begin());
 	}
+	diis_F.push_back(mo->F);
+	diis_err.push_back(err);
+	if(diis_F.size() > 1)
+	  DIISExtrapolate(mo->irrep_list, diis_F, diis_err, FDIIS);
       }
-      FOld = mo->F; // copy
 
       // -- calculate total energy --
       mo->energy = 0.0;
@@ -394,63 +538,11 @@ namespace cbasis {
     }
 
     // loop ERI and add to J and K
-    if(method == 0) {
-      int ib,jb,kb,lb,i,j,k,l,t;
-      dcomplex v;
-      eri->Reset();
-      while(eri->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-	if(ib == jb && kb == I0 && lb == I0) {
-	  // Add J
-	  pair<Irrep, Irrep> ij(ib, jb), kl(I0, I0);
-	  MatrixXcd& C = mo->C[kl];
-	  res[ij](i, j) += C(k, i0) * C(l, i0) * v;
-	}
-	
-	if(ib == lb && jb == I0 && kb == I0) {
-	  // Add K
-	  pair<Irrep, Irrep> il(ib, lb), jk(I0, I0);
-	  MatrixXcd& C = mo->C[jk];
-	  res[il](i, l) += C(j, i0) * C(k, i0) * v;
-	}
-      }  
-    } else if(method == 2) {
-      int ib,jb,kb,lb,i,j,k,l,t;
-      dcomplex v;
-      eri->Reset();
-      while(eri->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-	if(ib == jb && kb == I0 && lb == I0) {
-	  // Add J
-	  pair<Irrep, Irrep> ij(ib, jb), kl(I0, I0);
-	  MatrixXcd& C = mo->C[kl];
-	  res[ij](i, j) += C(k, i0) * C(l, i0) * v;
-	}
-	/*
-	if(ib == lb && jb == I0 && kb == I0) {
-	  // Add K
-	  pair<Irrep, Irrep> il(ib, lb), jk(I0, I0);
-	  MatrixXcd& C = mo->C[jk];
-	  res[il](i, l) += C(j, i0) * C(k, i0) * v;
-	}
-	*/
-      }  
-    } else if(method == 3) {
-      int ib,jb,kb,lb,i,j,k,l,t;
-      dcomplex v;
-      eri->Reset();
-      while(eri->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-	if(ib == jb && kb == I0 && lb == I0) {
-	  // Add J
-	  pair<Irrep, Irrep> ij(ib, jb), kl(I0, I0);
-	  MatrixXcd& C = mo->C[kl];
-	  res[ij](i, j) += C(k, i0) * C(l, i0) * v;
-	}
-	if(ib == lb && jb == I0 && kb == I0) {
-	  // Add K
-	  pair<Irrep, Irrep> il(ib, lb), jk(I0, I0);
-	  MatrixXcd& C = mo->C[jk];
-	  res[il](i, l) -= C(j, i0) * C(k, i0) * v;
-	}
-      }  
+    if(method == 0 || method == 2 || method == 3) {
+      // -- J + K, J only and J - K --
+      dcomplex coef_K(method == 0 ? 1.0 : method == 2 ? 0.0 : -1.0);
+      VectorXcd c0 = mo->C[make_pair(I0, I0)].col(i0);
+      AddJK_Orb(eri.get(), I0, c0, I0, c0, 1.0, coef_K, res);
     } else if(method == 1) {
       vector<int> num_isym;
       SymmetryGroup sym = mo->sym;
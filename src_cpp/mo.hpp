@@ -7,6 +7,7 @@
 #include "../utils/typedef.hpp"
 #include "symgroup.hpp"
 #include "symmolint.hpp"
+#include "ri.hpp"
 
 namespace cbasis {
 
@@ -19,6 +20,8 @@ namespace cbasis {
     std::vector<int> num_occ_irrep;
     std::vector<Irrep> irrep_list;
     dcomplex energy;
+    int num_iter;                  // number of SCF iterations
+    std::vector<double> err_history; // max |FPS-SPF| of each SCF iteration
     
     const BMat& HMat() { return H; }
     BMat& SMat() { return S; }
@@ -35,6 +38,12 @@ namespace cbasis {
   MO NewMO(SymmetryGroup sym, BMat& _H, BMat& _C, BVec& _eigs, int num_ele);
   vector<int> CalcOccNum(const BVec& eigs, int num_sym, int num_orb);
   MO CalcOneEle(SymmetryGroup sym, BMatSet mat_set, int debug_lvl = 0);
+  // -- H += coef_J J + coef_K K, J_ij = (ij|kl) a_k b_l for kb=A, lb=B and --
+  // -- K_il = (ij|kl) a_k b_j for jb=B, kb=A. chunks of eri are visited in --
+  // -- parallel by VisitERI. only diagonal blocks of H are updated.        --
+  void AddJK_Orb(IB2EInt* eri, Irrep A, const Eigen::VectorXcd& a,
+		 Irrep B, const Eigen::VectorXcd& b,
+		 dcomplex coef_J, dcomplex coef_K, BMat& H);
   void AddJK(B2EInt eri,  BMat& C, int I0, int i0,
 	     dcomplex coef_J, dcomplex coef_K, BMat& JK);
   void AddJK_Slow(B2EInt eri, BMat& C, int I0, int i0,
@@ -45,6 +54,14 @@ namespace cbasis {
 	     int debug_lvl = 0);
   MO CalcRHF(SymmetryGroup sym, BMatSet mat_set, B2EInt eri, int nele, 
 	     int max_iter, double eps, bool *is_conv, int debug_lvl=0);
+  MO CalcRHF(SymmetryGroup sym, BMatSet mat_set, B2EInt eri, ERIMethod method,
+	     int nele, int max_iter, double eps, bool *is_conv, int debug_lvl=0);
+  // -- integral direct. ERI are recomputed in each iteration and never stored. --
+  MO CalcRHF_Direct(SymGTOs gtos, BMatSet mat_set, ERIMethod method, int nele,
+		    int max_iter, double eps, bool *is_conv, int debug_lvl=0);
+  // -- density fitting or Cholesky. J and K are built from the B tensors of ri. --
+  MO CalcRHF_RI(SymmetryGroup sym, BMatSet mat_set, RI ri, ERIMethod method, int nele,
+		int max_iter, double eps, bool *is_conv, int debug_lvl=0);
   void CalcSEHamiltonian(MO mo, B2EInt eri, Irrep I0, int i0, BMat* hmat,
 			 int method = 0);
   dcomplex CalcAlpha(MO mo, BMatSet mat_set, Irrep I0, int i0, BMat& h_stex, double w, Coord coord, int method=0);
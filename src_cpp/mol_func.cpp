@@ -1,6 +1,8 @@
 #include <string>
 #include <stdexcept>
 #include <sstream>
+#include <vector>
+#include <algorithm>
 #include "mol_func.hpp"
 #include "../utils/fact.hpp"
 
@@ -109,6 +111,91 @@ namespace cbasis {
     delete[] fmR; delete[] fmI;
     delete[] bmR; delete[] bmI;
   }
+  static int inc_gamma_method = INC_GAMMA_SERIES;
+
+  // ==== Coefficient tables ====
+  /*
+    Coefficients of the three term recursions in F2 and G2 which depend
+    only on m and n. Built once at static initialization.
+   */
+  static const int INC_GAMMA_COEF_MAX_M = 100;
+  static const int INC_GAMMA_F2_NR = 47;
+  static const int INC_GAMMA_G2_MAX_N = 40;
+  struct IncGammaCoef {
+    double f2_t[INC_GAMMA_COEF_MAX_M][3];
+    double f2_F[INC_GAMMA_COEF_MAX_M][INC_GAMMA_F2_NR+1][4]; // F1, F2, F3, E
+    double f2_b[INC_GAMMA_F2_NR+1];
+    double g2_F[INC_GAMMA_COEF_MAX_M][INC_GAMMA_G2_MAX_N][2]; // F1, F2
+    IncGammaCoef() {
+      for(int n = 2; n <= INC_GAMMA_F2_NR; n++)
+	f2_b[n] = 1.0/(4*(2*n-1)*(2*n-3)*1.0);
+      for(int m = 0; m < INC_GAMMA_COEF_MAX_M; m++) {
+	f2_t[m][0] = (2.0*m+1) / (2.0*m+3);
+	f2_t[m][1] = (2.0*m+1) / ((2*m+3)*(2*m+5));
+	f2_t[m][2] = (double((2*m+1)*((2*m+1)*(2*m+1)+44)) /
+		      double(60*(2*m+3)*(2*m+5)*(2*m+7)));
+	for(int n = 4; n <= INC_GAMMA_F2_NR; n++) {
+	  double F1 = double(2*n-2*m-5)/double(2*(2*n-3)*(2*n+2*m+1));
+	  f2_F[m][n][0] = F1;
+	  f2_F[m][n][1] = double(1) / double(4*(2*n-1)*(2*n-3));
+	  f2_F[m][n][2] = double(-F1) / double(4*(2*n-3)*(2*n-5));
+	  f2_F[m][n][3] = -F1;
+	}
+	for(int n = 2; n < INC_GAMMA_G2_MAX_N; n++) {
+	  g2_F[m][n][0] = (double(2*(2*m+1)) /
+			   double((4*n+2*m+1)*(4*n+2*m-3)));
+	  g2_F[m][n][1] = (double(8*(n-1)*(2*n+2*m-1)) /
+			   double((4*n+2*m-1)*(4*n+2*m-3)*(4*n+2*m-3)*(4*n+2*m-5)));
+	}
+      }
+    }
+  };
+  static const IncGammaCoef inc_gamma_coef;
+  
+  dcomplex IncompleteGamma_F2_One(int m, dcomplex z, const dcomplex* Bn) {
+    /* F_m(z) by F2 algorithm. Bn is independent of m. */
+
+    static const int NR(INC_GAMMA_F2_NR);
+    dcomplex An[NR+1];
+    double t1, t2, t3;
+    bool use_table(m < INC_GAMMA_COEF_MAX_M);
+    if(use_table) {
+      t1 = inc_gamma_coef.f2_t[m][0];
+      t2 = inc_gamma_coef.f2_t[m][1];
+      t3 = inc_gamma_coef.f2_t[m][2];
+    } else {
+      t1 = (2.0*m+1) / (2.0*m+3);
+      t2 = (2.0*m+1) / ((2*m+3)*(2*m+5));
+      t3 = (double((2*m+1)*((2*m+1)*(2*m+1)+44)) /
+	    double(60*(2*m+3)*(2*m+5)*(2*m+7)));
+    }
+    
+    An[0] = 1.0;
+    An[1] = Bn[1] - t1*z;
+    An[2] = Bn[2] - t1*z - t2*z*z;
+    An[3] = Bn[3] - t1*z - t2*z*z - t3*z*z*z;
+    for(int n = 4; n <= NR; n++) {
+      double F1, F2, F3, E;
+      if(use_table) {
+	const double* c = inc_gamma_coef.f2_F[m][n];
+	F1 = c[0]; F2 = c[1]; F3 = c[2]; E = c[3];
+      } else {
+	F1 = double(2*n-2*m-5)/double(2*(2*n-3)*(2*n+2*m+1));
+	F2 = double(1) / double(4*(2*n-1)*(2*n-3));
+	F3 = double(-F1) / double(4*(2*n-3)*(2*n-5));
+	E = -F1;
+      }
+      An[n] = (1.0+F1*z)*An[n-1] + (E + F2*z)*z*An[n-2] + F3*z*z*z*An[n-3];
+    }
+    return 1.0 / (2*m+1) * An[NR]/Bn[NR];
+    
+  }
+  void IncompleteGamma_F2_Bn(dcomplex z, dcomplex* Bn) {
+    Bn[0] = 1.0;
+    Bn[1] = 1.0 + 0.5*z;
+    for(int n = 2; n <= INC_GAMMA_F2_NR; n++) 
+      Bn[n] = Bn[n-1] + z*z*inc_gamma_coef.f2_b[n]*Bn[n-2];
+  }
   void IncompleteGamma_F2(int max_m, dcomplex z, dcomplex* res) {
 
     double x = real(z);
@@ -128,39 +215,44 @@ namespace cbasis {
 	res[m] = conj(res[m]);
     }
 
-    static const int NR(47);
-    dcomplex Bn[NR+1];
-    dcomplex An[NR+1];
-
-    Bn[0] = 1.0;
-    Bn[1] = 1.0 + 0.5*z;
-    for(int n = 2; n <= NR; n++) 
-      Bn[n] = Bn[n-1] + z*z/(4*(2*n-1)*(2*n-3)*1.0)*Bn[n-2];
-
-    for(int m = 0; m <= max_m; m++) {
+    dcomplex Bn[INC_GAMMA_F2_NR+1];
+    IncompleteGamma_F2_Bn(z, Bn);
+    for(int m = 0; m <= max_m; m++) 
+      res[m] = IncompleteGamma_F2_One(m, z, Bn);
+    
+  }
+  void IncompleteGamma_F2_Down(int max_m, dcomplex z, dcomplex* res) {
+    /*
+      F2 for max_m only and downward recursion for lower m.
+      Relative error grows by |2z/(2m+1)| |F_{m+1}/F_m| in each step. It is
+      about 1 for real z, but not for large Im[z]. When the accumulated
+      growth exceeds 100, remaining F_m are evaluated by F2 directly.
+     */
 
-      An[0] = 1.0;
-      double t1 = (2.0*m+1) / (2.0*m+3);
-      double t2 = (2.0*m+1) / ((2*m+3)*(2*m+5));
-      double t3 = (double((2*m+1)*((2*m+1)*(2*m+1)+44)) /
-		   double(60*(2*m+3)*(2*m+5)*(2*m+7)));
-	
-      An[1] = Bn[1] - t1*z;
-      An[2] = Bn[2] - t1*z - t2*z*z;
-      An[3] = Bn[3] - t1*z - t2*z*z - t3*z*z*z;
-      for(int n = 4; n <= NR; n++) {
-	double F1 = double(2*n-2*m-5)/double(2*(2*n-3)*(2*n+2*m+1));
-	double F2 = double(1) / double(4*(2*n-1)*(2*n-3));
-	double F3 = double(-F1) / double(4*(2*n-3)*(2*n-5));
-	double E = -F1;
-	An[n] = (1.0+F1*z)*An[n-1] + (E + F2*z)*z*An[n-2] + F3*z*z*z*An[n-3];
+    dcomplex Bn[INC_GAMMA_F2_NR+1];
+    IncompleteGamma_F2_Bn(z, Bn);
+    dcomplex expz(exp(-z));
+    if(abs(z) > max_m + 0.5) {
+      res[0] = IncompleteGamma_F2_One(0, z, Bn);
+      for(int m = 0; m < max_m; m++)
+	res[m+1] = ((2.0*m+1.0)*res[m] - expz) / (2.0*z);
+      return;
+    }
+    res[max_m] = IncompleteGamma_F2_One(max_m, z, Bn);
+    double growth(1.0);
+    for(int m = max_m-1; m >= 0; m--) {
+      res[m] = (2.0*z*res[m+1] + expz) / (2.0*m+1.0);
+      growth *= 2.0*abs(z)/(2.0*m+1.0) * abs(res[m+1]) / abs(res[m]);
+      if(growth > 100.0) {
+	for(int mm = m; mm >= 0; mm--)
+	  res[mm] = IncompleteGamma_F2_One(mm, z, Bn);
+	return;
       }
-      res[m] = 1.0 / (2*m+1) * An[NR]/Bn[NR];
     }
     
   }
     
-  void IncompleteGamma(int max_m, dcomplex z, dcomplex* res_list) {
+  void IncompleteGamma_Series(int max_m, dcomplex z, dcomplex* res_list) {
     
     double x = real(z);
     double y = imag(z);
@@ -175,18 +267,106 @@ namespace cbasis {
     } 
     
     if(x > -eps && y > -eps) {
-      if(x < 21.0 && x+y < 37.0) 
-	IncompleteGamma_F2(max_m, z, res_list);
-      else
+      if(x < 21.0 && x+y < 37.0) {
+	if(inc_gamma_method == INC_GAMMA_DOWNWARD)
+	  IncompleteGamma_F2_Down(max_m, z, res_list);
+	else
+	  IncompleteGamma_F2(max_m, z, res_list);
+      } else
 	IncompleteGamma_F1(max_m, z, res_list);
     } else {
-      IncompleteGamma(max_m, dcomplex(x, -y), res_list);
+      IncompleteGamma_Series(max_m, dcomplex(x, -y), res_list);
       for(int m = 0; m <= max_m; m++)
 	res_list[m] = conj(res_list[m]);
     }
 
   }
 
+  // ==== Incomplete Gamma on grid ====
+  /*
+    F_m(z0) are tabulated on grid points z0 = h(ix + i iy) of 0 <= Re z, Im z < X_MAX.
+    Since dF_m/dz = -F_{m+1}, F_m(z) = sum_k F_{m+k}(z0) (z0-z)^k / k!.
+    Only F_{max_m} is interpolated and lower orders are obtained by
+    F_m = (2z F_{m+1} + exp(-z)) / (2m+1).
+   */
+  static const int    INC_GAMMA_GRID_MAX_M  = 20;  // max of max_m supported in grid
+  static const int    INC_GAMMA_GRID_TAYLOR = 8;   // order of Taylor expansion
+  static const int    INC_GAMMA_GRID_NM = INC_GAMMA_GRID_MAX_M + INC_GAMMA_GRID_TAYLOR + 1;
+  static const double INC_GAMMA_GRID_H = 0.2;
+  static const int    INC_GAMMA_GRID_N = 101;      // number of points for Re z and Im z
+  static vector<dcomplex> inc_gamma_grid;          // (ix*N + iy)*NM + m
+  
+  void BuildIncompleteGammaGrid() {
+    
+    if(not inc_gamma_grid.empty())
+      return;
+    
+    int n(INC_GAMMA_GRID_N), nm(INC_GAMMA_GRID_NM);
+    inc_gamma_grid.resize(n * n * nm);
+    for(int ix = 0; ix < n; ix++)
+      for(int iy = 0; iy < n; iy++) {
+	dcomplex z0(INC_GAMMA_GRID_H * ix, INC_GAMMA_GRID_H * iy);
+	IncompleteGamma_Series(nm-1, z0, &inc_gamma_grid[(ix*n + iy)*nm]);
+      }
+    
+  }
+  bool IncompleteGamma_Grid(int max_m, dcomplex z, dcomplex* res_list) {
+
+    if(max_m > INC_GAMMA_GRID_MAX_M)
+      return false;
+
+    double x = real(z);
+    double y = imag(z);
+    bool is_conj(y < 0.0);
+    if(is_conj) {
+      y = -y; z = conj(z);
+    }
+    int ix = int(x / INC_GAMMA_GRID_H + 0.5);
+    int iy = int(y / INC_GAMMA_GRID_H + 0.5);
+    if(x < 0.0 || ix >= INC_GAMMA_GRID_N || iy >= INC_GAMMA_GRID_N)
+      return false;
+
+    int nm(INC_GAMMA_GRID_NM);
+    const dcomplex* f0 = &inc_gamma_grid[(ix*INC_GAMMA_GRID_N + iy)*nm];
+    dcomplex dz(INC_GAMMA_GRID_H * ix - x, INC_GAMMA_GRID_H * iy - y);
+    
+    // -- Horner form of sum_k F_{max_m+k}(z0) dz^k / k! --
+    dcomplex fm(f0[max_m + INC_GAMMA_GRID_TAYLOR]);
+    for(int k = INC_GAMMA_GRID_TAYLOR-1; k >= 0; k--) 
+      fm = f0[max_m + k] + dz / double(k+1) * fm;
+    res_list[max_m] = fm;
+    
+    dcomplex expz(exp(-z));
+    for(int m = max_m-1; m >= 0; m--)
+      res_list[m] = (2.0*z*res_list[m+1] + expz) / (2.0*m+1.0);
+    
+    if(is_conj)
+      for(int m = 0; m <= max_m; m++)
+	res_list[m] = conj(res_list[m]);
+    return true;
+    
+  }
+  void SetIncompleteGammaMethod(int method) {
+    if(method != INC_GAMMA_SERIES && method != INC_GAMMA_GRID &&
+       method != INC_GAMMA_DOWNWARD) {
+      THROW_ERROR("unsupported method");
+    }
+    if(method == INC_GAMMA_GRID)
+      BuildIncompleteGammaGrid();
+    inc_gamma_method = method;
+  }
+  int GetIncompleteGammaMethod() {
+    return inc_gamma_method;
+  }
+  void IncompleteGamma(int max_m, dcomplex z, dcomplex* res_list) {
+
+    if(inc_gamma_method == INC_GAMMA_GRID &&
+       IncompleteGamma_Grid(max_m, z, res_list))
+      return;
+    IncompleteGamma_Series(max_m, z, res_list);
+    
+  }
+
   void ExpIncompleteGamma_G1(int max_m, dcomplex z, dcomplex *res_list) {
     cout << "G1" << endl;
     double x = real(z);
@@ -260,20 +440,65 @@ namespace cbasis {
     }
 
   }
+  dcomplex ExpIncompleteGamma_G2_One(int m, dcomplex z) {
+    /* G_m(z) by G2 algorithm. */
+
+    double x = real(z);
+    double y = imag(z);
+    double delta(pow(10.0, -15.0));
+    bool use_table(m < INC_GAMMA_COEF_MAX_M);
+    
+    bool conv(false);
+    int max_n(INC_GAMMA_G2_MAX_N);
+    double An_R(0), An_I(0), Bn_R(0), Bn_I(0);
+    double Anm1_R(0), Anm1_I(0), Bnm1_R(0), Bnm1_I(0);
+    double Anm2_R(0), Anm2_I(0), Bnm2_R(0), Bnm2_I(0);
+    Bnm2_R = 1;                      Bnm2_I = 0.0;
+    Bnm1_R = 1 + 2.0/(2.0*m+5.0)*x;  Bnm1_I = 2.0/(2.0*m+5.0)*y;
+    Anm2_R = 1;                      Anm2_I = 0; 
+    Anm1_R = Bnm1_R - 2.0*x/(2*m+3); Anm1_I = Bnm1_I - 2.0*y/(2*m+3); 
+
+    for(int n = 2; n < max_n; n++) {
+      double F1, F2;
+      if(use_table) {
+	F1 = inc_gamma_coef.g2_F[m][n][0];
+	F2 = inc_gamma_coef.g2_F[m][n][1];
+      } else {
+	F1 = (double(2*(2*m+1)) /
+	      double((4*n+2*m+1)*(4*n+2*m-3)));
+	F2 = (double(8*(n-1)*(2*n+2*m-1)) /
+	      double((4*n+2*m-1)*(4*n+2*m-3)*(4*n+2*m-3)*(4*n+2*m-5)));
+      }
+      An_R = (1+F1*x)*Anm1_R - F1*y*Anm1_I + (x*x-y*y)*F2*Anm2_R - 2*x*y*F2*Anm2_I;
+      An_I = (1+F1*x)*Anm1_I + F1*y*Anm1_R + (x*x-y*y)*F2*Anm2_I + 2*x*y*F2*Anm2_R;
+      Bn_R = (1+F1*x)*Bnm1_R - F1*y*Bnm1_I + (x*x-y*y)*F2*Bnm2_R - 2*x*y*F2*Bnm2_I;
+      Bn_I = (1+F1*x)*Bnm1_I + F1*y*Bnm1_R + (x*x-y*y)*F2*Bnm2_I + 2*x*y*F2*Bnm2_R;
+
+      dcomplex Gn(dcomplex(An_R, An_I) / dcomplex(Bn_R, Bn_I));
+      dcomplex Gnm1(dcomplex(Anm1_R, Anm1_I) / dcomplex(Bnm1_R, Bnm1_I));
+      if(abs((Gn-Gnm1)/Gn) < delta) {
+	conv = true; break;
+      }
+      Anm2_R = Anm1_R; Anm2_I = Anm1_I; Anm1_R = An_R; Anm1_I = An_I; 
+      Bnm2_R = Bnm1_R; Bnm2_I = Bnm1_I; Bnm1_R = Bn_R; Bnm1_I = Bn_I; 
+    }
+
+    if(!conv) {
+      string msg; SUB_LOCATION(msg);
+      ostringstream oss;
+      oss << msg << ": not converged." << endl;
+      oss << "z = " << z << ", m = " << m << endl;
+      throw runtime_error(oss.str());
+    }
+
+    return 1.0/(2*m+1) * dcomplex(An_R, An_I) / dcomplex(Bn_R, Bn_I);
+  }
   void ExpIncompleteGamma_G2(int max_m, dcomplex z, dcomplex *res_list) {
 
     //    cout << "G2" << endl;
 
     double x = real(z);
-    double y = imag(z);
     double delta(pow(10.0, -15.0));
-    /*
-    static const int MAX_M(100);
-    if(max_m >= MAX_M) {
-      string msg; SUB_LOCATION(msg); msg += ": max_m must be lesser than 100";
-      throw runtime_error(msg);
-    }
-    */
     if(x < -delta) {
       std::string msg;
       SUB_LOCATION(msg);
@@ -281,62 +506,26 @@ namespace cbasis {
       throw std::runtime_error(msg);
     }
 
-    for(int m = 0; m <= max_m; m++) {
-
-      bool conv(false);
-      int max_n(40);
-      double An_R(0), An_I(0), Bn_R(0), Bn_I(0);
-      double Anm1_R(0), Anm1_I(0), Bnm1_R(0), Bnm1_I(0);
-      double Anm2_R(0), Anm2_I(0), Bnm2_R(0), Bnm2_I(0);
-      Bnm2_R = 1;                      Bnm2_I = 0.0;
-      Bnm1_R = 1 + 2.0/(2.0*m+5.0)*x;  Bnm1_I = 2.0/(2.0*m+5.0)*y;
-      Anm2_R = 1;                      Anm2_I = 0; 
-      Anm1_R = Bnm1_R - 2.0*x/(2*m+3); Anm1_I = Bnm1_I - 2.0*y/(2*m+3); 
-      dcomplex Bn(0), An(0);
-
-      for(int n = 2; n < max_n; n++) {
-	double F1 = (double(2*(2*m+1)) /
-		     double((4*n+2*m+1)*(4*n+2*m-3)));
-	double F2 = (double(8*(n-1)*(2*n+2*m-1)) /
-		     double((4*n+2*m-1)*(4*n+2*m-3)*(4*n+2*m-3)*(4*n+2*m-5)));
-	An_R = (1+F1*x)*Anm1_R - F1*y*Anm1_I + (x*x-y*y)*F2*Anm2_R - 2*x*y*F2*Anm2_I;
-	An_I = (1+F1*x)*Anm1_I + F1*y*Anm1_R + (x*x-y*y)*F2*Anm2_I + 2*x*y*F2*Anm2_R;
-	Bn_R = (1+F1*x)*Bnm1_R - F1*y*Bnm1_I + (x*x-y*y)*F2*Bnm2_R - 2*x*y*F2*Bnm2_I;
-	Bn_I = (1+F1*x)*Bnm1_I + F1*y*Bnm1_R + (x*x-y*y)*F2*Bnm2_I + 2*x*y*F2*Bnm2_R;
-
-	Bn = 0.0;
-	for(int j = 0; j <= n; j++)
-	  Bn += (double(DoubleFactorial(2*n+2*m+2*j+1)) / 
-		 double(DoubleFactorial(4*n+2*m+1)) *
-		 Combination(n, j) *
-		 pow(2.0*z, n-j));
-	
-	dcomplex Gn(dcomplex(An_R, An_I) / dcomplex(Bn_R, Bn_I));
-	dcomplex Gnm1(dcomplex(Anm1_R, Anm1_I) / dcomplex(Bnm1_R, Bnm1_I));
-	if(abs((Gn-Gnm1)/Gn) < delta) {
-	  conv = true; break;
-	}
-	Anm2_R = Anm1_R; Anm2_I = Anm1_I; Anm1_R = An_R; Anm1_I = An_I; 
-	Bnm2_R = Bnm1_R; Bnm2_I = Bnm1_I; Bnm1_R = Bn_R; Bnm1_I = Bn_I; 
-      }
-
-      if(!conv) {
-	string msg; SUB_LOCATION(msg); msg += ": not converged.";
-	cout <<
-	  ((abs((Anm1_R-Anm2_R)/An_R) < delta) ? "Yes" : "No") << endl << 
-	  ((abs((Anm1_I-Anm2_I)/An_I) < delta) ? "Yes" : "No") << endl << 
-	  ((abs((Bnm1_R-Bnm2_R)/Bn_R) < delta) ? "Yes" : "No") << endl << 
-	  ((abs((Bnm1_I-Bnm2_I)/Bn_I) < delta) ? "Yes" : "No") << endl;
-	cout <<
-	  (Anm1_R-Anm2_R)/An_R << endl << 
-	  (Anm1_I-Anm2_I)/An_I << endl << 
-	  (Bnm1_R-Bnm2_R)/Bn_R << endl << 
-	  (Bnm1_I-Bnm2_I)/Bn_I << endl;
-	throw runtime_error(msg);
-      }
+    for(int m = 0; m <= max_m; m++)
+      res_list[m] = ExpIncompleteGamma_G2_One(m, z);
+  }
+  void ExpIncompleteGamma_G2_Rec(int max_m, dcomplex z, dcomplex *res_list) {
+    /*
+      G2 only for m = 0 and max_m. From G_m = (1 - 2z G_{m+1}) / (2m+1),
+      errors grow by |2z|/(2m+1) in downward direction, so that upward
+      recursion is used for m < |z| and downward one for m > |z|.
+     */
 
-      res_list[m] = 1.0/(2*m+1) * dcomplex(An_R, An_I) / dcomplex(Bn_R, Bn_I);
-    }
+    int m0(min(max_m, int(abs(z))));
+    res_list[0] = ExpIncompleteGamma_G2_One(0, z);
+    for(int m = 0; m < m0; m++)
+      res_list[m+1] = (1.0 - (2.0*m+1.0)*res_list[m]) / (2.0*z);
+    if(m0 == max_m)
+      return;
+    res_list[max_m] = ExpIncompleteGamma_G2_One(max_m, z);
+    for(int m = max_m-1; m > m0; m--)
+      res_list[m] = (1.0 - 2.0*z*res_list[m+1]) / (2.0*m+1.0);
+    
   }
   
   void ExpIncompleteGamma(int max_m, dcomplex z, dcomplex* res_list) {
@@ -357,6 +546,8 @@ namespace cbasis {
     if(x > -eps && y > -eps) {
       if( (x > 36.0 && y > 36) || x + y > 51) {
 	ExpIncompleteGamma_G1(max_m, z, res_list);
+      } else if(inc_gamma_method == INC_GAMMA_DOWNWARD) {
+	ExpIncompleteGamma_G2_Rec(max_m, z, res_list);
       } else {
 	ExpIncompleteGamma_G2(max_m, z, res_list);
       }
@@ -367,6 +558,157 @@ namespace cbasis {
     }
   }
 
+  // ==== Batch ====
+  void IncompleteGamma_F2_Batch(int max_m, int n, const double* zr, const double* zi,
+				double* fr, double* fi, double* buf) {
+    /*
+      F2 algorithm for n arguments in split real/imaginary arrays.
+      Result F_m(z_i) is put in (fr, fi)[m*n + i]. buf is work space of
+      22*n. Loops over i have no branch so that they can be vectorized.
+     */
+
+    static const int NR(INC_GAMMA_F2_NR);
+    double *z2r(&buf[0]),     *z2i(&buf[n]),    *z3r(&buf[2*n]),  *z3i(&buf[3*n]);
+    double *b1r(&buf[4*n]),   *b1i(&buf[5*n]),  *b2r(&buf[6*n]),  *b2i(&buf[7*n]);
+    double *b3r(&buf[8*n]),   *b3i(&buf[9*n]),  *bNr(&buf[10*n]), *bNi(&buf[11*n]);
+    double *pr(&buf[12*n]),   *pi(&buf[13*n]);
+    double *a1r(&buf[14*n]),  *a1i(&buf[15*n]), *a2r(&buf[16*n]), *a2i(&buf[17*n]);
+    double *a3r(&buf[18*n]),  *a3i(&buf[19*n]), *anr(&buf[20*n]), *ani(&buf[21*n]);
+
+    for(int i = 0; i < n; i++) {
+      z2r[i] = zr[i]*zr[i] - zi[i]*zi[i];  z2i[i] = 2.0*zr[i]*zi[i];
+      z3r[i] = z2r[i]*zr[i] - z2i[i]*zi[i]; z3i[i] = z2r[i]*zi[i] + z2i[i]*zr[i];
+    }
+
+    // -- B_n. (p, b1) = (B_{n-2}, B_{n-1}) in the loop --
+    for(int i = 0; i < n; i++) {
+      pr[i] = 1.0;              pi[i] = 0.0;
+      b1r[i] = 1.0 + 0.5*zr[i]; b1i[i] = 0.5*zi[i];
+      bNr[i] = b1r[i];          bNi[i] = b1i[i];
+    }
+    for(int k = 2; k <= NR; k++) {
+      double c(inc_gamma_coef.f2_b[k]);
+      for(int i = 0; i < n; i++) {
+	double xr(bNr[i] + c*(z2r[i]*pr[i] - z2i[i]*pi[i]));
+	double xi(bNi[i] + c*(z2r[i]*pi[i] + z2i[i]*pr[i]));
+	pr[i] = bNr[i]; pi[i] = bNi[i];
+	bNr[i] = xr;    bNi[i] = xi;
+      }
+      if(k == 2) 
+	for(int i = 0; i < n; i++) { b2r[i] = bNr[i]; b2i[i] = bNi[i]; }
+      if(k == 3) 
+	for(int i = 0; i < n; i++) { b3r[i] = bNr[i]; b3i[i] = bNi[i]; }
+    }
+
+    // -- A_n for each m. (a3, a2, a1) = (A_{n-3}, A_{n-2}, A_{n-1}) --
+    for(int m = 0; m <= max_m; m++) {
+      double t1, t2, t3;
+      if(m < INC_GAMMA_COEF_MAX_M) {
+	t1 = inc_gamma_coef.f2_t[m][0];
+	t2 = inc_gamma_coef.f2_t[m][1];
+	t3 = inc_gamma_coef.f2_t[m][2];
+      } else {
+	t1 = (2.0*m+1) / (2.0*m+3);
+	t2 = (2.0*m+1) / ((2*m+3)*(2*m+5));
+	t3 = (double((2*m+1)*((2*m+1)*(2*m+1)+44)) /
+	      double(60*(2*m+3)*(2*m+5)*(2*m+7)));
+      }
+      for(int i = 0; i < n; i++) {
+	a3r[i] = b1r[i] - t1*zr[i];
+	a3i[i] = b1i[i] - t1*zi[i];
+	a2r[i] = b2r[i] - t1*zr[i] - t2*z2r[i];
+	a2i[i] = b2i[i] - t1*zi[i] - t2*z2i[i];
+	a1r[i] = b3r[i] - t1*zr[i] - t2*z2r[i] - t3*z3r[i];
+	a1i[i] = b3i[i] - t1*zi[i] - t2*z2i[i] - t3*z3i[i];
+      }
+      for(int k = 4; k <= NR; k++) {
+	double F1, F2, F3, E;
+	if(m < INC_GAMMA_COEF_MAX_M) {
+	  const double* c = inc_gamma_coef.f2_F[m][k];
+	  F1 = c[0]; F2 = c[1]; F3 = c[2]; E = c[3];
+	} else {
+	  F1 = double(2*k-2*m-5)/double(2*(2*k-3)*(2*k+2*m+1));
+	  F2 = double(1) / double(4*(2*k-1)*(2*k-3));
+	  F3 = double(-F1) / double(4*(2*k-3)*(2*k-5));
+	  E = -F1;
+	}
+	// -- A_n = A_{n-1} + z(F1 A_{n-1} + E A_{n-2}) + z^2 F2 A_{n-2} + z^3 F3 A_{n-3} --
+	for(int i = 0; i < n; i++) {
+	  double tr(F1*a1r[i] + E*a2r[i]), ti(F1*a1i[i] + E*a2i[i]);
+	  anr[i] = (a1r[i]
+		    + zr[i]*tr - zi[i]*ti
+		    + F2*(z2r[i]*a2r[i] - z2i[i]*a2i[i])
+		    + F3*(z3r[i]*a3r[i] - z3i[i]*a3i[i]));
+	  ani[i] = (a1i[i]
+		    + zr[i]*ti + zi[i]*tr
+		    + F2*(z2r[i]*a2i[i] + z2i[i]*a2r[i])
+		    + F3*(z3r[i]*a3i[i] + z3i[i]*a3r[i]));
+	}
+	for(int i = 0; i < n; i++) {
+	  a3r[i] = a2r[i]; a3i[i] = a2i[i];
+	  a2r[i] = a1r[i]; a2i[i] = a1i[i];
+	  a1r[i] = anr[i]; a1i[i] = ani[i];
+	}
+      }
+      // -- F_m = A_NR / B_NR / (2m+1) --
+      double c(1.0/(2*m+1));
+      for(int i = 0; i < n; i++) {
+	double d(c / (bNr[i]*bNr[i] + bNi[i]*bNi[i]));
+	fr[m*n+i] = d * (a1r[i]*bNr[i] + a1i[i]*bNi[i]);
+	fi[m*n+i] = d * (a1i[i]*bNr[i] - a1r[i]*bNi[i]);
+      }
+    }
+    
+  }
+  void IncompleteGammaBatch(int max_m, const dcomplex* z, int n, dcomplex* out) {
+    IncGammaWork work;
+    IncompleteGammaBatch(max_m, z, n, out, work);
+  }
+  void IncompleteGammaBatch(int max_m, const dcomplex* z, int n, dcomplex* out,
+			    IncGammaWork& work) {
+
+    static const double delta(0.0000000000001);
+    int nm(max_m + 1);
+
+    // -- group by algorithm. F2 of series method is done in batch --
+    vector<int>& idx_f2(work.idx_f2);
+    idx_f2.clear();
+    for(int i = 0; i < n; i++) {
+      double x(real(z[i])), y(abs(imag(z[i])));
+      if(x + delta > 0.0) {
+	if(inc_gamma_method == INC_GAMMA_SERIES && x < 21.0 && x+y < 37.0)
+	  idx_f2.push_back(i);
+	else
+	  IncompleteGamma(max_m, z[i], out + i*nm);
+      } else {
+	ExpIncompleteGamma(max_m, -z[i], out + i*nm);
+      }
+    }
+    
+    int nf2(idx_f2.size());
+    if(nf2 == 0)
+      return;
+    // -- chunks small enough for work arrays to stay in cache --
+    static const int chunk(64);
+    work.zr.resize(chunk); work.zi.resize(chunk);
+    if((int)work.fr.size() < chunk*nm) {
+      work.fr.resize(chunk*nm); work.fi.resize(chunk*nm);
+    }
+    work.buf.resize(22*chunk);
+    double *zr(&work.zr[0]), *zi(&work.zi[0]), *fr(&work.fr[0]), *fi(&work.fi[0]);
+    for(int k0 = 0; k0 < nf2; k0 += chunk) {
+      int nk(std::min(chunk, nf2-k0));
+      for(int k = 0; k < nk; k++) {
+	zr[k] = real(z[idx_f2[k0+k]]); zi[k] = imag(z[idx_f2[k0+k]]);
+      }
+      IncompleteGamma_F2_Batch(max_m, nk, zr, zi, fr, fi, &work.buf[0]);
+      for(int k = 0; k < nk; k++)
+	for(int m = 0; m <= max_m; m++) 
+	  out[idx_f2[k0+k]*nm + m] = dcomplex(fr[m*nk+k], fi[m*nk+k]);
+    }
+    
+  }
+
   dcomplex coef_d(dcomplex zetap,
 		  dcomplex wPk, dcomplex wAk, dcomplex wBk,
 		  int nAk, int nBk, int Nk) {
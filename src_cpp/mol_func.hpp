@@ -1,6 +1,7 @@
 #ifndef MOL_FUNC_H
 #define MOL_FUNC_H
 
+#include <vector>
 #include <Eigen/Core>
 #include "../utils/typedef.hpp"
 #include "mult_array.hpp"
@@ -27,11 +28,33 @@ namespace cbasis {
   // Eq. (24)(25)(26) are incorrect.
   void IncompleteGamma(int max_m, dcomplex z, dcomplex* res);
 
+  // -- algorithm used in IncompleteGamma --
+  // -- INC_GAMMA_GRID : Taylor interpolation on tabulated grid with downward  --
+  // --                  recursion in m. Outside of the grid, F1/F2 are used. --
+  // -- INC_GAMMA_DOWNWARD : F2 (G2) only for max_m and recursion for other m. --
+  static const int INC_GAMMA_SERIES   = 0;
+  static const int INC_GAMMA_GRID     = 1;
+  static const int INC_GAMMA_DOWNWARD = 2;
+  void SetIncompleteGammaMethod(int method);
+  int GetIncompleteGammaMethod();
+
   // K.Ishida J.Comput.Chem. 25, (2004), 739
   // G1 and G2 algorithms 
   // Evaluate G(z) = Exp(-z)F(-z) for Re[z] > 0
   void ExpIncompleteGamma(int max_m, dcomplex z, dcomplex* res_list);
 
+  // -- F_m(z[i]) for 0<=m<=max_m and 0<=i<n is put in out[i*(max_m+1)+m]. --
+  // -- For Re[z[i]] < 0, G_m(-z[i]) = exp(z[i])F_m(z[i]) is put instead,  --
+  // -- in the same way as callers of IncompleteGamma/ExpIncompleteGamma.   --
+  void IncompleteGammaBatch(int max_m, const dcomplex* z, int n, dcomplex* out);
+  // -- work arrays of IncompleteGammaBatch. reused by callers in inner loops. --
+  struct IncGammaWork {
+    std::vector<int> idx_f2;
+    std::vector<double> zr, zi, fr, fi, buf;
+  };
+  void IncompleteGammaBatch(int max_m, const dcomplex* z, int n, dcomplex* out,
+			    IncGammaWork& work);
+
   dcomplex coef_d(dcomplex zetap,
 		  dcomplex wPk, dcomplex wAk, dcomplex wBk,
 		  int nAk, int nBk, int Nk);
@@ -415,6 +415,7 @@ namespace cbasis {
     A3dc dxmap(num), dymap(num), dzmap(num);
     A4dc rmap(num);
     A2dc Fjs_iat(num);
+    vector<dcomplex> args(mole->size()+1); // arguments of F_m for each nucleus
 
     prim.SetRange(niat, nipn, njat, njpn);
     if(calc_coulomb)
@@ -440,14 +441,10 @@ namespace cbasis {
 	  calc_d_coef(mi,mj+2,mi+mj,zetaP,wPz,zi,zj,dzmap);
 	  for(int kat = 0; kat < mole->size(); kat++) {
 	    dcomplex d2p = dist2(wPx-mole->x(kat), wPy-mole->y(kat), wPz-mole->z(kat));
-	    dcomplex arg = zetaP * d2p;
-	    double delta(0.0000000000001);
-	    if(real(arg)+delta > 0.0) {
-	      IncompleteGamma(isub->maxn+jsub->maxn, arg, &Fjs_iat(kat, 0));
-	    } else {
-	      ExpIncompleteGamma(isub->maxn+jsub->maxn, -arg, &Fjs_iat(kat, 0));
-	    }
+	    args[kat] = zetaP * d2p;
 	  }
+	  IncompleteGammaBatch(isub->maxn+jsub->maxn, &args[0], mole->size(),
+			       &Fjs_iat(0, 0));
 	} else {
 	  calc_d_coef(mi,mj+2,0,zetaP,wPx,xi,xj,dxmap);
 	  calc_d_coef(mi,mj+2,0,zetaP,wPy,yi,yj,dymap);
@@ -635,7 +632,7 @@ namespace cbasis {
     BMat S, T, V, X, Y, Z, DX, DY, DZ;
     CalcSTVMat(a, b, &S, &T, &V);
     CalcDipMat(a, b, &X, &Y, &Z, &DX, &DY, &DZ);
-    BMatSet bmat(new _BMatSet);;
+    BMatSet bmat(new _BMatSet(a->sym_group()->num_class()));
     bmat->RefBlockMatrix("s") = S;
     bmat->RefBlockMatrix("t") = T;
     bmat->RefBlockMatrix("v") = V;
@@ -744,6 +741,7 @@ namespace cbasis {
     t.SetRange(0, niat-1, 0, nipn-1, 0, njat-1, 0, njpn-1);
     v.SetRange(0, niat-1, 0, nipn-1, 0, njat-1, 0, njpn-1);
     Fjs_iat.SetRange(0, nkat, 0, isub->maxn + jsub->maxn);
+    vector<dcomplex> args(nkat+1); // arguments of F_m for each nucleus
 
     for(int iat = 0; iat < niat; iat++) {
       for(int jat = 0; jat < njat; jat++) {
@@ -764,14 +762,9 @@ namespace cbasis {
 	calc_d_coef(mi,mj+2,mi+mj,zetaP,wPx,xi,xj,dxmap);
 	calc_d_coef(mi,mj+2,mi+mj,zetaP,wPy,yi,yj,dymap);
 	calc_d_coef(mi,mj+2,mi+mj,zetaP,wPz,zi,zj,dzmap);
-	for(int kat = 0; kat < nkat; kat++) {
-	  dcomplex arg = zetaP * dist2(wPx-mole->x(kat), wPy-mole->y(kat), wPz-mole->z(kat));;
-	  double delta(0.0000000000001);
-	  if(real(arg)+delta > 0.0) 
-	    IncompleteGamma(isub->maxn+jsub->maxn, arg, &Fjs_iat(kat, 0));
-	  else 
-	    ExpIncompleteGamma(isub->maxn+jsub->maxn, -arg, &Fjs_iat(kat, 0));
-	}
+	for(int kat = 0; kat < nkat; kat++) 
+	  args[kat] = zetaP * dist2(wPx-mole->x(kat), wPy-mole->y(kat), wPz-mole->z(kat));
+	IncompleteGammaBatch(isub->maxn+jsub->maxn, &args[0], nkat, &Fjs_iat(0, 0));
 
 	// -- matrix element --
 	for(int ipn = 0; ipn < nipn; ipn++) {
@@ -405,6 +405,33 @@ namespace cbasis {
     if(obj.find("perm") != obj.end()) {
       method.set_perm(ReadJson<int>(obj, "perm"));
     }
+    if(obj.find("num_threads") != obj.end()) {
+      method.set_num_threads(ReadJson<int>(obj, "num_threads"));
+    }
+    if(obj.find("schwarz_thresh") != obj.end()) {
+      method.set_schwarz_thresh(ReadJson<double>(obj, "schwarz_thresh"));
+    }
+    if(obj.find("kernel") != obj.end()) {
+      method.set_kernel(ReadJson<int>(obj, "kernel"));
+    }
+    if(obj.find("direct") != obj.end()) {
+      method.set_direct(ReadJson<int>(obj, "direct"));
+    }
+    if(obj.find("incremental") != obj.end()) {
+      method.set_incremental(ReadJson<int>(obj, "incremental"));
+    }
+    if(obj.find("diis") != obj.end()) {
+      method.set_diis(ReadJson<int>(obj, "diis"));
+    }
+    if(obj.find("storage") != obj.end()) {
+      method.set_storage(ReadJson<int>(obj, "storage"));
+    }
+    if(obj.find("mem_budget") != obj.end()) {
+      method.set_mem_budget(ReadJson<int>(obj, "mem_budget"));
+    }
+    if(obj.find("reduced_tol") != obj.end()) {
+      method.set_reduced_tol(ReadJson<double>(obj, "reduced_tol"));
+    }
     return method;
   }
   template<> LinearSolver ReadJson<LinearSolver>(value& json, int n, int m) {
@@ -0,0 +1,432 @@
+#include <iostream>
+#include <stdexcept>
+#include <Eigen/Dense>
+#include "../utils/typedef.hpp"
+#include "../utils/macros.hpp"
+#include "two_int.hpp"
+#include "ri.hpp"
+
+using namespace std;
+using namespace Eigen;
+
+namespace cbasis {
+
+  typedef Matrix<dcomplex, Dynamic, Dynamic, RowMajor> MatrixXcdR;
+
+  // ==== Unit function ====
+  SymGTOs NewUnitSymGTOs(SymmetryGroup sym) {
+
+    Molecule mole = NewMolecule(sym);
+    mole->Add(NewAtom("ONE", 0.0)->Add(0.0, 0.0, 0.0));
+    SymGTOs unit = NewSymGTOs(mole);
+    VectorXcd zs = VectorXcd::Zero(1);
+    unit->NewSub("ONE")
+      .AddNs(0, 0, 0)
+      .AddRds(Reduction(sym->irrep_s(), MatrixXcd::Ones(1, 1)))
+      .AddConts_Mono(zs);
+    unit->SetUp();
+
+    // -- normalization constant diverges for zeta=0 --
+    unit->sub(0).rds[0].coef_icont(0) = 1.0;
+    return unit;
+
+  }
+
+  // ==== Density fitting ====
+  // ---- Utils ----
+  ERIMethod AuxERIMethod(ERIMethod method) {
+    /*
+      Integrals for the B tensors are read once by Get and discarded, so they
+      are kept in plain B2EIntMem whatever storage the caller uses for (ij|kl).
+     */
+    method.set_storage(0);
+    method.set_perm(0);
+    method.set_direct(0);
+    method.set_incremental(0);
+    return method;
+  }
+
+  // ---- Constructors ----
+  _RI::_RI(SymGTOs gtos, SymGTOs aux, ERIMethod method): gtos_(gtos), aux_(aux) {
+
+    method = AuxERIMethod(method);
+
+    if(not gtos->setupq || not aux->setupq) {
+      THROW_ERROR("not setup");
+    }
+    if(not gtos->sym_group()->IsSame(aux->sym_group())) {
+      THROW_ERROR("symmetry is different");
+    }
+
+    SymmetryGroup sym = gtos->sym_group();
+    int num_irrep(sym->order());
+    num_aux_ = 0;
+    for(Irrep irrep = 0; irrep < num_irrep; irrep++) {
+      num_basis_.push_back(gtos->size_basis_isym(irrep));
+      aux_offset_.push_back(num_aux_);
+      num_aux_ += aux->size_basis_isym(irrep);
+    }
+    if(num_aux_ == 0) {
+      THROW_ERROR("auxiliary basis is empty");
+    }
+
+    SymGTOs unit = NewUnitSymGTOs(sym);
+    int ib, jb, kb, lb, i, j, k, l, t;
+    dcomplex v;
+
+    // -- 2-index (P|Q) --
+    MatrixXcd V = MatrixXcd::Zero(num_aux_, num_aux_);
+    B2EInt eri2 = CalcERI(aux, unit, aux, unit, method);
+    eri2->Reset();
+    while(eri2->Get(&ib, &jb, &kb, &lb, &i, &j, &k, &l, &t, &v)) {
+      V(aux_offset_[ib] + i, aux_offset_[kb] + k) = v;
+    }
+    eri2.reset();
+
+    // -- complex symmetric Cholesky: V = L L^T (no conjugation) --
+    MatrixXcd L = MatrixXcd::Zero(num_aux_, num_aux_);
+    for(int q = 0; q < num_aux_; q++) {
+      dcomplex d = V(q, q);
+      for(int r = 0; r < q; r++)
+	d -= L(q, r) * L(q, r);
+      if(abs(d) < pow(10.0, -14.0)) {
+	THROW_ERROR("(P|Q) is singular. auxiliary basis is linearly dependent.");
+      }
+      L(q, q) = sqrt(d);
+      for(int p = q+1; p < num_aux_; p++) {
+	dcomplex x = V(p, q);
+	for(int r = 0; r < q; r++)
+	  x -= L(p, r) * L(q, r);
+	L(p, q) = x / L(q, q);
+      }
+    }
+
+    // -- 3-index (P|ij) --
+    map<Key, MatrixXcd> B3;
+    for(Irrep irrep = 0; irrep < num_irrep; irrep++)
+      for(Irrep jrrep = 0; jrrep < num_irrep; jrrep++) {
+	int ni(num_basis_[irrep]); int nj(num_basis_[jrrep]);
+	if(ni * nj != 0)
+	  B3[Key(irrep, jrrep)] = MatrixXcd::Zero(ni * nj, num_aux_);
+      }
+    B2EInt eri3 = CalcERI(aux, unit, gtos, gtos, method);
+    eri3->Reset();
+    while(eri3->Get(&ib, &jb, &kb, &lb, &i, &j, &k, &l, &t, &v)) {
+      B3[Key(kb, lb)](k * num_basis_[lb] + l, aux_offset_[ib] + i) = v;
+    }
+    eri3.reset();
+
+    // -- B = B3 L^{-T} --
+    for(map<Key, MatrixXcd>::iterator it = B3.begin(); it != B3.end(); ++it) {
+      MatrixXcd BT = L.triangularView<Lower>().solve(it->second.transpose());
+      B_[it->first] = BT.transpose();
+    }
+
+  }
+
+  _RI::_RI(SymGTOs gtos, ERIMethod method, double thresh): gtos_(gtos) {
+    /*
+      Complex symmetric version of pivoted Cholesky decomposition.
+      Pivot is the pair with largest |residual diagonal|, and its column is
+      taken from the ERI of the sub pair containing it. All columns of the
+      sub pair are kept until they are used or decomposition ends.
+     */
+
+    method = AuxERIMethod(method);
+
+    if(not gtos->setupq) {
+      THROW_ERROR("not setup");
+    }
+
+    SymmetryGroup sym = gtos->sym_group();
+    int num_irrep(sym->order());
+    for(Irrep irrep = 0; irrep < num_irrep; irrep++)
+      num_basis_.push_back(gtos->size_basis_isym(irrep));
+
+    // -- pair index: offset of block (ib,jb) + i*nj+j --
+    map<Key, int> pair_offset;
+    vector<Key> pair_key;
+    int num_pair(0);
+    for(Irrep irrep = 0; irrep < num_irrep; irrep++)
+      for(Irrep jrrep = 0; jrrep < num_irrep; jrrep++) {
+	int ni(num_basis_[irrep]); int nj(num_basis_[jrrep]);
+	if(ni * nj == 0)
+	  continue;
+	pair_offset[Key(irrep, jrrep)] = num_pair;
+	pair_key.push_back(Key(irrep, jrrep));
+	num_pair += ni * nj;
+      }
+
+    // -- sub index for each basis --
+    vector<vector<int> > sub_of(num_irrep);
+    for(Irrep irrep = 0; irrep < num_irrep; irrep++)
+      sub_of[irrep].resize(num_basis_[irrep]);
+    for(int isub = 0; isub < gtos->size_subs(); isub++) {
+      SubSymGTOs& sub(gtos->sub(isub));
+      for(SubSymGTOs::cRdsIt irds = sub.begin_rds(); irds != sub.end_rds(); ++irds)
+	for(int icont = 0; icont < sub.size_cont(); icont++)
+	  sub_of[irds->irrep][irds->offset + icont] = isub;
+    }
+
+    int ib, jb, kb, lb, i, j, k, l, t;
+    dcomplex v;
+
+    // -- diagonal --
+    VectorXcd d = VectorXcd::Zero(num_pair);
+    B2EInt diag = CalcERI_Diag(gtos, method);
+    diag->Reset();
+    while(diag->Get(&ib, &jb, &kb, &lb, &i, &j, &k, &l, &t, &v)) {
+      if(ib == kb && jb == lb && i == k && j == l)
+	d(pair_offset[Key(ib, jb)] + i * num_basis_[jb] + j) = v;
+    }
+    diag.reset();
+
+    // -- decomposition --
+    map<int, VectorXcd> cols;    // pair index => column of ERI supermatrix
+    vector<VectorXcd> vecs;
+    int p;
+    while((int)vecs.size() < num_pair) {
+      d.cwiseAbs().maxCoeff(&p);
+      if(abs(d(p)) < thresh)
+	break;
+
+      if(cols.find(p) == cols.end()) {
+	int a(0);
+	while(a+1 < (int)pair_key.size() && pair_offset[pair_key[a+1]] <= p)
+	  a++;
+	Key key(pair_key[a]);
+	int kl(p - pair_offset[key]);
+	int ksub(sub_of[key.first][kl / num_basis_[key.second]]);
+	int lsub(sub_of[key.second][kl % num_basis_[key.second]]);
+	B2EInt eri = CalcERI_Cols(gtos, ksub, lsub, method);
+	eri->Reset();
+	while(eri->Get(&ib, &jb, &kb, &lb, &i, &j, &k, &l, &t, &v)) {
+	  int q(pair_offset[Key(kb, lb)] + k * num_basis_[lb] + l);
+	  if(cols.find(q) == cols.end())
+	    cols[q] = VectorXcd::Zero(num_pair);
+	  cols[q](pair_offset[Key(ib, jb)] + i * num_basis_[jb] + j) = v;
+	}
+      }
+
+      VectorXcd x(cols[p]);
+      cols.erase(p);
+      for(int m = 0; m < (int)vecs.size(); m++)
+	x -= vecs[m](p) * vecs[m];
+      x /= sqrt(d(p));
+      d -= (x.array() * x.array()).matrix();
+      d(p) = 0.0;
+      vecs.push_back(x);
+    }
+    num_aux_ = vecs.size();
+
+    for(vector<Key>::iterator it = pair_key.begin(); it != pair_key.end(); ++it) {
+      int n(num_basis_[it->first] * num_basis_[it->second]);
+      MatrixXcd& B(B_[*it]);
+      B = MatrixXcd::Zero(n, num_aux_);
+      for(int m = 0; m < num_aux_; m++)
+	B.col(m) = vecs[m].segment(pair_offset[*it], n);
+    }
+
+  }
+
+  // ---- Accessors ----
+  bool _RI::has_block(Irrep ib, Irrep jb) const {
+    return B_.find(Key(ib, jb)) != B_.end();
+  }
+  const MatrixXcd& _RI::B(Irrep ib, Irrep jb) const {
+    map<Key, MatrixXcd>::const_iterator it = B_.find(Key(ib, jb));
+    if(it == B_.end()) {
+      THROW_ERROR("block not found");
+    }
+    return it->second;
+  }
+
+  // ---- Calculation ----
+  dcomplex _RI::ERI(int ib, int jb, int kb, int lb, int i, int j, int k, int l) const {
+    if(not this->has_block(ib, jb) || not this->has_block(kb, lb))
+      return 0.0;
+    const MatrixXcd& Bij = this->B(ib, jb);
+    const MatrixXcd& Bkl = this->B(kb, lb);
+    int ij(i * num_basis_[jb] + j);
+    int kl(k * num_basis_[lb] + l);
+    return (Bij.row(ij).array() * Bkl.row(kl).array()).sum();
+  }
+  void _RI::AddJK(const BMat& D, dcomplex coef_J, dcomplex coef_K, BMat& F) const {
+
+    int num_irrep(num_basis_.size());
+
+    // -- J: d_P = sum_kl B(kl,P) D_kl,  J_ij = sum_P B(ij,P) d_P --
+    if(coef_J != 0.0) {
+      VectorXcd d = VectorXcd::Zero(num_aux_);
+      for(Irrep kb = 0; kb < num_irrep; kb++) {
+	if(not D.has_block(kb, kb) || not this->has_block(kb, kb))
+	  continue;
+	const MatrixXcd& Dkk = D(kb, kb);
+	int n(num_basis_[kb]);
+	MatrixXcdR Dr(Dkk);
+	Map<const VectorXcd> dv(Dr.data(), n * n);
+	d += this->B(kb, kb).transpose() * dv;
+      }
+      for(Irrep ib = 0; ib < num_irrep; ib++) {
+	if(not F.has_block(ib, ib) || not this->has_block(ib, ib))
+	  continue;
+	int n(num_basis_[ib]);
+	VectorXcd jv = this->B(ib, ib) * d;
+	Map<MatrixXcdR> J(jv.data(), n, n);
+	F(ib, ib) += coef_J * J;
+      }
+    }
+
+    // -- K: K_il = sum_P sum_jk B(ij,P) D_jk B(kl,P) --
+    if(coef_K != 0.0) {
+      for(Irrep ib = 0; ib < num_irrep; ib++) {
+	if(not F.has_block(ib, ib))
+	  continue;
+	int ni(num_basis_[ib]);
+	MatrixXcd K = MatrixXcd::Zero(ni, ni);
+	for(Irrep jb = 0; jb < num_irrep; jb++) {
+	  if(not D.has_block(jb, jb) ||
+	     not this->has_block(ib, jb) || not this->has_block(jb, ib))
+	    continue;
+	  int nj(num_basis_[jb]);
+	  const MatrixXcd& Djj = D(jb, jb);
+	  const MatrixXcd& Bij = this->B(ib, jb);
+	  const MatrixXcd& Bji = this->B(jb, ib);
+	  for(int P = 0; P < num_aux_; P++) {
+	    Map<const MatrixXcdR> X(Bij.col(P).data(), ni, nj);
+	    Map<const MatrixXcdR> Y(Bji.col(P).data(), nj, ni);
+	    K += X * Djj * Y;
+	  }
+	}
+	F(ib, ib) += coef_K * K;
+      }
+    }
+
+  }
+  RI NewRI(SymGTOs gtos, SymGTOs aux, ERIMethod method) {
+    RI ptr(new _RI(gtos, aux, method));
+    return ptr;
+  }
+  RI NewRI_Cholesky(SymGTOs gtos, ERIMethod method, double thresh) {
+    RI ptr(new _RI(gtos, method, thresh));
+    return ptr;
+  }
+
+  // ==== B2EInt view ====
+  /*
+    Enumerates (ij|kl) for all pairs of B blocks. Values are computed in Get,
+    so nothing of size O(N^4) is stored.
+   */
+  class B2EIntRI :public IB2EInt {
+  private:
+    RI ri_;
+    vector<_RI::Key> keys_;
+    int a_, c_, ij_, kl_; // current block pair and index pair
+  public:
+    B2EIntRI(RI ri): ri_(ri) {
+      for(map<_RI::Key, MatrixXcd>::const_iterator it = ri->B_.begin();
+	  it != ri->B_.end(); ++it)
+	keys_.push_back(it->first);
+      this->Reset();
+    }
+    ~B2EIntRI() {}
+    void Init(int) {}
+    bool Get(int *ib, int *jb, int *kb, int *lb,
+	     int *i, int *j, int *k, int *l, int *type, dcomplex *val) {
+      int nkey(keys_.size());
+      while(a_ < nkey) {
+	const MatrixXcd& Ba = ri_->B(keys_[a_].first, keys_[a_].second);
+	const MatrixXcd& Bc = ri_->B(keys_[c_].first, keys_[c_].second);
+	if(kl_ == Bc.rows()) {
+	  kl_ = 0; ij_++;
+	}
+	if(ij_ == Ba.rows()) {
+	  ij_ = 0; c_++;
+	  if(c_ == nkey) {
+	    c_ = 0; a_++;
+	  }
+	  continue;
+	}
+	dcomplex v = (Ba.row(ij_).array() * Bc.row(kl_).array()).sum();
+	int x(kl_); kl_++;
+	if(v == 0.0)
+	  continue;
+	int nj(ri_->num_basis(keys_[a_].second));
+	int nl(ri_->num_basis(keys_[c_].second));
+	*ib = keys_[a_].first; *jb = keys_[a_].second;
+	*kb = keys_[c_].first; *lb = keys_[c_].second;
+	*i = ij_ / nj; *j = ij_ % nj;
+	*k = x / nl;   *l = x % nl;
+	*type = ERI_TYPE_PLAIN;
+	*val = v;
+	return true;
+      }
+      return false;
+    }
+    bool GetPacked(int *ib, int *jb, int *kb, int *lb,
+		   int *i, int *j, int *k, int *l, int *type, dcomplex *val) {
+      return this->Get(ib, jb, kb, lb, i, j, k, l, type, val);
+    }
+    dcomplex At(int ib, int jb, int kb, int lb, int i, int j, int k, int l) {
+      if(not this->Exist(ib, jb, kb, lb, i, j, k, l)) {
+	THROW_ERROR("failed to find given index list.");
+      }
+      return ri_->ERI(ib, jb, kb, lb, i, j, k, l);
+    }
+    bool Exist(int ib, int jb, int kb, int lb, int i, int j, int k, int l) {
+      /* same as entries returned by Get */
+      if(not ri_->has_block(ib, jb) || not ri_->has_block(kb, lb))
+	return false;
+      if(i < 0 || ri_->num_basis(ib) <= i || j < 0 || ri_->num_basis(jb) <= j ||
+	 k < 0 || ri_->num_basis(kb) <= k || l < 0 || ri_->num_basis(lb) <= l)
+	return false;
+      return ri_->ERI(ib, jb, kb, lb, i, j, k, l) != 0.0;
+    }
+    bool Set(int, int, int, int, int, int, int, int, dcomplex) {
+      THROW_ERROR("B2EIntRI is read only");
+    }
+    bool Set(int, int, int, int, int, int, int, int, int, dcomplex) {
+      THROW_ERROR("B2EIntRI is read only");
+    }
+    int num_chunk() const { return keys_.size() * keys_.size(); }
+    void GetChunk(int n, ERIChunk *chunk) {
+      /* block pair (a,c) computed at once as Ba Bc^T */
+      if(n < 0 || n >= this->num_chunk()) {
+	THROW_ERROR("chunk index out of range");
+      }
+      const _RI::Key& ka(keys_[n / keys_.size()]);
+      const _RI::Key& kc(keys_[n % keys_.size()]);
+      MatrixXcd V = ri_->B(ka.first, ka.second) * ri_->B(kc.first, kc.second).transpose();
+      int nj(ri_->num_basis(ka.second));
+      int nl(ri_->num_basis(kc.second));
+      chunk->Alloc(V.size());
+      int e(0);
+      for(int ij = 0; ij < V.rows(); ij++)
+	for(int kl = 0; kl < V.cols(); kl++) {
+	  if(V(ij, kl) == 0.0)
+	    continue;
+	  chunk->SetEntry(e, ka.first, ka.second, kc.first, kc.second,
+			  ij / nj, ij % nj, kl / nl, kl % nl, ERI_TYPE_PLAIN);
+	  chunk->v_buf[e] = V(ij, kl);
+	  e++;
+	}
+      chunk->num = e;
+    }
+    void Reset() { a_ = 0; c_ = 0; ij_ = 0; kl_ = 0; }
+    void Write(string) {
+      THROW_ERROR("B2EIntRI is read only");
+    }
+    int size() const {
+      int num(0);
+      for(vector<_RI::Key>::const_iterator a = keys_.begin(); a != keys_.end(); ++a)
+	for(vector<_RI::Key>::const_iterator c = keys_.begin(); c != keys_.end(); ++c)
+	  num += ri_->B(a->first, a->second).rows() * ri_->B(c->first, c->second).rows();
+      return num;
+    }
+    int capacity() const { return this->size(); }
+  };
+  B2EInt ERIView(RI ri) {
+    B2EInt ptr(new B2EIntRI(ri));
+    return ptr;
+  }
+}
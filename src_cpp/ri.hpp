@@ -0,0 +1,62 @@
+#ifndef RI_H
+#define RI_H
+
+#include <map>
+#include <vector>
+#include <Eigen/Core>
+#include <boost/shared_ptr.hpp>
+#include "../utils/typedef.hpp"
+#include "symmolint.hpp"
+#include "b2eint.hpp"
+
+namespace cbasis {
+
+  // ==== Unit function ====
+  // -- SymGTOs with one constant function (zeta=0 s GTO at origin, no normalization). --
+  // -- (P 1|ij) = (P|ij) so that 3- and 2-index integrals come from CalcERI.          --
+  SymGTOs NewUnitSymGTOs(SymmetryGroup sym);
+
+  // ==== Density fitting (resolution of identity) ====
+  /*
+    (ij|kl) ~ sum_P B(ij,P) B(kl,P),  B = (ij|Q) L^{-T},  (P|Q) = L L^T
+    L is the Cholesky factor for complex symmetric (not hermitian) matrix.
+
+    The same representation is used for pivoted Cholesky decomposition of
+    ERI supermatrix, (ij|kl) ~ sum_m B(ij,m) B(kl,m). In this case auxiliary
+    index means Cholesky vector and aux_ is empty.
+   */
+  class _RI;
+  typedef boost::shared_ptr<_RI> RI;
+  class _RI {
+  public:
+    typedef std::pair<Irrep, Irrep> Key;
+    SymGTOs gtos_, aux_;
+    int num_aux_;                    // number of auxiliary functions
+    std::vector<int> aux_offset_;    // offset of each irrep in auxiliary index
+    std::vector<int> num_basis_;     // number of basis for each irrep
+    std::map<Key, Eigen::MatrixXcd> B_; // (ib,jb) => B(i*nj+j, P)
+  public:
+    _RI(SymGTOs gtos, SymGTOs aux, ERIMethod method);
+    _RI(SymGTOs gtos, ERIMethod method, double thresh);
+
+    // ---- Accessors ----
+    int num_aux() const { return num_aux_; }
+    int num_basis(Irrep irrep) const { return num_basis_[irrep]; }
+    bool has_block(Irrep ib, Irrep jb) const;
+    const Eigen::MatrixXcd& B(Irrep ib, Irrep jb) const;
+
+    // ---- Calculation ----
+    // -- approximate (ij|kl) --
+    dcomplex ERI(int ib, int jb, int kb, int lb, int i, int j, int k, int l) const;
+    // -- F += coef_J J[D] + coef_K K[D] (same convention as AddJK_Dens) --
+    void AddJK(const BMat& D, dcomplex coef_J, dcomplex coef_K, BMat& F) const;
+  };
+  RI NewRI(SymGTOs gtos, SymGTOs aux, ERIMethod method);
+  // -- pivoted Cholesky decomposition. stops when max |residual (ij|ij)| < thresh. --
+  RI NewRI_Cholesky(SymGTOs gtos, ERIMethod method, double thresh);
+  // -- read only B2EInt which computes fitted (ij|kl) in Get. O(N^4 N_aux) for all   --
+  // -- entries, so it is for tests and debugging. SCF should use CalcRHF_RI.         --
+  B2EInt ERIView(RI ri);
+}
+
+#endif
@@ -28,10 +28,22 @@ namespace cbasis {
 
 
   // ==== ERI method ====
-  ERIMethod::ERIMethod(): symmetry(0), coef_R_memo(0), perm(0) {}
+  ERIMethod::ERIMethod(): symmetry(0), coef_R_memo(0), perm(0), num_threads(1),
+			   schwarz_thresh(0.0), kernel(0), direct(0),
+			   incremental(0), diis(0), storage(0), mem_budget(1024),
+			   reduced_tol(1.0e-10) {}
   void ERIMethod::set_symmetry(int s) {symmetry = s; }
   void ERIMethod::set_coef_R_memo(int s) {coef_R_memo = s; }
   void ERIMethod::set_perm(int s) {perm = s; }
+  void ERIMethod::set_num_threads(int s) {num_threads = s; }
+  void ERIMethod::set_schwarz_thresh(double s) {schwarz_thresh = s; }
+  void ERIMethod::set_kernel(int s) {kernel = s; }
+  void ERIMethod::set_direct(int s) {direct = s; }
+  void ERIMethod::set_incremental(int s) {incremental = s; }
+  void ERIMethod::set_diis(int s) {diis = s; }
+  void ERIMethod::set_storage(int s) {storage = s; }
+  void ERIMethod::set_mem_budget(int s) {mem_budget = s; }
+  void ERIMethod::set_reduced_tol(double s) {reduced_tol = s; }
 
   // ==== Reduction ====
   void Reduction::SetLM(int _L, int _M, dcomplex _coef_sh) {
@@ -64,6 +76,7 @@ namespace cbasis {
     atom_ = _atom;
     //    zeta_iz = VectorXcd::Zero(0);
     setupq = false;
+    setup_id = 0;
   }
   void SubSymGTOs::SetUp() {
 
@@ -154,6 +167,9 @@ namespace cbasis {
     sym_group()->CalcSymMatrix(gtos, this->ip_jg_kp, this->sign_ip_jg_kp);
 
     // -- set flag --
+    static int num_setup(0);
+#pragma omp critical(sub_setup_id)
+    setup_id = ++num_setup;
     setupq = true;
   }
   SubSymGTOs& SubSymGTOs::AddNs(int nx, int ny, int nz) {
@@ -21,12 +21,33 @@ namespace cbasis {
   class ERIMethod {
   public:
     int symmetry;
-    int coef_R_memo;
+    int coef_R_memo; // 0:recursion, 1:memorized recursion, 2:iterative table
     int perm;
+    int num_threads; // number of threads used in CalcERI
+    double schwarz_thresh; // skip quartets with Schwarz estimate below it (0: off)
+    int kernel; // 0:McMurchie-Davidson, 1:Head-Gordon-Pople, 2:Rys quadrature
+                // (HGP for sub quartets beyond (gg|gg))
+    int direct; // 1: RHF recomputes ERI in each iteration (integral direct)
+    int incremental; // 1: RHF adds J/K of density change to previous Fock
+    int diis; // >1: RHF uses DIIS with this number of previous Fock matrices
+    int storage; // 0: B2EIntMem, 1: B2EIntSparse (block sparse, values only), 2: B2EIntPaged
+                 // 3: B2EIntReduced (B2EIntSparse with float/int16 blocks)
+                 // 4: B2EIntBlock (dense blocks, O(1) Ref)
+    int mem_budget; // MB of resident ERI for storage=2. rest is spilled to scratch file
+    double reduced_tol; // error bound of Re and Im of each ERI for storage=3
     ERIMethod();
     void set_symmetry(int s);
     void set_coef_R_memo(int s);
     void set_perm(int s);
+    void set_num_threads(int s);
+    void set_schwarz_thresh(double s);
+    void set_kernel(int s);
+    void set_direct(int s);
+    void set_incremental(int s);
+    void set_diis(int s);
+    void set_storage(int s);
+    void set_mem_budget(int s);
+    void set_reduced_tol(double s);
   };
 
   // ==== AO Reduction ====
@@ -80,6 +101,7 @@ namespace cbasis {
     Eigen::MatrixXi sign_ip_jg_kp; // sign of above relation
     
     bool setupq;
+    int setup_id; // distinct for each SetUp (0: never). key of caches of derived data
     int maxn;
     //    int maxnx;
 
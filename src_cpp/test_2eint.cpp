@@ -137,6 +137,287 @@ TEST_F(TestB2EInt, IO) {
   
 }
 
+TEST(B2EInt, Perm8) {
+
+  B2EInt eri(new B2EIntMem(10));
+  eri->Set(0, 1, 0, 1, 2, 0, 1, 0, ERI_TYPE_PERM8, 1.1);
+  eri->Set(0, 0, 0, 0, 1, 1, 1, 0, ERI_TYPE_PERM8, 1.2);
+  EXPECT_EQ(2, eri->size());
+  
+  int ib,jb,kb,lb,i,j,k,l,t;
+  dcomplex v;
+  int num(0);
+  eri->Reset();
+  while(eri->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v))
+    num++;
+  EXPECT_EQ(8+4, num);
+
+  EXPECT_C_EQ(1.1, eri->At(1, 0, 0, 1, 0, 2, 1, 0));
+  EXPECT_C_EQ(1.1, eri->At(0, 1, 0, 1, 1, 0, 2, 0));
+  EXPECT_C_EQ(1.1, eri->At(1, 0, 1, 0, 0, 2, 0, 1));
+  EXPECT_C_EQ(1.2, eri->At(0, 0, 0, 0, 1, 0, 1, 1));
+  EXPECT_FALSE(eri->Exist(0, 0, 0, 0, 1, 0, 0, 1));
+
+  // -- packed entries are written and read back --
+  string fn("eri_perm.bin");
+  eri->Write(fn);
+  B2EInt eri2 = ERIRead(fn);
+  EXPECT_EQ(2, eri2->size());
+  EXPECT_C_EQ(1.1, eri2->At(1, 0, 1, 0, 0, 2, 0, 1));
+  
+}
+TEST(B2EInt, Block) {
+
+  vector<int> num_basis(5, 9);
+  B2EInt mem(new B2EIntMem(10));
+  B2EInt blk(new B2EIntBlock(num_basis, 10));
+  B2EInt eris[2] = {mem, blk};
+  for(int a = 0; a < 2; a++) {
+    eris[a]->Set(1, 2, 3, 4, 5, 6, 7, 8, 1.1);
+    eris[a]->Set(0, 1, 0, 1, 2, 0, 1, 0, ERI_TYPE_PERM8, 1.2);
+    eris[a]->Set(0, 0, 0, 1, 0, 0, 3, 0, 1.3);
+    eris[a]->Set(0, 0, 0, 0, 1, 1, 1, 0, ERI_TYPE_PERM8, 1.4);
+  }
+  EXPECT_EQ(14, blk->size()); // distinct images of PERM8 entries are stored
+  EXPECT_EQ(10, blk->capacity());
+
+  // -- same unfolded entries as B2EIntMem --
+  map<vector<int>, dcomplex> ref, res;
+  vector<int> x(9);
+  dcomplex v;
+  mem->Reset(); blk->Reset();
+  while(mem->Get(&x[0],&x[1],&x[2],&x[3],&x[4],&x[5],&x[6],&x[7],&x[8], &v)) {
+    x[8] = ERI_TYPE_PLAIN;
+    ref[x] = v;
+  }
+  while(blk->Get(&x[0],&x[1],&x[2],&x[3],&x[4],&x[5],&x[6],&x[7],&x[8], &v)) {
+    EXPECT_EQ(ERI_TYPE_PLAIN, x[8]);
+    res[x] = v;
+  }
+  EXPECT_EQ(ref.size(), res.size());
+  for(map<vector<int>, dcomplex>::iterator it = ref.begin(); it != ref.end(); ++it) {
+    const vector<int>& y(it->first);
+    EXPECT_TRUE(res.count(y) == 1);
+    EXPECT_C_EQ(it->second, blk->At(y[0],y[1],y[2],y[3],y[4],y[5],y[6],y[7]));
+  }
+
+  // -- At, Exist --
+  EXPECT_C_EQ(1.2, blk->At(1, 0, 1, 0, 0, 2, 0, 1));
+  EXPECT_FALSE(blk->Exist(0, 0, 0, 0, 1, 0, 0, 1));
+  EXPECT_FALSE(blk->Exist(0, 0, 0, 0, 9, 0, 0, 0));
+  EXPECT_ANY_THROW(blk->At(0, 0, 0, 0, 1, 1, 1, 1));
+
+  // -- Ref. each image has its own element --
+  blk->Ref(1, 2, 3, 4, 5, 6, 7, 8) += 1.0;
+  EXPECT_C_EQ(2.1, blk->At(1, 2, 3, 4, 5, 6, 7, 8));
+  blk->Ref(1, 0, 1, 0, 0, 2, 0, 1) = 2.2;
+  EXPECT_C_EQ(2.2, blk->At(1, 0, 1, 0, 0, 2, 0, 1));
+  EXPECT_C_EQ(1.2, blk->At(0, 1, 0, 1, 2, 0, 1, 0));
+  EXPECT_C_EQ(2.2, mem->Ref(1, 0, 1, 0, 0, 2, 0, 1) = 2.2);
+  blk->Ref(0, 0, 0, 0, 1, 1, 1, 1) = 3.3;
+  EXPECT_EQ(15, blk->size());
+  EXPECT_C_EQ(3.3, blk->At(0, 0, 0, 0, 1, 1, 1, 1));
+
+  // -- IO --
+  string fn("eri_block.bin");
+  blk->Write(fn);
+  B2EInt eri2 = ERIRead(fn);
+  EXPECT_EQ(15, eri2->size());
+  EXPECT_C_EQ(2.2, eri2->At(1, 0, 1, 0, 0, 2, 0, 1));
+  EXPECT_C_EQ(1.2, eri2->At(0, 1, 0, 1, 2, 0, 1, 0));
+  
+}
+TEST(B2EInt, Paged) {
+
+  // -- 3 entries per page, 2 pages in memory --
+  B2EIntMem* mem_body(new B2EIntMem(2));
+  B2EInt mem(mem_body);
+  B2EIntPaged* pag_body(new B2EIntPaged(2 * 3 * 64, 3, 2));
+  B2EInt pag(pag_body);
+  B2EInt eris[2] = {mem, pag};
+  for(int a = 0; a < 2; a++) 
+    for(int n = 0; n < 20; n++) {
+      if(n % 4 == 0)
+	eris[a]->Set(0, 0, 0, 0, n, 1, 1, 0, ERI_TYPE_PERM8, 0.1 * n);
+      else
+	eris[a]->Set(1, 2, 3, 4, n, 6, 7, 8, dcomplex(1.0, 0.1 * n));
+    }
+  EXPECT_EQ(20, mem->size());
+  EXPECT_LE(20, mem->capacity());
+  EXPECT_EQ(20, pag->size());
+  EXPECT_EQ(21, pag->capacity());
+  EXPECT_LT(0, pag_body->num_spilled());
+
+  // -- same order as B2EIntMem --
+  int x[10], y[10];
+  dcomplex vx, vy;
+  for(int rep = 0; rep < 2; rep++) {
+    mem->Reset(); pag->Reset();
+    while(mem->Get(&x[0],&x[1],&x[2],&x[3],&x[4],&x[5],&x[6],&x[7],&x[8], &vx)) {
+      EXPECT_TRUE(pag->Get(&y[0],&y[1],&y[2],&y[3],&y[4],&y[5],&y[6],&y[7],&y[8], &vy));
+      for(int n = 0; n < 9; n++)
+	EXPECT_EQ(x[n], y[n]);
+      EXPECT_C_EQ(vx, vy);
+    }
+    EXPECT_FALSE(pag->Get(&y[0],&y[1],&y[2],&y[3],&y[4],&y[5],&y[6],&y[7],&y[8], &vy));
+  }
+  EXPECT_C_EQ(dcomplex(1.0, 1.9), pag->At(1, 2, 3, 4, 19, 6, 7, 8));
+  EXPECT_C_EQ(0.8, pag->At(0, 0, 0, 0, 1, 0, 8, 1));
+
+  // -- IO --
+  string fn("eri_paged.bin");
+  pag->Write(fn);
+  B2EInt eri2 = ERIRead(fn);
+  EXPECT_EQ(20, eri2->size());
+  EXPECT_C_EQ(dcomplex(1.0, 0.5), eri2->At(1, 2, 3, 4, 5, 6, 7, 8));
+
+  pag->Init(10);
+  EXPECT_EQ(0, pag->size());
+  pag->Reset();
+  EXPECT_FALSE(pag->Get(&y[0],&y[1],&y[2],&y[3],&y[4],&y[5],&y[6],&y[7],&y[8], &vy));
+
+  // -- interleave Set and Get. pages spill after read ahead buffer is read --
+  B2EInt pag3(new B2EIntPaged(0, 2, 4));
+  for(int n = 0; n < 12; n++) {
+    pag3->Set(0, 0, 0, 0, n, 0, 0, 0, dcomplex(1.0 * n, 0.1));
+    pag3->Reset();
+    for(int m = 0; m <= n; m++) {
+      EXPECT_TRUE(pag3->GetPacked(&y[0],&y[1],&y[2],&y[3],&y[4],&y[5],&y[6],&y[7],&y[8], &vy));
+      EXPECT_EQ(m, y[4]);
+      EXPECT_C_EQ(dcomplex(1.0 * m, 0.1), vy);
+    }
+    EXPECT_FALSE(pag3->GetPacked(&y[0],&y[1],&y[2],&y[3],&y[4],&y[5],&y[6],&y[7],&y[8], &vy));
+  }
+  
+}
+TEST(B2EInt, Chunk) {
+
+  SymmetryGroup sym = SymmetryGroup_C1();
+  vector<int> num_basis(1, 3);
+  B2EInt eris[5] = {B2EInt(new B2EIntMem(1)),
+		    B2EInt(new B2EIntBlock(num_basis, 1)),
+		    B2EInt(new B2EIntSparse(sym, num_basis, false)),
+		    B2EInt(new B2EIntSparse(sym, num_basis, true)),
+		    B2EInt(new B2EIntPaged(0, 5, 1))};
+  for(int a = 0; a < 5; a++) {
+    int n(0);
+    for(int i = 0; i < 3; i++)
+      for(int j = 0; j <= i; j++)
+	for(int k = 0; k < 3; k++)
+	  for(int l = 0; l <= k; l++)
+	    if(i*(i+1)/2+j >= k*(k+1)/2+l) {
+	      eris[a]->Set(0, 0, 0, 0, i, j, k, l, ERI_TYPE_PERM8,
+			   dcomplex(1.0 + n, 0.1 * n));
+	      n++;
+	    }
+    
+    // -- unfolded entries by Get and by chunks read from 3 threads --
+    map<vector<int>, dcomplex> ref, res;
+    vector<int> x(8);
+    int t;
+    dcomplex v;
+    eris[a]->Reset();
+    while(eris[a]->Get(&x[0],&x[1],&x[2],&x[3],&x[4],&x[5],&x[6],&x[7],&t, &v))
+      ref[x] += v;
+    int num_chunk(eris[a]->num_chunk());
+#pragma omp parallel for schedule(dynamic) num_threads(3)
+    for(int n = 0; n < num_chunk; n++) {
+      ERIChunk c;
+      int y[64];
+      eris[a]->GetChunk(n, &c);
+      for(int e = 0; e < c.num; e++) 
+	for(int g = 0, ng = c.Images(e, y); g < ng; g++) {
+	  vector<int> z(&y[8*g], &y[8*g+8]);
+#pragma omp critical(test_chunk)
+	  res[z] += c.value(e);
+	}
+    }
+    EXPECT_EQ(81, (int)ref.size()) << a;
+    EXPECT_EQ(ref.size(), res.size()) << a;
+    for(map<vector<int>, dcomplex>::iterator it = ref.begin(); it != ref.end(); ++it)
+      EXPECT_C_EQ(it->second, res[it->first]) << a;
+  }
+  EXPECT_LT(1, eris[4]->num_chunk());
+  ERIChunk c;
+  EXPECT_ANY_THROW(eris[0]->GetChunk(eris[0]->num_chunk(), &c));
+  
+}
+TEST(B2EInt, Reduced) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  vector<int> num_basis(8, 2);
+  B2EIntReduced* body(new B2EIntReduced(D2h, num_basis, false, 1.0e-7));
+  B2EInt red(body);
+  B2EInt ref(new B2EIntMem(1));
+  // -- |v| ~ 1e-3 : int16, ~ 1 : float, ~ 100 : double --
+  double mag[3] = {1.0e-3, 1.0, 100.0};
+  int irr[3][4] = {{0,0,0,0}, {1,1,0,0}, {1,1,1,1}};
+  for(int a = 0; a < 3; a++) 
+    for(int i = 0; i < 2; i++)
+      for(int j = 0; j < 2; j++)
+	for(int k = 0; k < 2; k++)
+	  for(int l = 0; l < 2; l++) {
+	    int x[8] = {irr[a][0], irr[a][1], irr[a][2], irr[a][3], i, j, k, l};
+	    dcomplex v(mag[a] * dcomplex(0.3 + 0.11*i + 0.07*j - 0.05*k,
+					 0.01*l - 0.2*i));
+	    red->Set(x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7], v);
+	    ref->Set(x[0], x[1], x[2], x[3], x[4], x[5], x[6], x[7], v);
+	  }
+  size_t bytes0(body->value_bytes());
+  body->Compress();
+  EXPECT_TRUE(body->compressed());
+  EXPECT_LE(body->max_error(), 1.0e-7);
+  EXPECT_EQ(1, body->num_block(ERI_PREC_DOUBLE));
+  EXPECT_EQ(1, body->num_block(ERI_PREC_FLOAT));
+  EXPECT_EQ(red->num_chunk() - 2, body->num_block(ERI_PREC_INT16));
+  EXPECT_LT(body->value_bytes(), bytes0 / 2);
+
+  int x[10];
+  dcomplex v;
+  ref->Reset();
+  while(ref->Get(&x[0],&x[1],&x[2],&x[3],&x[4],&x[5],&x[6],&x[7],&x[8], &v)) {
+    dcomplex w(red->At(x[0],x[1],x[2],x[3],x[4],x[5],x[6],x[7]));
+    EXPECT_NEAR(v.real(), w.real(), 1.0e-7);
+    EXPECT_NEAR(v.imag(), w.imag(), 1.0e-7);
+    if(x[0] == 1 && x[2] == 1) {
+      EXPECT_C_EQ(v, w);
+    }
+  }
+
+  // -- chunks point to encoded values and are decoded in the same way --
+  ERIChunk c;
+  for(int n = 0; n < red->num_chunk(); n++) {
+    red->GetChunk(n, &c);
+    EXPECT_EQ(c.prec == ERI_PREC_DOUBLE, c.v != NULL);
+    for(int e = 0; e < c.num; e++)
+      EXPECT_C_EQ(red->At(c.ib[e], c.jb[e], c.kb[e], c.lb[e],
+			  c.i[e], c.j[e], c.k[e], c.l[e]), c.value(e));
+  }
+
+  // -- J/K read encoded values --
+  BMat D, F0, F1;
+  for(int irrep = 0; irrep < 2; irrep++) {
+    pair<int, int> II(irrep, irrep);
+    D[II] = MatrixXcd::Ones(2, 2);
+    F0[II] = MatrixXcd::Zero(2, 2);
+    F1[II] = MatrixXcd::Zero(2, 2);
+  }
+  AddJK_Dens(ref, D, 2.0, -1.0, F0);
+  AddJK_Dens(red, D, 2.0, -1.0, F1);
+  for(int irrep = 0; irrep < 2; irrep++)
+    EXPECT_NEAR(0.0, (F0(irrep, irrep) - F1(irrep, irrep)).norm(), 1.0e-5);
+
+  // -- IO and Init --
+  string fn("eri_reduced.bin");
+  red->Write(fn);
+  B2EInt eri2 = ERIRead(fn);
+  EXPECT_C_EQ(red->At(0, 0, 0, 0, 1, 0, 1, 1), eri2->At(0, 0, 0, 0, 1, 0, 1, 1));
+  EXPECT_ANY_THROW(red->Set(0, 0, 0, 0, 0, 0, 0, 0, 1.0));
+  red->Init(1);
+  EXPECT_FALSE(body->compressed());
+  EXPECT_C_EQ(0.0, red->At(1, 1, 1, 1, 1, 1, 1, 1));
+  
+}
 TEST(coef_R, method1) {
 
   static const int nn(6);
@@ -166,6 +447,26 @@ TEST(coef_R, method1) {
     for(int j = 0; j < 2; j++)
       EXPECT_C_EQ(res0(i, j, 0), res1(i, j, 0)) << i << j;
 
+}
+TEST(coef_R, method2) {
+
+  static const int nn(6);
+  dcomplex Fjs[nn];
+  Fjs[0] = 0.1;  Fjs[1] = 0.2; Fjs[2] = 0.3;
+  Fjs[3] = 0.25; Fjs[4] = 0.7; Fjs[5] = 0.6;
+
+  dcomplex zeta(0.1, 0.001);
+  MultArray<dcomplex, 3> res1(1000); ERIMethod m1; m1.coef_R_memo = 1;
+  MultArray<dcomplex, 3> res2(1000); ERIMethod m2; m2.coef_R_memo = 2;
+  
+  coef_R_eri_switch(zeta, 0.1, 0.2, 0.3, 0.11, 0.22, 0.33, 5, Fjs, 1.3, res1, m1);
+  coef_R_eri_switch(zeta, 0.1, 0.2, 0.3, 0.11, 0.22, 0.33, 5, Fjs, 1.3, res2, m2);
+
+  for(int i = 0; i <= 5; i++)
+    for(int j = 0; j <= 5-i; j++)
+      for(int k = 0; k <= 5-i-j; k++)
+	EXPECT_C_EQ(res1(i, j, k), res2(i, j, k)) << i << j << k;
+
 }
 TEST(SymGTOs, CalcERI_differenct) {
 
@@ -179,11 +480,11 @@ TEST(SymGTOs, CalcERI_differenct) {
     ->Add(NewAtom("H",   1.0)->Add(0,0,1)->Add(0,0,1));
   
   SymGTOs gtos_1 = NewSymGTOs(mole);
-  gtos_1->NewSub("CEN").SolidSH_M(0, 0, zeta);
+  gtos_1->NewSub("CEN").SolidSH_M(0, 0).AddConts_Mono(zeta);
   gtos_1->SetUp();
 
   SymGTOs gtos_2 = NewSymGTOs(mole);
-  gtos_2->NewSub("CEN").SolidSH_M(1, 0, zeta);
+  gtos_2->NewSub("CEN").SolidSH_M(1, 0).AddConts_Mono(zeta);
   gtos_2->SetUp();
 
   CCs cz_list;
@@ -232,13 +533,13 @@ TEST(SymGTOs, CalcERI) {
   mole
     ->Add(NewAtom("A", 0.0, Vector3cd(0.0, 0.0,  0.4)))
     ->Add(NewAtom("B", 1.0, Vector3cd(0.0, 0.0,  0.0)))
-    ->Add(NewAtom("C", 0.0, Vector3cd(0.0, -0.2, 0.4)))
+    ->Add(NewAtom("C", 0.0, Vector3cd(0.0, -0.2, 0.0)))
     ->Add(NewAtom("D", 0.0, Vector3cd(0.2, 0.0,  0.1)));
   SymGTOs gtos = NewSymGTOs(mole);
-  gtos->NewSub("A").SolidSH_M(0,0, OneVec(1.2));
-  gtos->NewSub("B").SolidSH_M(0,0, OneVec(1.4));
-  gtos->NewSub("C").SolidSH_M(0,0, OneVec(1.1));
-  gtos->NewSub("D").SolidSH_M(0,0, OneVec(1.0));
+  gtos->NewSub("A").SolidSH_M(0,0).AddConts_Mono(OneVec(1.2));
+  gtos->NewSub("B").SolidSH_M(0,0).AddConts_Mono(OneVec(1.4));
+  gtos->NewSub("C").SolidSH_M(0,0).AddConts_Mono(OneVec(1.1));
+  gtos->NewSub("D").SolidSH_M(0,0).AddConts_Mono(OneVec(1.0));
   gtos->SetUp();
 
   // -- A --
@@ -296,10 +597,10 @@ TEST(SymGTOs, CalcERI2) {
     ->Add(NewAtom("C", 0, Vector3cd(0.0, -0.2, 0.0)))
     ->Add(NewAtom("D", 0, Vector3cd(0.2, 0.0,  0.1)));
   SymGTOs gtos = NewSymGTOs(mole);
-  gtos->NewSub("A").Mono(0, Vector3i(0,1,0), OneVec(1.2));
-  gtos->NewSub("B").Mono(0, Vector3i(1,1,0), OneVec(1.4));
-  gtos->NewSub("C").Mono(0, Vector3i(1,1,1), OneVec(1.1));
-  gtos->NewSub("D").Mono(0, Vector3i(0,3,0), OneVec(1.0));
+  gtos->NewSub("A").Mono(0, Vector3i(0,1,0)).AddConts_Mono(OneVec(1.2));
+  gtos->NewSub("B").Mono(0, Vector3i(1,1,0)).AddConts_Mono(OneVec(1.4));
+  gtos->NewSub("C").Mono(0, Vector3i(1,1,1)).AddConts_Mono(OneVec(1.1));
+  gtos->NewSub("D").Mono(0, Vector3i(0,3,0)).AddConts_Mono(OneVec(1.0));
   gtos->SetUp();
   
   /*
@@ -374,7 +675,7 @@ TEST(SymGTOs, CalcERI_sym_p) {
     .AddConts_Mono(z2);
   VectorXcd z3(1); z3 << dcomplex(0.011389, -0.002197);
   gtos->NewSub("Cen")
-    .SolidSH_M(0, 0, z3);
+    .SolidSH_M(0, 0).AddConts_Mono(z3);
   VectorXcd z4(1); z4 << dcomplex(5.063464, -0.024632);
   MatrixXcd C4_1(1, 3); C4_1 << -1,-1,+2; 
   gtos->NewSub("Cen")
@@ -395,9 +696,10 @@ TEST(SymGTOs, CalcERI_sym_p) {
   dcomplex v;
   eri1->Reset();
   while(eri0->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-    if(abs(v) > 0.000001)
+    if(abs(v) > 0.000001) {
       EXPECT_C_EQ(v, eri1->At(ib, jb, kb, lb, i, j, k, l)) <<
 	ib << jb << kb << lb << i << j << k << l;
+    }
   }
 
 }
@@ -472,13 +774,13 @@ TEST(SymGTOs, method_time) {
 
   int num_z(10);
   VectorXcd zs(num_z); zs << 1.1, 1.2, 1.3, 1.4, 1.5, 1.6, 1.7, 1.8, 1.9, 2.0;
-  gtos->NewSub("H").SolidSH_M(0,0, zs);
+  gtos->NewSub("H").SolidSH_M(0,0).AddConts_Mono(zs);
 
   // ---- p orbital ----
   int num_z_p(8);
   VectorXcd zs_p(num_z_p); zs_p << 1.1, 1.2, 1.3, 1.4, 1.5, 1.6, 1.7, 1.8;
   VectorXi Ms(3); Ms << -1,0,1;
-  gtos->NewSub("H").SolidSH_Ms(0, Ms, zs_p);
+  gtos->NewSub("H").SolidSH_Ms(1, Ms).AddConts_Mono(zs_p);
 
   ERIMethod m00; 
   ERIMethod m01; m01.symmetry = 1;
@@ -515,12 +817,12 @@ TEST(SymGTOs, method_check) {
 
   int num_z(2);
   VectorXcd zs(num_z); zs << 1.1, 1.2;
-  gtos->NewSub("H").SolidSH_M(0,0, zs);
+  gtos->NewSub("H").SolidSH_M(0,0).AddConts_Mono(zs);
 
   int num_z_p(2);
   VectorXcd zs_p(num_z_p); zs_p << 1.7, 1.8;
   VectorXi Ms(3); Ms << -1,0,1;
-  gtos->NewSub("H").SolidSH_Ms(0, Ms, zs_p);
+  gtos->NewSub("H").SolidSH_Ms(1, Ms).AddConts_Mono(zs_p);
 
   gtos->SetUp();
   
@@ -571,6 +873,383 @@ TEST(SymGTOs, method_check) {
 
   }
 
+}
+TEST(SymGTOs, CalcERI_rds) {
+
+  // -- several Reductions in one SubSymGTOs vs. one Reduction for each --
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole->Add(NewAtom("CEN", 0.0)->Add(0,0,0));
+
+  SymGTOs gtos_sh = NewSymGTOs(mole);
+  VectorXi Ms(3); Ms << -1,0,1;
+  gtos_sh->NewSub("CEN").SolidSH_Ms(1, Ms).AddCont_Mono(0.7);
+  gtos_sh->SetUp();
+
+  SymGTOs gtos_mono = NewSymGTOs(mole);
+  gtos_mono->NewSub("CEN").Mono(D2h->irrep_x(), Vector3i(1,0,0)).AddCont_Mono(0.7);
+  gtos_mono->NewSub("CEN").Mono(D2h->irrep_y(), Vector3i(0,1,0)).AddCont_Mono(0.7);
+  gtos_mono->NewSub("CEN").Mono(D2h->irrep_z(), Vector3i(0,0,1)).AddCont_Mono(0.7);
+  gtos_mono->SetUp();
+
+  B2EInt eri_sh   = CalcERI_Complex(gtos_sh,   ERIMethod());
+  B2EInt eri_mono = CalcERI_Complex(gtos_mono, ERIMethod());
+
+  Irrep x = D2h->irrep_x(); Irrep z = D2h->irrep_z();
+  EXPECT_C_EQ(eri_mono->At(x, x, z, z, 0, 0, 0, 0),
+	      eri_sh->At(  x, x, z, z, 0, 0, 0, 0));
+  EXPECT_C_EQ(eri_mono->At(x, z, x, z, 0, 0, 0, 0),
+	      eri_sh->At(  x, z, x, z, 0, 0, 0, 0));
+  EXPECT_C_EQ(eri_mono->At(z, z, z, z, 0, 0, 0, 0),
+	      eri_sh->At(  z, z, z, z, 0, 0, 0, 0));
+  
+}
+TEST(SymGTOs, CalcERI_threads) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole
+    ->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7))
+    ->Add(NewAtom("CEN", 0.0)->Add(0,0,0));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(2); zs << 2.0, dcomplex(0.1, -0.02);
+  VectorXi Ms(3); Ms << -1,0,1;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  gtos->NewSub("CEN").SolidSH_Ms(1, Ms).AddConts_Mono(zs);
+  gtos->NewSub("CEN").SolidSH_M(2, 0).AddConts_Mono(zs);
+  gtos->SetUp();
+
+  ERIMethod m0; m0.symmetry = 1;
+  ERIMethod m4; m4.symmetry = 1; m4.num_threads = 4;
+  B2EInt eri0 = CalcERI_Complex(gtos, m0);
+  B2EInt eri4 = CalcERI_Complex(gtos, m4);
+  EXPECT_EQ(eri0->size(), eri4->size());
+
+  // -- order of integrals in eri4 depends on thread scheduling --
+  int ib,jb,kb,lb,i,j,k,l,t;
+  dcomplex v;
+  eri4->Reset();
+  while(eri4->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    if(abs(v) > 0.00001) {
+      EXPECT_C_EQ(eri0->At(ib, jb, kb, lb, i, j, k, l), v) <<
+	ib << jb << kb << lb << " : " << i << j << k << l;
+    }
+  }
+
+  // -- results of threads are appended to block sparse store in parallel --
+  ERIMethod m5; m5.symmetry = 1; m5.num_threads = 4; m5.perm = 1; m5.storage = 1;
+  B2EInt eri5 = CalcERI_Complex(gtos, m5);
+  eri5->Reset();
+  while(eri5->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    if(abs(v) > 0.00001) {
+      EXPECT_C_NEAR(eri0->At(ib, jb, kb, lb, i, j, k, l), v, pow(10.0, -12.0)) <<
+	ib << jb << kb << lb << " : " << i << j << k << l;
+    }
+  }
+  
+}
+TEST(SymGTOs, CalcERI_perm) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole
+    ->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7))
+    ->Add(NewAtom("CEN", 0.0)->Add(0,0,0));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(2); zs << 2.0, dcomplex(0.1, -0.02);
+  VectorXi Ms(3); Ms << -1,0,1;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  gtos->NewSub("CEN").SolidSH_Ms(1, Ms).AddConts_Mono(zs);
+  gtos->NewSub("CEN").SolidSH_M(2, 0).AddConts_Mono(zs);
+  gtos->SetUp();
+
+  ERIMethod m0; m0.symmetry = 1;
+  ERIMethod m1; m1.symmetry = 1; m1.perm = 1;
+  ERIMethod m4; m4.symmetry = 1; m4.perm = 1; m4.num_threads = 4;
+  B2EInt eri0 = CalcERI_Complex(gtos, m0);
+  B2EInt eri1 = CalcERI_Complex(gtos, m1);
+  B2EInt eri4 = CalcERI_Complex(gtos, m4);
+  EXPECT_GT(eri0->size(), 4 * eri1->size());
+  EXPECT_EQ(eri1->size(), eri4->size());
+
+  int ib,jb,kb,lb,i,j,k,l,t;
+  dcomplex v;
+  int num1(0);
+  eri1->Reset();
+  while(eri1->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    num1++;
+    if(abs(v) > 0.00001) {
+      EXPECT_C_EQ(eri0->At(ib, jb, kb, lb, i, j, k, l), v) <<
+	ib << jb << kb << lb << " : " << i << j << k << l;
+    }
+  }
+  EXPECT_EQ(eri0->size(), num1);
+
+  int num4(0);
+  eri4->Reset();
+  while(eri4->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v))
+    num4++;
+  EXPECT_EQ(eri0->size(), num4);
+  
+}
+TEST(SymGTOs, CalcERI_storage) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole
+    ->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7))
+    ->Add(NewAtom("CEN", 0.0)->Add(0,0,0));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(2); zs << 2.0, dcomplex(0.1, -0.02);
+  VectorXi Ms(3); Ms << -1,0,1;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  gtos->NewSub("CEN").SolidSH_Ms(1, Ms).AddConts_Mono(zs);
+  gtos->SetUp();
+
+  ERIMethod m0; m0.symmetry = 1;
+  ERIMethod s0; s0.symmetry = 1; s0.storage = 1;
+  ERIMethod s1; s1.symmetry = 1; s1.storage = 1; s1.perm = 1; s1.num_threads = 2;
+  ERIMethod s2; s2.symmetry = 1; s2.storage = 2; s2.perm = 1; s2.mem_budget = 0;
+  ERIMethod s3; s3.symmetry = 1; s3.storage = 3; s3.perm = 1; s3.reduced_tol = 1.0e-8;
+  ERIMethod s4; s4.symmetry = 1; s4.storage = 4; s4.perm = 1; s4.num_threads = 2;
+  B2EInt eri0 = CalcERI_Complex(gtos, m0);
+  B2EInt eri_s0 = CalcERI_Complex(gtos, s0);
+  B2EInt eri_s1 = CalcERI_Complex(gtos, s1);
+  B2EInt eri_s2 = CalcERI_Complex(gtos, s2);
+  B2EInt eri_s3 = CalcERI_Complex(gtos, s3);
+  B2EInt eri_s4 = CalcERI_Complex(gtos, s4);
+  EXPECT_GT(eri_s0->size(), 4 * eri_s1->size());
+
+  int ib,jb,kb,lb,i,j,k,l,t;
+  dcomplex v;
+  eri0->Reset();
+  while(eri0->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    if(abs(v) < 0.00001)
+      continue;
+    EXPECT_C_NEAR(v, eri_s0->At(ib, jb, kb, lb, i, j, k, l), pow(10.0, -12.0)) <<
+      ib << jb << kb << lb << " : " << i << j << k << l;
+    EXPECT_C_NEAR(v, eri_s1->At(ib, jb, kb, lb, i, j, k, l), pow(10.0, -12.0)) <<
+      ib << jb << kb << lb << " : " << i << j << k << l;
+    EXPECT_C_NEAR(v, eri_s2->At(ib, jb, kb, lb, i, j, k, l), pow(10.0, -12.0)) <<
+      ib << jb << kb << lb << " : " << i << j << k << l;
+    EXPECT_C_NEAR(v, eri_s3->At(ib, jb, kb, lb, i, j, k, l), 2.0e-8) <<
+      ib << jb << kb << lb << " : " << i << j << k << l;
+    EXPECT_C_NEAR(v, eri_s4->At(ib, jb, kb, lb, i, j, k, l), pow(10.0, -12.0)) <<
+      ib << jb << kb << lb << " : " << i << j << k << l;
+  }
+
+  // -- folded values are unfolded to all values of non 0 blocks --
+  int num1(0);
+  eri_s1->Reset();
+  while(eri_s1->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    num1++;
+    EXPECT_C_EQ(eri_s0->At(ib, jb, kb, lb, i, j, k, l), v) <<
+      ib << jb << kb << lb << " : " << i << j << k << l;
+  }
+  EXPECT_EQ(eri_s0->size(), num1);
+
+  // -- IO --
+  string fn("eri_sparse.bin");
+  eri_s1->Write(fn);
+  B2EInt eri2 = ERIRead(fn);
+  EXPECT_EQ(eri_s1->size(), eri2->size());
+  EXPECT_C_EQ(eri_s1->At(0, 0, 0, 0, 1, 0, 1, 1), eri2->At(0, 0, 0, 0, 1, 1, 0, 1));
+  
+}
+TEST(SymGTOs, CalcERI_file) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole
+    ->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7))
+    ->Add(NewAtom("CEN", 0.0)->Add(0,0,0));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(2); zs << 2.0, dcomplex(0.1, -0.02);
+  VectorXi Ms(3); Ms << -1,0,1;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  gtos->NewSub("CEN").SolidSH_Ms(1, Ms).AddConts_Mono(zs);
+  gtos->SetUp();
+
+  ERIMethod m0; m0.symmetry = 1;
+  ERIMethod m1; m1.symmetry = 1; m1.perm = 1; m1.num_threads = 2;
+  B2EInt eri0 = CalcERI_Complex(gtos, m0);
+  B2EInt eri1 = CalcERI_File(gtos, m1, "eri_blk.bin");
+
+  int ib,jb,kb,lb,i,j,k,l,t;
+  dcomplex v;
+  eri0->Reset();
+  while(eri0->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    if(abs(v) > 0.00001) {
+      EXPECT_C_NEAR(v, eri1->At(ib, jb, kb, lb, i, j, k, l), pow(10.0, -12.0)) <<
+	ib << jb << kb << lb << " : " << i << j << k << l;
+    }
+  }
+
+  // -- writer with small chunk gives the same file --
+  vector<int> num_basis;
+  for(Irrep irrep = 0; irrep < D2h->order(); irrep++)
+    num_basis.push_back(gtos->size_basis_isym(irrep));
+  B2EIntStreamWriter* writer = new B2EIntStreamWriter(D2h, num_basis, true,
+						      "eri_blk2.bin", 3);
+  eri1->Reset();
+  while(eri1->GetPacked(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v))
+    writer->Set(ib,jb,kb,lb, i,j,k,l, t, v);
+  delete writer;
+  B2EInt eri2 = ERIRead("eri_blk2.bin");
+  EXPECT_EQ(eri1->size(), eri2->size());
+  int ib2,jb2,kb2,lb2,i2,j2,k2,l2,t2;
+  dcomplex v2;
+  eri1->Reset(); eri2->Reset();
+  while(eri1->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    EXPECT_TRUE(eri2->Get(&ib2,&jb2,&kb2,&lb2,&i2,&j2,&k2,&l2, &t2, &v2));
+    EXPECT_EQ(i, i2);
+    EXPECT_C_EQ(v, v2);
+  }
+  EXPECT_ANY_THROW(ERIRead("not_exist.bin"));
+  EXPECT_EQ(num_basis, dynamic_cast<B2EIntSparse*>(eri2.get())->num_basis());
+
+  // -- broken header or truncated file is rejected --
+  // -- int at byte 12: num_irrep, 20: num_block, long long at 24: num_value --
+  ifstream ifs("eri_blk2.bin", ios::in|ios::binary);
+  string data((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+  ifs.close();
+  int bad_int[2] = {12, 20};
+  for(int a = 0; a < 2; a++) {
+    string bad(data);
+    int x(1 << 28);
+    copy((char*)&x, (char*)&x + sizeof(int), bad.begin() + bad_int[a]);
+    ofstream ofs("eri_bad.bin", ios::out|ios::binary|ios::trunc);
+    ofs.write(bad.data(), bad.size());
+    ofs.close();
+    EXPECT_ANY_THROW(ERIRead("eri_bad.bin")) << a;
+  }
+  {
+    string bad(data);
+    long long x(1LL << 40);
+    copy((char*)&x, (char*)&x + sizeof(long long), bad.begin() + 24);
+    ofstream ofs("eri_bad.bin", ios::out|ios::binary|ios::trunc);
+    ofs.write(bad.data(), bad.size());
+    ofs.close();
+    EXPECT_ANY_THROW(ERIRead("eri_bad.bin"));
+  }
+  {
+    ofstream ofs("eri_bad.bin", ios::out|ios::binary|ios::trunc);
+    ofs.write(data.data(), data.size() - 16);
+    ofs.close();
+    EXPECT_ANY_THROW(ERIRead("eri_bad.bin"));
+  }
+  
+}
+TEST(SymGTOs, CalcERI_schwarz) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole
+    ->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7))
+    ->Add(NewAtom("X", 0.0)->Add(0,0,6.0)->Add(0,0,-6.0));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(3); zs << 4.0, 1.0, dcomplex(0.05, -0.01);
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  gtos->NewSub("X")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  gtos->SetUp();
+
+  ERIMethod m0; m0.symmetry = 1;
+  ERIMethod m1; m1.symmetry = 1; m1.schwarz_thresh = pow(10.0, -8.0);
+  ERIStat stat0, stat1;
+  B2EInt eri0 = CalcERI_Complex(gtos, m0, &stat0);
+  B2EInt eri1 = CalcERI_Complex(gtos, m1, &stat1);
+  EXPECT_EQ(0, stat0.num_skipped);
+  EXPECT_EQ(stat0.num_computed, stat1.num_computed + stat1.num_skipped);
+  EXPECT_TRUE(stat1.num_skipped > 0);
+  EXPECT_TRUE(eri1->size() < eri0->size());
+
+  // -- skipped integrals are negligible --
+  int ib,jb,kb,lb,i,j,k,l,t;
+  dcomplex v;
+  eri0->Reset();
+  while(eri0->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    if(eri1->Exist(ib, jb, kb, lb, i, j, k, l)) {
+      EXPECT_C_EQ(v, eri1->At(ib, jb, kb, lb, i, j, k, l));
+    } else {
+      EXPECT_TRUE(abs(v) < pow(10.0, -7.0)) << v;
+    }
+  }
+  
+}
+TEST(SymGTOs, CalcERI_kernel) {
+
+  Timer timer;
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole
+    ->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7))
+    ->Add(NewAtom("CEN", 0.0)->Add(0,0,0));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(3); zs << 2.0, 0.5, dcomplex(0.1, -0.02);
+  VectorXi Ms(3); Ms << -1,0,1;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  gtos->NewSub("CEN").SolidSH_Ms(1, Ms).AddConts_Mono(zs);
+  gtos->NewSub("CEN").SolidSH_M(2, 0).AddConts_Mono(zs);
+  // -- f and g shells. (gg|gg) needs 9 Rys roots --
+  VectorXcd zs1(1); zs1 << dcomplex(0.5, -0.1);
+  gtos->NewSub("CEN").SolidSH_M(3, 0).AddConts_Mono(zs1);
+  gtos->NewSub("CEN")
+    .AddNs(4,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(1,1)))
+    .AddConts_Mono(zs1);
+  gtos->SetUp();
+
+  ERIMethod m0; m0.symmetry = 1;
+  ERIMethod m1; m1.symmetry = 1; m1.kernel = 1;
+  ERIMethod m2; m2.symmetry = 1; m2.coef_R_memo = 2;
+  ERIMethod m3; m3.symmetry = 1; m3.kernel = 2;
+  B2EInt eri0, eri1, eri2, eri3;
+  timer.Start("MD");      eri0 = CalcERI_Complex(gtos, m0); timer.End("MD");
+  timer.Start("MD_memo"); eri2 = CalcERI_Complex(gtos, m2); timer.End("MD_memo");
+  timer.Start("HGP");     eri1 = CalcERI_Complex(gtos, m1); timer.End("HGP");
+  timer.Start("Rys");     eri3 = CalcERI_Complex(gtos, m3); timer.End("Rys");
+  EXPECT_EQ(eri0->size(), eri1->size());
+  EXPECT_EQ(eri0->size(), eri3->size());
+
+  int ib,jb,kb,lb,i,j,k,l,t;
+  dcomplex v;
+  eri1->Reset();
+  while(eri1->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    if(abs(v) > 0.00001) {
+      EXPECT_C_NEAR(eri0->At(ib, jb, kb, lb, i, j, k, l), v, abs(v)*pow(10.0, -10.0)) <<
+	ib << jb << kb << lb << " : " << i << j << k << l;
+    }
+  }
+  eri3->Reset();
+  while(eri3->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+    if(abs(v) > 0.00001) {
+      EXPECT_C_NEAR(eri0->At(ib, jb, kb, lb, i, j, k, l), v, abs(v)*pow(10.0, -10.0)) <<
+	ib << jb << kb << lb << " : " << i << j << k << l;
+    }
+  }
+  timer.Display();
+  
 }
 TEST(Time, MatrixAccess) {
   int n(1000);
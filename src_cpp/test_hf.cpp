@@ -15,6 +15,7 @@
 #include "mo.hpp"
 #include "timer.hpp"
 #include "trans_eri.hpp"
+#include "ri.hpp"
 
 using namespace std;
 using namespace cbasis;
@@ -34,18 +35,18 @@ TEST(Matrix, J) {
   SymGTOs g_full  = NewSymGTOs(mole);
 
   VectorXcd zeta_i(2); zeta_i << 0.4, 1.0;
-  SubSymGTOs sub_i(sym, h); sub_i.SolidSH_M(0,0,zeta_i);
+  SubSymGTOs sub_i(sym, h); sub_i.SolidSH_M(0,0).AddConts_Mono(zeta_i);
     
   g_i->AddSub(     sub_i);
   g_full->AddSub(  sub_i);
 
   VectorXcd zeta0(2); zeta0 << dcomplex(0.5, 0.0), dcomplex(0.4, 0.1);
-  SubSymGTOs sub_0(sym, h); sub_0.SolidSH_M(1,0,zeta0);
+  SubSymGTOs sub_0(sym, h); sub_0.SolidSH_M(1,0).AddConts_Mono(zeta0);
   g_0->AddSub(sub_0);
   g_full->AddSub(sub_0);
 
   VectorXcd zeta1(2); zeta1 << dcomplex(1.0, 0.4), dcomplex(0.4, 0.1);
-  SubSymGTOs sub_1(sym, h); sub_1.SolidSH_M(1,0,zeta1);
+  SubSymGTOs sub_1(sym, h); sub_1.SolidSH_M(1,0).AddConts_Mono(zeta1);
   g_1->AddSub(sub_1);
   g_full->AddSub(sub_1);
 
@@ -103,14 +104,14 @@ Molecule mole = NewMolecule(sym);
   SymGTOs gtos_full = NewSymGTOs(mole);
 
   VectorXcd zeta1(2); zeta1 << 0.4, 1.0;
-  SubSymGTOs sub_s(sym,h); sub_s.SolidSH_M(0,0, zeta1);
+  SubSymGTOs sub_s(sym,h); sub_s.SolidSH_M(0,0).AddConts_Mono(zeta1);
   gtos->AddSub(     sub_s);
   gtos_cc->AddSub(  sub_s);
   gtos_full->AddSub(sub_s);
 
   VectorXcd zeta2(2); zeta2 << dcomplex(1.0, 0.4), dcomplex(0.4, 0.1);
-  SubSymGTOs sub_z(sym,h); sub_z.SolidSH_M(1,0,zeta2);
-  SubSymGTOs sub_zc(sym,h); sub_zc.SolidSH_M(1,0,zeta2.conjugate());
+  SubSymGTOs sub_z(sym,h); sub_z.SolidSH_M(1,0).AddConts_Mono(zeta2);
+  SubSymGTOs sub_zc(sym,h); sub_zc.SolidSH_M(1,0).AddConts_Mono(zeta2.conjugate());
 
   gtos->AddSub(   sub_z);
   gtos_cc->AddSub(sub_zc);
@@ -174,9 +175,9 @@ TEST(Matrix, JK2) {
   SymGTOs gtos = NewSymGTOs(mole);
   
   VectorXcd zeta1(2); zeta1 << 0.4, 1.0;
-  gtos->NewSub("H").SolidSH_M(0, 0, zeta1);
+  gtos->NewSub("H").SolidSH_M(0, 0).AddConts_Mono(zeta1);
   VectorXcd zeta2(2); zeta2 << dcomplex(1.0, 0.4), dcomplex(0.4, 0.1);
-  gtos->NewSub("H").SolidSH_M(1, 0, zeta2);
+  gtos->NewSub("H").SolidSH_M(1, 0).AddConts_Mono(zeta2);
   gtos->SetUp();  
 
   BMatSet mat = CalcMat_Complex(gtos, false);
@@ -201,6 +202,54 @@ TEST(Matrix, JK2) {
   EXPECT_MATXCD_EQ(H_slow[ii], H_fast[ii]);
   EXPECT_MATXCD_EQ(H_slow[jj], H_fast[jj]);
   
+}
+TEST(Matrix, JK_Small) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole
+    ->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7))
+    ->Add(NewAtom("CEN", 0.0)->Add(0,0,0));
+  SymGTOs g1 = NewSymGTOs(mole);
+  VectorXcd zs(2); zs << 2.0, dcomplex(0.1, -0.02);
+  VectorXi Ms(3); Ms << -1,0,1;
+  g1->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  g1->NewSub("CEN").SolidSH_Ms(1, Ms).AddConts_Mono(zs);
+  g1->SetUp();
+
+  SymGTOs g0 = NewSymGTOs(mole);
+  VectorXcd zs0(2); zs0 << 1.3, 0.4;
+  g0->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs0);
+  g0->SetUp();
+  VectorXcd c0(2); c0 << 0.7, dcomplex(0.2, 0.1);
+  Irrep ir0(D2h->irrep_s());
+
+  BMat J0, K0, J1, K1;
+  for(Irrep irrep = 0; irrep < D2h->order(); irrep++) {
+    int n(g1->size_basis_isym(irrep));
+    if(n == 0)
+      continue;
+    J0(irrep, irrep) = MatrixXcd::Zero(n, n); K0(irrep, irrep) = MatrixXcd::Zero(n, n);
+    J1(irrep, irrep) = MatrixXcd::Zero(n, n); K1(irrep, irrep) = MatrixXcd::Zero(n, n);
+  }
+  ERIMethod m; m.symmetry = 1;
+  AddJ(CalcERI(g1, g1, g0, g0, m), c0, ir0, 1.0, J0);
+  AddK(CalcERI(g1, g0, g0, g1, m), c0, ir0, 1.0, K0);
+  AddJ_Small(g1, g1, g0, c0, ir0, 1.0, m, J1);
+  AddK_Small(g1, g0, g1, c0, ir0, 1.0, m, K1);
+
+  for(BMat::iterator it = J0.begin(); it != J0.end(); ++it) {
+    BMat::Key key(it->first);
+    EXPECT_MATXCD_EQ(J0[key], J1[key]);
+    EXPECT_MATXCD_EQ(K0[key], K1[key]);
+  }
+  
 }
 TEST(Trans, Slow) {
 
@@ -430,10 +479,11 @@ TEST(HF, He) {
   VectorXcd zeta_s(10);
   zeta_s << 0.107951, 0.240920, 0.552610, 1.352436, 3.522261, 9.789053,
     30.17990, 108.7723, 488.8941, 3293.694;  
-  gtos->NewSub("He").SolidSH_M(0,0,zeta_s);
+  gtos->NewSub("He").SolidSH_M(0,0).AddConts_Mono(zeta_s);
+  gtos->SetUp();
 
   bool conv;
-  MO mo = CalcRHF(gtos, 2, 10, 0.0000001, &conv);
+  MO mo = CalcRHF(gtos, 2, 20, 0.0000001, &conv);
   EXPECT_TRUE(conv);
   EXPECT_C_NEAR(dcomplex(-2.8617,0.0), mo->energy,
 		0.0001);
@@ -475,19 +525,19 @@ TEST(HF, H2) {
   gtos->NewSub("H")
     .AddNs(0,0,0)
     .AddRds(Reduction(sym->irrep_s(), c))
-    .AddZeta(zetas);
+    .AddConts_Mono(zetas);
 
   VectorXcd zeta_p(1); zeta_p << 1.1;
   MatrixXcd cp(2, 1); cp << 1, -1;
   gtos->NewSub("H")
     .AddNs(0,0,1)
     .AddRds(Reduction(sym->irrep_s(), cp))
-    .AddZeta(zeta_p);
+    .AddConts_Mono(zeta_p);
   
   gtos->SetUp();
 
   bool conv;
-  double eps(pow(10.0, -5.0));
+  double eps(pow(10.0, -7.0));
   BMatSet mat_set = CalcMat_Complex(gtos, true);
   ERIMethod method; method.symmetry = 1;
   B2EInt eri = CalcERI_Complex(gtos, method);
@@ -495,9 +545,321 @@ TEST(HF, H2) {
   MO mo = CalcRHF(sym, mat_set, eri, 2, 50, eps, &conv, 0);
   EXPECT_TRUE(conv);
   EXPECT_C_NEAR(mo->energy + 1.0/R0, -1.11881323240, 0.00001);
-  EXPECT_C_NEAR(mo->eigs[0](0), -0.59012, 0.00002);
+  EXPECT_C_NEAR(mo->eigs[0](0), -0.59015, 0.00002);
   EXPECT_C_NEAR(mo->eigs[0](1), +0.02339, 0.00002);
 }
+TEST(HF, H2_direct) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(4); zs << 1.336, 2.013, 0.4538, 0.1233;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  MatrixXcd cp(2, 1); cp << 1, -1;
+  gtos->NewSub("H")
+    .AddNs(0,0,1)
+    .AddRds(Reduction(D2h->irrep_s(), cp))
+    .AddConts_Mono(zs.head(2));
+  gtos->SetUp();
+
+  bool conv0, conv1, conv2;
+  double eps(pow(10.0, -8.0));
+  BMatSet mat_set = CalcMat_Complex(gtos, true);
+  ERIMethod method; method.symmetry = 1;
+  B2EInt eri = CalcERI_Complex(gtos, method);
+  MO mo0 = CalcRHF(D2h, mat_set, eri, 2, 50, eps, &conv0);
+  MO mo1 = CalcRHF_Direct(gtos, mat_set, method, 2, 50, eps, &conv1);
+  ERIMethod method_s; method_s.symmetry = 1; method_s.schwarz_thresh = pow(10.0, -12.0);
+  MO mo2 = CalcRHF_Direct(gtos, mat_set, method_s, 2, 50, eps, &conv2);
+
+  EXPECT_TRUE(conv0);
+  EXPECT_TRUE(conv1);
+  EXPECT_TRUE(conv2);
+  EXPECT_C_NEAR(mo0->energy, mo1->energy, pow(10.0, -10.0));
+  EXPECT_C_NEAR(mo0->energy, mo2->energy, pow(10.0, -8.0));
+  EXPECT_C_NEAR(mo0->eigs[0](0), mo1->eigs[0](0), pow(10.0, -8.0));
+
+  // -- incremental Fock build --
+  bool conv3, conv4;
+  ERIMethod method_i; method_i.symmetry = 1; method_i.incremental = 1;
+  MO mo3 = CalcRHF(D2h, mat_set, eri, method_i, 2, 50, eps, &conv3);
+  method_i.schwarz_thresh = pow(10.0, -12.0);
+  MO mo4 = CalcRHF_Direct(gtos, mat_set, method_i, 2, 50, eps, &conv4);
+  EXPECT_TRUE(conv3);
+  EXPECT_TRUE(conv4);
+  EXPECT_C_NEAR(mo0->energy, mo3->energy, pow(10.0, -8.0));
+  bool conv5;
+  MO mo5 = CalcRHF(D2h, mat_set, eri, method_i, 2, 50, eps, &conv5);
+  EXPECT_TRUE(conv5);
+  EXPECT_C_NEAR(mo0->energy, mo4->energy, pow(10.0, -8.0));
+  EXPECT_C_NEAR(mo0->energy, mo5->energy, pow(10.0, -8.0));
+  
+}
+TEST(HF, DIIS) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(4); zs << 1.336, 2.013, 0.4538, 0.1233;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  MatrixXcd cp(2, 1); cp << 1, -1;
+  gtos->NewSub("H")
+    .AddNs(0,0,1)
+    .AddRds(Reduction(D2h->irrep_s(), cp))
+    .AddConts_Mono(zs.head(2));
+  gtos->SetUp();
+
+  bool conv0, conv1;
+  double eps(pow(10.0, -8.0));
+  BMatSet mat_set = CalcMat_Complex(gtos, true);
+  ERIMethod method; method.symmetry = 1;
+  B2EInt eri = CalcERI_Complex(gtos, method);
+  MO mo0 = CalcRHF(D2h, mat_set, eri, method, 2, 50, eps, &conv0);
+  ERIMethod method_d; method_d.symmetry = 1; method_d.diis = 6;
+  MO mo1 = CalcRHF(D2h, mat_set, eri, method_d, 2, 50, eps, &conv1);
+
+  EXPECT_TRUE(conv0);
+  EXPECT_TRUE(conv1);
+  EXPECT_C_NEAR(mo1->energy + 1.0/1.4, -1.1187277514, pow(10.0, -8.0));
+  EXPECT_C_NEAR(mo0->energy, mo1->energy, pow(10.0, -8.0));
+  EXPECT_EQ(mo0->num_iter, (int)mo0->err_history.size());
+  EXPECT_EQ(mo1->num_iter, (int)mo1->err_history.size());
+  EXPECT_LT(mo1->num_iter, mo0->num_iter);
+  EXPECT_GT(pow(10.0, -6.0), mo1->err_history.back());
+  
+}
+TEST(HF, RI) {
+
+  // -- one center s basis. products of basis are in auxiliary basis, --
+  // -- so that density fitting is exact.                             --
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole->Add(NewAtom("He", 2.0)->Add(0,0,0));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(3); zs << dcomplex(0.5, -0.1), 1.0, 2.0;
+  gtos->NewSub("He").Mono(0, Vector3i(0,0,0)).AddConts_Mono(zs);
+  gtos->SetUp();
+  SymGTOs aux = NewSymGTOs(mole);
+  VectorXcd zs_aux(6);
+  zs_aux << zs(0)+zs(0), zs(0)+zs(1), zs(0)+zs(2), zs(1)+zs(1), zs(1)+zs(2), zs(2)+zs(2);
+  aux->NewSub("He").Mono(0, Vector3i(0,0,0)).AddConts_Mono(zs_aux);
+  aux->SetUp();
+
+  ERIMethod method; method.symmetry = 1;
+  B2EInt eri = CalcERI_Complex(gtos, method);
+  RI ri = NewRI(gtos, aux, method);
+  EXPECT_EQ(6, ri->num_aux());
+  EXPECT_C_NEAR(eri->At(0,0,0,0, 0,1,2,1), ri->ERI(0,0,0,0, 0,1,2,1), pow(10.0, -8.0));
+  EXPECT_C_NEAR(eri->At(0,0,0,0, 2,2,0,0), ri->ERI(0,0,0,0, 2,2,0,0), pow(10.0, -8.0));
+
+  // -- storage of (ij|kl) does not affect auxiliary integrals --
+  ERIMethod method_s; method_s.symmetry = 1; method_s.perm = 1; method_s.storage = 2;
+  RI ri_s = NewRI(gtos, aux, method_s);
+  EXPECT_C_NEAR(ri->ERI(0,0,0,0, 0,1,2,1), ri_s->ERI(0,0,0,0, 0,1,2,1), pow(10.0, -12.0));
+
+  BMat D; D[make_pair(0, 0)] = MatrixXcd::Random(3, 3);
+  D[make_pair(0, 0)] += D[make_pair(0, 0)].transpose().eval();
+  BMat F0; F0[make_pair(0, 0)] = MatrixXcd::Zero(3, 3);
+  BMat F1; F1[make_pair(0, 0)] = MatrixXcd::Zero(3, 3);
+  AddJK_Dens(eri, D, 2.0, -1.0, F0);
+  ri->AddJK(D, 2.0, -1.0, F1);
+  EXPECT_NEAR(0.0, (F0(0, 0) - F1(0, 0)).norm(), pow(10.0, -8.0));
+
+  // -- RHF with fitted integrals --
+  bool conv0, conv1, conv2;
+  double eps(pow(10.0, -8.0));
+  BMatSet mat_set = CalcMat_Complex(gtos, true);
+  MO mo0 = CalcRHF(D2h, mat_set, eri, 2, 50, eps, &conv0);
+  MO mo1 = CalcRHF(D2h, mat_set, ERIView(ri), 2, 50, eps, &conv1);
+  MO mo2 = CalcRHF_RI(D2h, mat_set, ri, method, 2, 50, eps, &conv2);
+  EXPECT_TRUE(conv0);
+  EXPECT_TRUE(conv1);
+  EXPECT_TRUE(conv2);
+  EXPECT_C_NEAR(mo0->energy, mo1->energy, pow(10.0, -8.0));
+  EXPECT_C_NEAR(mo0->energy, mo2->energy, pow(10.0, -8.0));
+  
+}
+TEST(HF, JK_Dens) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(4); zs << 1.336, 2.013, 0.4538, 0.1233;
+  MatrixXcd cp(2, 1); cp << 1, -1;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_z(), cp))
+    .AddConts_Mono(zs);
+  gtos->NewSub("H")
+    .AddNs(0,0,1)
+    .AddRds(Reduction(D2h->irrep_s(), cp))
+    .AddConts_Mono(zs.head(2));
+  gtos->SetUp();
+
+  // -- random symmetric density for all irreps --
+  BMatSet mat_set = CalcMat_Complex(gtos, true);
+  BMat D;
+  const BMat& S = mat_set->GetBlockMatrix("s");
+  for(BMat::const_iterator it = S.begin(); it != S.end(); ++it) {
+    int n(it->second.rows());
+    if(it->first.first != it->first.second || n == 0)
+      continue;
+    MatrixXcd A = MatrixXcd::Random(n, n);
+    D[it->first] = A + A.transpose();
+  }
+  EXPECT_EQ(2, D.size());
+
+  // -- same as AddJK_Dens for plain and folded stores --
+  ERIMethod m0; m0.symmetry = 1;
+  ERIMethod m1; m1.symmetry = 1; m1.perm = 1;
+  ERIMethod m2; m2.symmetry = 1; m2.perm = 1; m2.storage = 1;
+  ERIMethod ms[3] = {m0, m1, m2};
+  B2EInt eri0 = CalcERI_Complex(gtos, m0);
+  for(int a = 0; a < 3; a++) {
+    B2EInt eri = CalcERI_Complex(gtos, ms[a]);
+    BMat J, K, J0, K0;
+    CalcJK_Dens(eri, D, J, K);
+    for(BMat::iterator it = D.begin(); it != D.end(); ++it) {
+      int n(it->second.rows());
+      J0[it->first] = MatrixXcd::Zero(n, n);
+      K0[it->first] = MatrixXcd::Zero(n, n);
+    }
+    AddJK_Dens(eri0, D, 1.0, 0.0, J0);
+    AddJK_Dens(eri0, D, 0.0, 1.0, K0);
+    for(BMat::iterator it = D.begin(); it != D.end(); ++it) {
+      EXPECT_MATXCD_EQ(J0[it->first], J[it->first]) << a;
+      EXPECT_MATXCD_EQ(K0[it->first], K[it->first]) << a;
+    }
+  }
+
+  // -- integral direct with threads and Schwarz table --
+  {
+    BMat F0, F1;
+    for(BMat::iterator it = D.begin(); it != D.end(); ++it) {
+      int n(it->second.rows());
+      F0[it->first] = MatrixXcd::Zero(n, n);
+      F1[it->first] = MatrixXcd::Zero(n, n);
+    }
+    ERIMethod md; md.symmetry = 1; md.num_threads = 2; md.schwarz_thresh = pow(10.0, -14.0);
+    AddJK_Dens(eri0, D, 2.0, -1.0, F0);
+    AddJK_Direct(gtos, NewSchwarz(gtos, md), D, 2.0, -1.0, md, F1);
+    for(BMat::iterator it = D.begin(); it != D.end(); ++it)
+      EXPECT_MATXCD_EQ(F0[it->first], F1[it->first]);
+  }
+
+  // -- chunks screened by max |ERI| times max |D| --
+  {
+    vector<double> chunk_max = ChunkMaxAbs(eri0);
+    EXPECT_EQ(eri0->num_chunk(), (int)chunk_max.size());
+    BMat dD, F0, F1;
+    for(BMat::iterator it = D.begin(); it != D.end(); ++it) {
+      int n(it->second.rows());
+      dD[it->first] = pow(10.0, -20.0) * it->second;
+      F0[it->first] = MatrixXcd::Zero(n, n);
+      F1[it->first] = MatrixXcd::Zero(n, n);
+    }
+    AddJK_Dens(eri0, D, 2.0, -1.0, chunk_max, pow(10.0, -12.0), F0);
+    AddJK_Dens(eri0, D, 2.0, -1.0, F1);
+    for(BMat::iterator it = D.begin(); it != D.end(); ++it)
+      EXPECT_MATXCD_EQ(F1[it->first], F0[it->first]);
+    AddJK_Dens(eri0, dD, 2.0, -1.0, chunk_max, pow(10.0, -12.0), F0);
+    for(BMat::iterator it = D.begin(); it != D.end(); ++it)
+      EXPECT_TRUE(F1[it->first] == F0[it->first]);
+  }
+
+  // -- RHF with 2 occupied orbitals --
+  bool conv0, conv1, conv2;
+  double eps(pow(10.0, -8.0));
+  B2EInt eri1 = CalcERI_Complex(gtos, m1);
+  MO mo0 = CalcRHF(D2h, mat_set, eri1, m1, 4, 100, eps, &conv0);
+  MO mo1 = CalcRHF_Direct(gtos, mat_set, m0, 4, 100, eps, &conv1);
+  ERIMethod mi; mi.symmetry = 1; mi.incremental = 1;
+  MO mo2 = CalcRHF(D2h, mat_set, eri0, mi, 4, 100, eps, &conv2);
+  EXPECT_TRUE(conv0);
+  EXPECT_TRUE(conv1);
+  EXPECT_TRUE(conv2);
+  int nocc(0);
+  for(int irrep = 0; irrep < D2h->num_class(); irrep++)
+    nocc += mo0->num_occ_irrep[irrep];
+  EXPECT_EQ(2, nocc);
+  EXPECT_C_NEAR(mo0->energy, mo1->energy, pow(10.0, -8.0));
+  EXPECT_C_NEAR(mo0->energy, mo2->energy, pow(10.0, -8.0));
+  
+}
+TEST(HF, Cholesky) {
+
+  SymmetryGroup D2h = SymmetryGroup_D2h();
+  Molecule mole = NewMolecule(D2h);
+  mole->Add(NewAtom("H", 1.0)->Add(0,0,0.7)->Add(0,0,-0.7));
+  SymGTOs gtos = NewSymGTOs(mole);
+  VectorXcd zs(4); zs << 1.336, 2.013, dcomplex(0.4538, -0.05), 0.1233;
+  gtos->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs);
+  MatrixXcd cp(2, 1); cp << 1, -1;
+  gtos->NewSub("H")
+    .AddNs(0,0,1)
+    .AddRds(Reduction(D2h->irrep_s(), cp))
+    .AddConts_Mono(zs.head(2));
+  gtos->SetUp();
+
+  ERIMethod method; method.symmetry = 1;
+  B2EInt eri = CalcERI_Complex(gtos, method);
+  RI cd = NewRI_Cholesky(gtos, method, pow(10.0, -12.0));
+  int n(gtos->size_basis_isym(0));
+  EXPECT_TRUE(cd->num_aux() < n*n);
+  EXPECT_C_NEAR(eri->At(0,0,0,0, 0,1,2,3), cd->ERI(0,0,0,0, 0,1,2,3), pow(10.0, -10.0));
+  EXPECT_C_NEAR(eri->At(0,0,0,0, 5,5,0,4), cd->ERI(0,0,0,0, 5,5,0,4), pow(10.0, -10.0));
+
+  BMat D; D[make_pair(0, 0)] = MatrixXcd::Random(n, n);
+  D[make_pair(0, 0)] += D[make_pair(0, 0)].transpose().eval();
+  BMat F0; F0[make_pair(0, 0)] = MatrixXcd::Zero(n, n);
+  BMat F1; F1[make_pair(0, 0)] = MatrixXcd::Zero(n, n);
+  AddJK_Dens(eri, D, 2.0, -1.0, F0);
+  cd->AddJK(D, 2.0, -1.0, F1);
+  EXPECT_NEAR(0.0, (F0(0, 0) - F1(0, 0)).norm(), pow(10.0, -8.0));
+
+  // -- loose threshold uses fewer vectors --
+  RI cd1 = NewRI_Cholesky(gtos, method, pow(10.0, -3.0));
+  EXPECT_TRUE(cd1->num_aux() < cd->num_aux());
+
+  // -- RHF with Cholesky vectors (real basis) --
+  SymGTOs gtos_r = NewSymGTOs(mole);
+  VectorXcd zs_r(4); zs_r << 1.336, 2.013, 0.4538, 0.1233;
+  gtos_r->NewSub("H")
+    .AddNs(0,0,0)
+    .AddRds(Reduction(D2h->irrep_s(), MatrixXcd::Ones(2,1)))
+    .AddConts_Mono(zs_r);
+  gtos_r->NewSub("H")
+    .AddNs(0,0,1)
+    .AddRds(Reduction(D2h->irrep_s(), cp))
+    .AddConts_Mono(zs_r.head(2));
+  gtos_r->SetUp();
+  bool conv0, conv1;
+  double eps(pow(10.0, -8.0));
+  BMatSet mat_set = CalcMat_Complex(gtos_r, true);
+  MO mo0 = CalcRHF(D2h, mat_set, CalcERI_Complex(gtos_r, method), 2, 50, eps, &conv0);
+  MO mo1 = CalcRHF_RI(D2h, mat_set, NewRI_Cholesky(gtos_r, method, pow(10.0, -12.0)),
+		      method, 2, 50, eps, &conv1);
+  EXPECT_TRUE(conv0);
+  EXPECT_TRUE(conv1);
+  EXPECT_C_NEAR(mo0->energy, mo1->energy, pow(10.0, -8.0));
+  
+}
 TEST(HF, H2O) {
 
   /*
@@ -583,12 +945,13 @@ TEST(STEX, small) {
   // S orbital
   VectorXcd zeta_s(2); zeta_s << 0.1, 0.5;  
   gtos->NewSub("He")
-    .SolidSH_M(0, 0, zeta_s);
+    .SolidSH_M(0, 0).AddConts_Mono(zeta_s);
 
   // P orbital
   VectorXcd zeta_z(2); zeta_z << dcomplex(1.0, 0.1), dcomplex(3.0, 0.2);  
   gtos->NewSub("He")
-    .SolidSH_M(1, 0, zeta_z);
+    .SolidSH_M(1, 0).AddConts_Mono(zeta_z);
+  gtos->SetUp();
 
   // compute basic matrix
   BMatSet mat_set = CalcMat_Complex(gtos, true);
@@ -632,7 +995,7 @@ TEST(STEX, He) {
   VectorXcd zeta_s(10);
   zeta_s << 0.107951, 0.240920, 0.552610, 1.352436, 3.522261, 9.789053, 30.17990, 108.7723, 488.8941, 3293.694;  
   gtos->NewSub("He")
-    .SolidSH_M(0, 0, zeta_s);
+    .SolidSH_M(0, 0).AddConts_Mono(zeta_s);
 
   // P orbital
   int num_zeta(19);
@@ -658,7 +1021,7 @@ TEST(STEX, He) {
     16.9338400,
     30.0000000;
   gtos->NewSub("He")
-    .SolidSH_M(1, 0, zetas);
+    .SolidSH_M(1, 0).AddConts_Mono(zetas);
 
   // setup
   gtos->SetUp();
@@ -744,11 +1107,11 @@ TEST(STEX, He_one_gto) {
   VectorXcd zeta_s(10);
   zeta_s << 0.107951, 0.240920, 0.552610, 1.352436, 3.522261, 9.789053, 30.17990, 108.7723, 488.8941, 3293.694;
   gtos->NewSub("He")
-    .SolidSH_M(0, 0, zeta_s);
+    .SolidSH_M(0, 0).AddConts_Mono(zeta_s);
 
   // sub set (P orbital)
   VectorXcd zeta_z(1); zeta_z << z1;
-  gtos->NewSub("He").SolidSH_M(1, 0, zeta_z);
+  gtos->NewSub("He").SolidSH_M(1, 0).AddConts_Mono(zeta_z);
 
   gtos->SetUp();
 
@@ -816,14 +1179,14 @@ SymGTOs CreateGTOs_H2() {
   zetas << 1.336, 2.013, 0.4538, 0.1233, 0.0411, 0.0137;
   gtos->NewSub("H")
     .AddNs(0,0,0)
-    .AddZeta(zetas)
+    .AddConts_Mono(zetas)
     .AddRds(Reduction(sym->irrep_s(), MatrixXcd::Ones(2,1)));
 
   VectorXcd zeta_p(1); zeta_p << 1.1;
   MatrixXcd cp(2, 1); cp << 1, -1;
   gtos->NewSub("H")
     .AddNs(0,0,1)
-    .AddZeta(zeta_p)
+    .AddConts_Mono(zeta_p)
     .AddRds(Reduction(sym->irrep_s(), cp));
 
   VectorXcd zeta_cen(19);
@@ -848,7 +1211,7 @@ SymGTOs CreateGTOs_H2() {
     16.9338400,
     30.0000000;
   Vector3i Ms(3); Ms << -1, 0, 1;
-  gtos->NewSub("Cen").SolidSH_Ms(1, Ms, zeta_cen);
+  gtos->NewSub("Cen").SolidSH_Ms(1, Ms).AddConts_Mono(zeta_cen);
 
   gtos->SetUp();
   return gtos;
@@ -1,3 +1,4 @@
+#include <ctime>
 #include <gtest/gtest.h>
 #include "../utils/gtest_plus.hpp"
 #include "../utils/typedef.hpp"
@@ -664,6 +665,149 @@ TEST(MolFunc, IncGamma) {
 
   delete[] us;
 
+}
+TEST(MolFunc, IncGammaGrid) {
+
+  int max_m(16);
+  dcomplex* us = new dcomplex[max_m+1];
+  dcomplex* vs = new dcomplex[max_m+1];
+  
+  // -- accuracy. points on, between and outside of grid points --
+  dcomplex zs[] = {0.0, dcomplex(0.1, -0.2), dcomplex(0.4, 0.4), dcomplex(1.33, 0.71),
+		   dcomplex(5.05, -3.09), dcomplex(12.3, 7.7), dcomplex(19.9, -19.9),
+		   dcomplex(21.0, 15.5), dcomplex(50.0, -5.5)};
+  int nz(sizeof(zs)/sizeof(zs[0]));
+  for(int m = 0; m <= max_m; m += 4) 
+    for(int iz = 0; iz < nz; iz++) {
+      SetIncompleteGammaMethod(INC_GAMMA_SERIES);
+      IncompleteGamma(m, zs[iz], us);
+      SetIncompleteGammaMethod(INC_GAMMA_GRID);
+      IncompleteGamma(m, zs[iz], vs);
+      for(int j = 0; j <= m; j++) {
+	EXPECT_C_NEAR(us[j], vs[j], pow(10.0, -10.0) * abs(us[j]) + pow(10.0, -14.0))
+	  << "m=" << m << ", j=" << j << ", z=" << zs[iz];
+      }
+    }
+
+  // -- speed --
+  int num(20000);
+  clock_t t0 = clock();
+  SetIncompleteGammaMethod(INC_GAMMA_SERIES);
+  for(int i = 0; i < num; i++)
+    IncompleteGamma(8, dcomplex(0.001*i, 0.0005*i), us);
+  clock_t t1 = clock();
+  SetIncompleteGammaMethod(INC_GAMMA_GRID);
+  for(int i = 0; i < num; i++)
+    IncompleteGamma(8, dcomplex(0.001*i, 0.0005*i), vs);
+  clock_t t2 = clock();
+  SetIncompleteGammaMethod(INC_GAMMA_SERIES);
+  cout << "series: " << double(t1-t0)/CLOCKS_PER_SEC << " s" << endl;
+  cout << "grid:   " << double(t2-t1)/CLOCKS_PER_SEC << " s" << endl;
+  EXPECT_C_NEAR(us[8], vs[8], pow(10.0, -12.0));
+
+  delete[] us;
+  delete[] vs;
+  
+}
+TEST(MolFunc, IncGammaDownward) {
+
+  int max_m(16);
+  dcomplex* us = new dcomplex[max_m+1];
+  dcomplex* vs = new dcomplex[max_m+1];
+  dcomplex zs[] = {0.0, dcomplex(0.1, -0.2), dcomplex(1.33, 0.71), dcomplex(5.05, -3.09),
+		   dcomplex(12.3, 7.7), dcomplex(8.5, 15.5), dcomplex(30.0, -5.5)};
+  int nz(sizeof(zs)/sizeof(zs[0]));
+  for(int m = 0; m <= max_m; m += 4) 
+    for(int iz = 0; iz < nz; iz++) {
+      // -- F --
+      if(real(zs[iz]) < 21.0) {
+	SetIncompleteGammaMethod(INC_GAMMA_SERIES);
+	IncompleteGamma(m, zs[iz], us);
+	SetIncompleteGammaMethod(INC_GAMMA_DOWNWARD);
+	IncompleteGamma(m, zs[iz], vs);
+	for(int j = 0; j <= m; j++) {
+	  EXPECT_C_NEAR(us[j], vs[j], pow(10.0, -10.0) * abs(us[j]) + pow(10.0, -14.0))
+	    << "F: m=" << m << ", j=" << j << ", z=" << zs[iz];
+	}
+      }
+      // -- G --
+      SetIncompleteGammaMethod(INC_GAMMA_SERIES);
+      ExpIncompleteGamma(m, zs[iz], us);
+      SetIncompleteGammaMethod(INC_GAMMA_DOWNWARD);
+      ExpIncompleteGamma(m, zs[iz], vs);
+      for(int j = 0; j <= m; j++) {
+	EXPECT_C_NEAR(us[j], vs[j], pow(10.0, -10.0) * abs(us[j]) + pow(10.0, -14.0))
+	  << "G: m=" << m << ", j=" << j << ", z=" << zs[iz];
+      }
+    }
+  
+  // -- speed --
+  int num(2000);
+  clock_t t0 = clock();
+  SetIncompleteGammaMethod(INC_GAMMA_SERIES);
+  for(int i = 0; i < num; i++) {
+    IncompleteGamma(12, dcomplex(0.01*i, 0.005*i), us);
+    ExpIncompleteGamma(12, dcomplex(0.01*i, 0.005*i), us);
+  }
+  clock_t t1 = clock();
+  SetIncompleteGammaMethod(INC_GAMMA_DOWNWARD);
+  for(int i = 0; i < num; i++) {
+    IncompleteGamma(12, dcomplex(0.01*i, 0.005*i), vs);
+    ExpIncompleteGamma(12, dcomplex(0.01*i, 0.005*i), vs);
+  }
+  clock_t t2 = clock();
+  SetIncompleteGammaMethod(INC_GAMMA_SERIES);
+  cout << "series:   " << double(t1-t0)/CLOCKS_PER_SEC << " s" << endl;
+  cout << "downward: " << double(t2-t1)/CLOCKS_PER_SEC << " s" << endl;
+
+  delete[] us;
+  delete[] vs;
+  
+}
+TEST(MolFunc, IncGammaBatch) {
+
+  int max_m(10);
+  dcomplex zs[] = {0.0, dcomplex(0.1, -0.2), dcomplex(1.33, 0.71), dcomplex(5.05, -3.09),
+		   dcomplex(12.3, 7.7), dcomplex(20.5, 15.5), dcomplex(30.0, -5.5),
+		   dcomplex(0.3, 25.0), dcomplex(-0.5, 0.2), dcomplex(-7.1, -3.3)};
+  int nz(sizeof(zs)/sizeof(zs[0]));
+  dcomplex* us = new dcomplex[max_m+1];
+  dcomplex* vs = new dcomplex[nz*(max_m+1)];
+
+  // -- compare with one by one evaluation. --
+  // -- F2 loses digits near (20, 15) so that summation order matters there. --
+  IncompleteGammaBatch(max_m, zs, nz, vs);
+  for(int iz = 0; iz < nz; iz++) {
+    if(real(zs[iz]) > 0.0 || zs[iz] == 0.0)
+      IncompleteGamma(max_m, zs[iz], us);
+    else
+      ExpIncompleteGamma(max_m, -zs[iz], us);
+    for(int m = 0; m <= max_m; m++) {
+      EXPECT_C_NEAR(us[m], vs[iz*(max_m+1)+m], pow(10.0, -8.0) * abs(us[m]))
+	<< "m=" << m << ", z=" << zs[iz];
+    }
+  }
+  delete[] vs;
+  
+  // -- speed --
+  int num(20000);
+  dcomplex* ts = new dcomplex[num];
+  for(int i = 0; i < num; i++)
+    ts[i] = dcomplex(0.001*i, 0.0005*i);
+  vs = new dcomplex[num*(max_m+1)];
+  clock_t t0 = clock();
+  for(int i = 0; i < num; i++)
+    IncompleteGamma(max_m, ts[i], us);
+  clock_t t1 = clock();
+  IncompleteGammaBatch(max_m, ts, num, vs);
+  clock_t t2 = clock();
+  cout << "one by one: " << double(t1-t0)/CLOCKS_PER_SEC << " s" << endl;
+  cout << "batch:      " << double(t2-t1)/CLOCKS_PER_SEC << " s" << endl;
+
+  delete[] ts;
+  delete[] us;
+  delete[] vs;
+  
 }
 TEST(MolFunc, ExpIncGamma) {
 
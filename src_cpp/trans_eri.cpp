@@ -4,36 +4,29 @@ using namespace Eigen;
 
 namespace cbasis {
 
-  void TransformERI_Slow(IB2EInt* ao, MO mo, IB2EInt* res) {
-    
-    /**
-       Transform AO basis to MO basis for ERI
-     */
-
-    res->Init(ao->size());
-
-    BMat& C = mo->C;
-
-    int ib,jb,kb,lb,i,j,k,l,t;
-    dcomplex v;
-
-    // ==== set zero =====
-    ao->Reset();
-    while(ao->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) { 
-      res->Set(ib,jb,kb,lb,i,j,k,l,0.0);
-    }
-    
-    // ==== calculate ====
-    ao->Reset();
-    while(ao->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) { 
-      MatrixXcd& Ci = C[make_pair(ib, ib)]; 
-      MatrixXcd& Cj = C[make_pair(jb, jb)];
-      MatrixXcd& Ck = C[make_pair(kb, kb)];
-      MatrixXcd& Cl = C[make_pair(lb, lb)];
-      int ni(Ci.rows());
-      int nj(Cj.rows());
-      int nk(Ck.rows());
-      int nl(Cl.rows());
+  struct ERI_MO {
+    /*
+      Visitor for VisitERI. Adds C_ii' C_jj' C_kk' C_ll' (ij|kl) to
+      (i'j'|k'l') in dense blocks so that Ref is O(1). C[irrep] is the
+      coefficient block of irrep, read only by all threads.
+    */
+    vector<const MatrixXcd*> C;
+    B2EIntBlock acc;
+    ERI_MO(const vector<const MatrixXcd*>& _C, const vector<int>& num_mo):
+      C(_C), acc(num_mo) {}
+    void operator()(const int* x, dcomplex v) {
+      int ib(x[0]), jb(x[1]), kb(x[2]), lb(x[3]), i(x[4]), j(x[5]), k(x[6]), l(x[7]);
+      int n(C.size());
+      if(ib >= n || jb >= n || kb >= n || lb >= n)
+	return;
+      const MatrixXcd& Ci = *C[ib];
+      const MatrixXcd& Cj = *C[jb];
+      const MatrixXcd& Ck = *C[kb];
+      const MatrixXcd& Cl = *C[lb];
+      int ni(Ci.cols());
+      int nj(Cj.cols());
+      int nk(Ck.cols());
+      int nl(Cl.cols());
       // ii,jj,kk,ll are index for MO.
       for(int ii = 0; ii < ni; ii++)
 	for(int jj = 0; jj < nj; jj++)
@@ -43,9 +36,44 @@ namespace cbasis {
 			    Cj(j, jj) *
 			    Ck(k, kk) *
 			    Cl(l, ll));
-	      res->At(ib, jb, kb, lb, ii, jj, kk, ll) += c * v;
+	      acc.Ref(ib, jb, kb, lb, ii, jj, kk, ll) += c * v;
 	    }
     }
+    void Merge(ERI_MO& o) {
+      ERIChunk c;
+      for(int n = 0; n < o.acc.num_chunk(); n++) {
+	o.acc.GetChunk(n, &c);
+	for(int e = 0; e < c.num; e++)
+	  acc.Ref(c.ib[e], c.jb[e], c.kb[e], c.lb[e],
+		  c.i[e], c.j[e], c.k[e], c.l[e]) += c.value(e);
+      }
+    }
+  };
+  void TransformERI_Slow(IB2EInt* ao, MO mo, IB2EInt* res) {
+    
+    /**
+       Transform AO basis to MO basis for ERI
+     */
+
+    BMat& C = mo->C;
+
+    // ==== number of MO for each irrep =====
+    int n_irrep(C.size());
+    vector<int> num_mo(n_irrep);
+    vector<const MatrixXcd*> Cs(n_irrep);
+    for(int irrep = 0; irrep < n_irrep; irrep++) {
+      Cs[irrep] = &C[make_pair(irrep, irrep)];
+      num_mo[irrep] = Cs[irrep]->cols();
+    }
+    
+    // ==== calculate ====
+    ERI_MO f(Cs, num_mo);
+    VisitERI(ao, f);
+
+    // ==== copy to res =====
+    res->Init(f.acc.size());
+    vector<IB2EInt*> src(1, &f.acc);
+    res->Append(src, 1);
 
   }
   void TransformERI(IB2EInt* ao, MO mo, IB2EInt* res) {
@@ -88,21 +116,7 @@ namespace cbasis {
     VectorXcd cA0 = C[make_pair(A0, A0)].col(a0);
     VectorXcd cB0 = C[make_pair(B0, B0)].col(b0);
 
-    int ib,jb,kb,lb,i,j,k,l,t;
-    dcomplex v;
-    eri_ao->Reset();
-    while(eri_ao->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
-
-      if(ib == jb && kb == A0 && lb == B0) {
-	pair<Irrep, Irrep> AB(ib, jb);
-	(*bmat)[AB](i, j) += cJ * cA0(k) * cB0(l) * v;
-      }
-
-      if(ib == lb && jb == B0 && kb == A0) {
-	pair<Irrep, Irrep> AB(ib, lb);
-	(*bmat)[AB](i, l) += cK * cA0(k) * cB0(j) * v;
-      }
-    }
+    AddJK_Orb(eri_ao, A0, cA0, B0, cB0, cJ, cK, *bmat);
 
     for(BMat::iterator it = bmat->begin(); it != bmat->end(); ++it) {
       MatrixXcd HA = it->second; // AO basis
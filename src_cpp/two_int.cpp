@@ -1,9 +1,15 @@
 #include <iostream>
 #include <stdexcept>
+#include <cfloat>
+#include <Eigen/Eigenvalues>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "../utils/typedef.hpp"
 #include "two_int.hpp"
 
 using namespace std;
+using namespace Eigen;
 
 namespace cbasis {
 
@@ -103,16 +109,15 @@ namespace cbasis {
 	}
 
   }
-  MultArray<dcomplex, 4> coef_R_map_val(1000);
-  MultArray<bool,     4> coef_R_map_has(1000);
   dcomplex coef_R_with_memo(dcomplex zetaP,
 			    dcomplex wPx, dcomplex wPy, dcomplex wPz,
 			    dcomplex cx,  dcomplex cy,  dcomplex cz,
-			    int mx, int my, int mz, int j, dcomplex* Fjs) {
+			    int mx, int my, int mz, int j, dcomplex* Fjs,
+			    A4dc& map_val, MultArray<bool, 4>& map_has) {
     /* Compute function coef_R with memorize;     */
 
-    dcomplex& ref = coef_R_map_val(mx, my, mz, j);
-    bool& has = coef_R_map_has(mx, my, mz, j);
+    dcomplex& ref = map_val(mx, my, mz, j);
+    bool& has = map_has(mx, my, mz, j);
     if(has) 
       return ref;
 
@@ -126,9 +131,9 @@ namespace cbasis {
       ref = 0.0;
       if(mx > 1) 
 	ref += (mx-1.0) * coef_R_with_memo(zetaP, wPx, wPy, wPz, cx, cy, cz,
-					    mx-2, my, mz, j+1, Fjs);
+					    mx-2, my, mz, j+1, Fjs, map_val, map_has);
       ref += (wPx-cx) * coef_R_with_memo(zetaP, wPx, wPy, wPz, cx, cy, cz,
-					  mx-1, my, mz, j+1, Fjs);
+					  mx-1, my, mz, j+1, Fjs, map_val, map_has);
       has = true;
       return ref;
     }
@@ -136,9 +141,9 @@ namespace cbasis {
       ref = 0.0;
       if(my > 1) 
 	ref += (my-1.0) * coef_R_with_memo(zetaP, wPx, wPy, wPz, cx, cy, cz,
-					    mx, my-2, mz, j+1, Fjs);
+					    mx, my-2, mz, j+1, Fjs, map_val, map_has);
       ref += (wPy-cy) *   coef_R_with_memo(zetaP, wPx, wPy, wPz, cx, cy, cz,
-					    mx, my-1, mz, j+1, Fjs);
+					    mx, my-1, mz, j+1, Fjs, map_val, map_has);
       has = true;
       return ref;
     }
@@ -146,9 +151,9 @@ namespace cbasis {
       ref = 0.0;
       if(mz > 1) 
 	ref += (mz-1.0) * coef_R_with_memo(zetaP, wPx, wPy, wPz, cx, cy, cz,
-					    mx, my, mz-2, j+1, Fjs);
+					    mx, my, mz-2, j+1, Fjs, map_val, map_has);
       ref += (wPz-cz) *   coef_R_with_memo(zetaP, wPx, wPy, wPz, cx, cy, cz,
-					    mx, my, mz-1, j+1, Fjs);
+					    mx, my, mz-1, j+1, Fjs, map_val, map_has);
       has = true;
       return ref;
     }
@@ -163,12 +168,13 @@ namespace cbasis {
   void calc_R_coef_eri1(dcomplex zarg,
 			dcomplex wPx, dcomplex wPy, dcomplex wPz,
 			dcomplex wPpx,dcomplex wPpy,dcomplex wPpz,
-			int max_n, dcomplex *Fjs, dcomplex mult_coef, A3dc& res) {
+			int max_n, dcomplex *Fjs, dcomplex mult_coef, A3dc& res,
+			A4dc& map_val, MultArray<bool, 4>& map_has) {
 
-    coef_R_map_val.SetRange(0, max_n, 0, max_n, 0, max_n, 0, max_n);
-    coef_R_map_has.SetRange(0, max_n, 0, max_n, 0, max_n, 0, max_n);
+    map_val.SetRange(0, max_n, 0, max_n, 0, max_n, 0, max_n);
+    map_has.SetRange(0, max_n, 0, max_n, 0, max_n, 0, max_n);
 
-    coef_R_map_has.SetValue(false);
+    map_has.SetValue(false);
       
     for(int nx = 0; nx <= max_n; nx++)
       for(int ny = 0; ny <= max_n; ny++)
@@ -177,29 +183,91 @@ namespace cbasis {
 	    dcomplex v = coef_R_with_memo(zarg,
 					  wPx, wPy, wPz,
 					  wPpx, wPpy, wPpz,
-					  nx, ny, nz, 0, Fjs);
+					  nx, ny, nz, 0, Fjs, map_val, map_has);
 	    res(nx, ny, nz) = mult_coef * v;
 	  }
 	}
   }
+  void calc_R_coef_eri2(dcomplex zarg,
+			dcomplex wPx, dcomplex wPy, dcomplex wPz,
+			dcomplex wPpx,dcomplex wPpy,dcomplex wPpz,
+			int max_n, dcomplex *Fjs, dcomplex mult_coef, A3dc& res,
+			vector<dcomplex>& tab) {
+    /*
+      Non recursive version of calc_R_coef_eri1.
+      R_{tuv}^{(j)} with t+u+v <= max_n-j is filled from j=max_n down to
+      j=0. Only the layers j and j+1 are kept in tab.
+    */
+    int n1(max_n + 1);
+    int n3(n1 * n1 * n1);
+    if((int)tab.size() < 2 * n3)
+      tab.resize(2 * n3);
+    dcomplex X(wPx - wPpx), Y(wPy - wPpy), Z(wPz - wPpz);
+    dcomplex* cur(NULL);
+    for(int j = max_n; j >= 0; j--) {
+      cur = &tab[(j % 2) * n3];
+      dcomplex* nxt = &tab[((j + 1) % 2) * n3];
+      int L(max_n - j);
+      for(int t = 0; t <= L; t++)
+      for(int u = 0; u <= L - t; u++)
+      for(int v = 0; v <= L - t - u; v++) {
+	int idx((t * n1 + u) * n1 + v);
+	dcomplex& ref(cur[idx]);
+	if(t > 0) {
+	  ref = X * nxt[idx - n1 * n1];
+	  if(t > 1)
+	    ref += (t - 1.0) * nxt[idx - 2 * n1 * n1];
+	} else if(u > 0) {
+	  ref = Y * nxt[idx - n1];
+	  if(u > 1)
+	    ref += (u - 1.0) * nxt[idx - 2 * n1];
+	} else if(v > 0) {
+	  ref = Z * nxt[idx - 1];
+	  if(v > 1)
+	    ref += (v - 1.0) * nxt[idx - 2];
+	} else {
+	  ref = pow(-2.0 * zarg, j) * Fjs[j];
+	}
+      }
+    }
+    for(int nx = 0; nx <= max_n; nx++)
+      for(int ny = 0; ny <= max_n - nx; ny++)
+	for(int nz = 0; nz <= max_n - nx - ny; nz++) 
+	  res(nx, ny, nz) = mult_coef * cur[(nx * n1 + ny) * n1 + nz];
+  }
   void coef_R_eri_switch(dcomplex zarg,
 			 dcomplex wPx, dcomplex wPy, dcomplex wPz,
 			 dcomplex wPpx,dcomplex wPpy,dcomplex wPpz,
 			 int max_n, dcomplex *Fjs, dcomplex mult_coef, A3dc& res,
-			 ERIMethod method) {
+			 ERIMethod method, A4dc& map_val, MultArray<bool, 4>& map_has,
+			 vector<dcomplex>& tab) {
 
     res.SetRange(0, max_n, 0, max_n, 0, max_n);
 
-
     if(method.coef_R_memo == 0) {
       calc_R_coef_eri0(zarg, wPx, wPy, wPz,
 		       wPpx, wPpy, wPpz, max_n, Fjs, mult_coef, res);
-    } else { 
+    } else if(method.coef_R_memo == 1) { 
       calc_R_coef_eri1(zarg, wPx, wPy, wPz,
-		       wPpx, wPpy, wPpz, max_n, Fjs, mult_coef, res);
+		       wPpx, wPpy, wPpz, max_n, Fjs, mult_coef, res,
+		       map_val, map_has);
+    } else {
+      calc_R_coef_eri2(zarg, wPx, wPy, wPz,
+		       wPpx, wPpy, wPpz, max_n, Fjs, mult_coef, res, tab);
     }
 
   }
+  void coef_R_eri_switch(dcomplex zarg,
+			 dcomplex wPx, dcomplex wPy, dcomplex wPz,
+			 dcomplex wPpx,dcomplex wPpy,dcomplex wPpz,
+			 int max_n, dcomplex *Fjs, dcomplex mult_coef, A3dc& res,
+			 ERIMethod method) {
+    A4dc map_val(1000);
+    MultArray<bool, 4> map_has(1000);
+    vector<dcomplex> tab;
+    coef_R_eri_switch(zarg, wPx, wPy, wPz, wPpx, wPpy, wPpz, max_n, Fjs,
+		      mult_coef, res, method, map_val, map_has, tab);
+  }
 
   // ==== SymGTOs ====
   bool ExistNon0(SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub) {
@@ -216,66 +284,158 @@ namespace cbasis {
   }
 
   struct ERI_buf {
-    A3dc dx, dy, dz, dxp, dyp, dzp;
     A1dc Fjs;
     A3dc Rrs;
+    A4dc R_val;              // memo table for coef_R_memo=1
+    MultArray<bool, 4> R_has;
+    vector<dcomplex> R_tab;  // work space for coef_R_memo=2
+    vector<dcomplex> Gms;    // F_m(T) times prefactor for kernel=1
+    vector<dcomplex> vrr, hrr_bra, hrr_ket; // work space for kernel=1
+    vector<dcomplex> rys_mom, rys_u, rys_w;  // moments, roots and weights for kernel=2
+    vector<dcomplex> rys_2d, rys_hrr, rys_I; // 2D integrals for kernel=2
+    vector<dcomplex> T_batch, F_batch; // arguments and F_m(T) of atom quartets
+    vector<int> q_batch;     // index in T_batch of atom quartets (-1: not computed)
+    IncGammaWork gamma_work; // work space of CalcBoysBatch
+    const dcomplex* Fjs_pre; // F_m(T) of current atom quartet in F_batch (or NULL)
     //    dcomplex eij, ekl, lambda;
     dcomplex lambda;
     ERI_buf(int n) :
-      dx(n), dy(n), dz(n), dxp(n), dyp(n), dzp(n), Fjs(n), Rrs(n) {}
+      Fjs(n), Rrs(n), R_val(n), R_has(n), Fjs_pre(NULL) {
+      Fjs.SetRange(0, n-1);
+    }
   };
-  void CalcCoef(dcomplex xi, dcomplex yi, dcomplex zi,
-	       int mi, dcomplex zetai,
-	       dcomplex xj, dcomplex yj, dcomplex zj,
-	       int mj, dcomplex& zetaj,
-	       dcomplex xk, dcomplex yk, dcomplex zk,
-	       int mk, dcomplex& zetak,
-	       dcomplex xl, dcomplex yl, dcomplex zl,
-		int ml, dcomplex zetal, ERI_buf& buf, ERIMethod method) {
-    dcomplex zetaP = zetai + zetaj;
-    dcomplex zetaPp= zetak + zetal;
-    dcomplex wPx((zetai*xi + zetaj*xj)/zetaP);
-    dcomplex wPy((zetai*yi + zetaj*yj)/zetaP);
-    dcomplex wPz((zetai*zi + zetaj*zj)/zetaP);
-    
-    calc_d_coef(mi, mj, mi+mj, zetaP,  wPx,  xi, xj, buf.dx);
-    calc_d_coef(mi, mj, mi+mj, zetaP,  wPy,  yi, yj, buf.dy);
-    calc_d_coef(mi, mj, mi+mj, zetaP,  wPz,  zi, zj, buf.dz);
 
-    dcomplex wPpx((zetak*xk + zetal*xl)/zetaPp);
-    dcomplex wPpy((zetak*yk + zetal*yl)/zetaPp);
-    dcomplex wPpz((zetak*zk + zetal*zl)/zetaPp);
-    
-    calc_d_coef(mk, ml, mk+ml, zetaPp, wPpx, xk, xl, buf.dxp);
-    calc_d_coef(mk, ml, mk+ml, zetaPp, wPpy, yk, yl, buf.dyp);
-    calc_d_coef(mk, ml, mk+ml, zetaPp, wPpz, zk, zl, buf.dzp);
+  // ==== Shell pair ====
+  struct ShellPair {
+    /* data of primitive pair (ij) used by all (ij|kl) */
+    dcomplex zetaP;
+    dcomplex wPx, wPy, wPz;
+    dcomplex arg;     // -zeta_i zeta_j / zetaP |r_i-r_j|^2
+    A3dc dx, dy, dz;  // Hermite expansion coefficients
+    ShellPair(): dx(1), dy(1), dz(1) {}
+  };
+  void CalcShellPair(dcomplex xi, dcomplex yi, dcomplex zi, int mi, dcomplex zetai,
+		     dcomplex xj, dcomplex yj, dcomplex zj, int mj, dcomplex zetaj,
+		     ShellPair& p) {
+    p.zetaP = zetai + zetaj;
+    p.wPx = (zetai*xi + zetaj*xj)/p.zetaP;
+    p.wPy = (zetai*yi + zetaj*yj)/p.zetaP;
+    p.wPz = (zetai*zi + zetaj*zj)/p.zetaP;
+    p.arg = -zetai * zetaj / p.zetaP * dist2(xi-xj, yi-yj, zi-zj);
+    calc_d_coef(mi, mj, mi+mj, p.zetaP, p.wPx, xi, xj, p.dx);
+    calc_d_coef(mi, mj, mi+mj, p.zetaP, p.wPy, yi, yj, p.dy);
+    calc_d_coef(mi, mj, mi+mj, p.zetaP, p.wPz, zi, zj, p.dz);
+  }
+  class ShellPairSet {
+    /*
+      ShellPair for all (icont, icz, jcont, jcz, iat, jat) of one sub
+      shell pair. Build skips the calculation when called again with
+      the same pair, so one bra set is shared by all ket sub pairs.
+      The pair is identified by SubSymGTOs::setup_id, which changes in
+      each SetUp, so that a sub set up again is never taken from cache.
+    */
+  private:
+    int iid_, jid_; // setup_id of cached pair
+    vector<int> iz0_, jz0_; // first zeta index of each contraction
+    int nzj_, nati_, natj_, num_;
+    vector<ShellPair*> pairs_;
+    ShellPairSet(const ShellPairSet&);
+    ShellPairSet& operator=(const ShellPairSet&);
+  public:
+    ShellPairSet(): iid_(0), jid_(0), num_(0) {}
+    ~ShellPairSet() {
+      for(int n = 0; n < (int)pairs_.size(); n++)
+	delete pairs_[n];
+    }
+    void Build(SubIt isub, SubIt jsub) {
+      if(isub->setup_id != 0 && isub->setup_id == iid_ && jsub->setup_id == jid_)
+	return;
+      iid_ = isub->setup_id; jid_ = jsub->setup_id;
+      iz0_.resize(isub->size_cont());
+      jz0_.resize(jsub->size_cont());
+      int nzi(0), nzj(0);
+      for(int icont = 0; icont < isub->size_cont(); icont++) {
+	iz0_[icont] = nzi; nzi += isub->size_cz(icont);
+      }
+      for(int jcont = 0; jcont < jsub->size_cont(); jcont++) {
+	jz0_[jcont] = nzj; nzj += jsub->size_cz(jcont);
+      }
+      nzj_ = nzj; nati_ = isub->size_at(); natj_ = jsub->size_at();
+      num_ = nzi * nzj * nati_ * natj_;
+      while((int)pairs_.size() < num_)
+	pairs_.push_back(new ShellPair());
+
+      for(int icont = 0; icont < isub->size_cont(); icont++)
+      for(int icz = 0; icz < isub->size_cz(icont); icz++)
+      for(int jcont = 0; jcont < jsub->size_cont(); jcont++)
+      for(int jcz = 0; jcz < jsub->size_cz(jcont); jcz++)
+      for(int iat = 0; iat < nati_; iat++)
+      for(int jat = 0; jat < natj_; jat++) {
+	CalcShellPair(isub->x(iat), isub->y(iat), isub->z(iat), isub->maxn,
+		      isub->zeta(icont, icz),
+		      jsub->x(jat), jsub->y(jat), jsub->z(jat), jsub->maxn,
+		      jsub->zeta(jcont, jcz),
+		      (*this)(iz(icont, icz), jz(jcont, jcz), iat, jat));
+      }
+    }
+    inline int iz(int icont, int icz) const { return iz0_[icont] + icz; }
+    inline int jz(int jcont, int jcz) const { return jz0_[jcont] + jcz; }
+    inline ShellPair& operator()(int iz, int jz, int iat, int jat) {
+      return *pairs_[((iz * nzj_ + jz) * nati_ + iat) * natj_ + jat];
+    }
+  };
+  
+  // ==== Boys function ====
+  inline dcomplex BoysArg(ShellPair& ij, ShellPair& kl) {
+    dcomplex zarg(ij.zetaP * kl.zetaP / (ij.zetaP + kl.zetaP));
+    return zarg * dist2(ij.wPx-kl.wPx, ij.wPy-kl.wPy, ij.wPz-kl.wPz);
+  }
+  inline int BoysOrder(int mm, ERIMethod method) {
+    /* max order of F_m(T) used by the kernel. Rys uses 2*nroot moments. */
+    return method.kernel == 2 ? 2*(mm/2)+1 : mm;
+  }
+  void CalcBoys(int M, dcomplex T, ERI_buf& buf, dcomplex* res) {
+    /* F_m(T) (or G_m(-T) for Re[T]<0). batch result is used if exists. */
+    if(buf.Fjs_pre != NULL) {
+      copy(buf.Fjs_pre, buf.Fjs_pre + M + 1, res);
+      return;
+    }
+    double delta(0.0000000000001);
+    if(real(T)+delta > 0.0)
+      IncompleteGamma(M, T, res);
+    else
+      ExpIncompleteGamma(M, -T, res);
+  }
+  void CalcBoysBatch(int nq, int M, ERI_buf& buf) {
+    /* F_m of buf.T_batch[0..nq-1] to buf.F_batch. */
+    if(nq == 0)
+      return;
+    buf.F_batch.resize(nq * (M + 1));
+    IncompleteGammaBatch(M, &buf.T_batch[0], nq, &buf.F_batch[0], buf.gamma_work);
+  }
+  
+  void CalcCoef(ShellPair& ij, ShellPair& kl, int mm, ERI_buf& buf, ERIMethod method) {
 
-    dcomplex zarg(zetaP * zetaPp / (zetaP + zetaPp));
-    dcomplex argIncGamma(zarg * dist2(wPx-wPpx, wPy-wPpy, wPz-wPpz));
+    dcomplex zarg(ij.zetaP * kl.zetaP / (ij.zetaP + kl.zetaP));
+    dcomplex argIncGamma(zarg * dist2(ij.wPx-kl.wPx, ij.wPy-kl.wPy, ij.wPz-kl.wPz));
     double delta(0.0000000000001);
+    CalcBoys(mm, argIncGamma, buf, &buf.Fjs(0));
     if(real(argIncGamma)+delta > 0.0) {
-      IncompleteGamma(mi+mj+mk+ml, argIncGamma, &buf.Fjs(0));      
-      int mm = mi + mj + mk + ml;
-      dcomplex eij = exp(-zetai * zetaj / zetaP *  dist2(xi-xj, yi-yj, zi-zj));
-      dcomplex ekl = (exp(-zetak * zetal / zetaPp * dist2(xk-xl, yk-yl, zk-zl)));
-      coef_R_eri_switch(zarg, wPx, wPy, wPz, wPpx, wPpy, wPpz, mm,
-			&buf.Fjs(0), eij * ekl, buf.Rrs, method);
+      coef_R_eri_switch(zarg, ij.wPx, ij.wPy, ij.wPz, kl.wPx, kl.wPy, kl.wPz, mm,
+			&buf.Fjs(0), exp(ij.arg + kl.arg), buf.Rrs, method,
+			buf.R_val, buf.R_has, buf.R_tab);
     } else {      
-      int mm = mi + mj + mk + ml;
-      ExpIncompleteGamma(mm, -argIncGamma, &buf.Fjs(0)); 
-      dcomplex arg_other = 
-	-zetai * zetaj / zetaP *  dist2(xi-xj, yi-yj, zi-zj)
-	-zetak * zetal / zetaPp * dist2(xk-xl, yk-yl, zk-zl)
-	-argIncGamma;
-      coef_R_eri_switch(zarg, wPx, wPy, wPz, wPpx, wPpy, wPpz, mm,
-			&buf.Fjs(0), exp(arg_other), buf.Rrs, method);
+      coef_R_eri_switch(zarg, ij.wPx, ij.wPy, ij.wPz, kl.wPx, kl.wPy, kl.wPz, mm,
+			&buf.Fjs(0), exp(ij.arg + kl.arg - argIncGamma), buf.Rrs, method,
+			buf.R_val, buf.R_has, buf.R_tab);
     }
 
   }
   dcomplex CalcPrimOne(int nxi, int nyi, int nzi,
 		   int nxj, int nyj, int nzj,
 		   int nxk, int nyk, int nzk,
-		   int nxl, int nyl, int nzl, ERI_buf& buf) {
+		   int nxl, int nyl, int nzl,
+		   ShellPair& ij, ShellPair& kl, ERI_buf& buf) {
     dcomplex cumsum(0);
     for(int Nx  = 0; Nx  <= nxi + nxj; Nx++)
       for(int Nxp = 0; Nxp <= nxk + nxl; Nxp++)
@@ -285,14 +445,509 @@ namespace cbasis {
 	      for(int Nzp = 0; Nzp <= nzk + nzl; Nzp++) {
 		dcomplex r0;
 		r0 = buf.Rrs(Nx+Nxp, Ny+Nyp, Nz+Nzp);
-		cumsum += (buf.dx(nxi, nxj, Nx) * buf.dxp(nxk, nxl, Nxp) *
-			   buf.dy(nyi, nyj, Ny) * buf.dyp(nyk, nyl, Nyp) *
-			   buf.dz(nzi, nzj, Nz) * buf.dzp(nzk, nzl, Nzp) *
+		cumsum += (ij.dx(nxi, nxj, Nx) * kl.dx(nxk, nxl, Nxp) *
+			   ij.dy(nyi, nyj, Ny) * kl.dy(nyk, nyl, Nyp) *
+			   ij.dz(nzi, nzj, Nz) * kl.dz(nzk, nzl, Nzp) *
 			   r0 * pow(-1.0, Nxp+Nyp+Nzp));
 	      }
     return buf.lambda * cumsum;;
 	
   }
+  // ==== Specialized McMurchie-Davidson kernel for low angular momentum ====
+  // -- e(t) = sum_{N+N'=t} d(N) d'(N') (-1)^N' for N<=A, N'<=B. --
+  template<int A, int B>
+  inline void HermiteConv(const dcomplex* d, const dcomplex* dp, dcomplex* e) {
+    for(int t = 0; t <= A + B; t++)
+      e[t] = 0.0;
+    for(int n = 0; n <= A; n++)
+      for(int np = 0; np <= B; np++) {
+	if(np % 2 == 0)
+	  e[n + np] += d[n] * dp[np];
+	else
+	  e[n + np] -= d[n] * dp[np];
+      }
+  }
+  typedef void (*HermiteConvFunc)(const dcomplex*, const dcomplex*, dcomplex*);
+  static const int MAX_LOW_N = 2; // d orbital
+#define HERMITE_CONV_ROW(A) \
+  {&HermiteConv<A,0>, &HermiteConv<A,1>, &HermiteConv<A,2>, &HermiteConv<A,3>, &HermiteConv<A,4>}
+  static const HermiteConvFunc hermite_conv_table[2*MAX_LOW_N+1][2*MAX_LOW_N+1] = {
+    HERMITE_CONV_ROW(0), HERMITE_CONV_ROW(1), HERMITE_CONV_ROW(2),
+    HERMITE_CONV_ROW(3), HERMITE_CONV_ROW(4)};
+#undef HERMITE_CONV_ROW
+  // -- sum_{tx,ty,tz} ex(tx) ey(ty) ez(tz) R(tx,ty,tz) --
+  template<int TX, int TY, int TZ>
+  inline dcomplex HermiteSum(const dcomplex* ex, const dcomplex* ey, const dcomplex* ez,
+			     const dcomplex* R, int sx, int sy) {
+    dcomplex cumsum(0);
+    for(int tx = 0; tx <= TX; tx++)
+      for(int ty = 0; ty <= TY; ty++) {
+	dcomplex exy(ex[tx] * ey[ty]);
+	const dcomplex* Rxy = R + tx * sx + ty * sy;
+	for(int tz = 0; tz <= TZ; tz++)
+	  cumsum += exy * ez[tz] * Rxy[tz];
+      }
+    return cumsum;
+  }
+  typedef dcomplex (*HermiteSumFunc)(const dcomplex*, const dcomplex*, const dcomplex*,
+				     const dcomplex*, int, int);
+  static const int MAX_LOW_T = 4; // (pp|pp)
+#define HERMITE_SUM_ROW(X, Y) \
+  {&HermiteSum<X,Y,0>, &HermiteSum<X,Y,1>, &HermiteSum<X,Y,2>, \
+   &HermiteSum<X,Y,3>, &HermiteSum<X,Y,4>}
+#define HERMITE_SUM_BLOCK(X) \
+  {HERMITE_SUM_ROW(X,0), HERMITE_SUM_ROW(X,1), HERMITE_SUM_ROW(X,2), \
+   HERMITE_SUM_ROW(X,3), HERMITE_SUM_ROW(X,4)}
+  static const HermiteSumFunc hermite_sum_table[MAX_LOW_T+1][MAX_LOW_T+1][MAX_LOW_T+1] = {
+    HERMITE_SUM_BLOCK(0), HERMITE_SUM_BLOCK(1), HERMITE_SUM_BLOCK(2),
+    HERMITE_SUM_BLOCK(3), HERMITE_SUM_BLOCK(4)};
+#undef HERMITE_SUM_ROW
+#undef HERMITE_SUM_BLOCK
+  inline bool UseLowKernel(int mi, int mj, int mk, int ml) {
+    return (mi <= MAX_LOW_N && mj <= MAX_LOW_N && mk <= MAX_LOW_N && ml <= MAX_LOW_N);
+  }
+  dcomplex CalcPrimOneLow(int nxi, int nyi, int nzi,
+			  int nxj, int nyj, int nzj,
+			  int nxk, int nyk, int nzk,
+			  int nxl, int nyl, int nzl,
+			  ShellPair& ij, ShellPair& kl, ERI_buf& buf) {
+    /*
+      Same as CalcPrimOne for angular numbers <= MAX_LOW_N. Hermite sums
+      are done by the template kernels above with raw pointers.
+    */
+    dcomplex ex[2*(2*MAX_LOW_N)+1], ey[2*(2*MAX_LOW_N)+1], ez[2*(2*MAX_LOW_N)+1];
+    int Ax(nxi+nxj), Bx(nxk+nxl), Ay(nyi+nyj), By(nyk+nyl), Az(nzi+nzj), Bz(nzk+nzl);
+    hermite_conv_table[Ax][Bx](&ij.dx(nxi, nxj, 0), &kl.dx(nxk, nxl, 0), ex);
+    hermite_conv_table[Ay][By](&ij.dy(nyi, nyj, 0), &kl.dy(nyk, nyl, 0), ey);
+    hermite_conv_table[Az][Bz](&ij.dz(nzi, nzj, 0), &kl.dz(nzk, nzl, 0), ez);
+
+    int TX(Ax+Bx), TY(Ay+By), TZ(Az+Bz);
+    A3dc& Rrs(buf.Rrs);
+    int sy(Rrs.n1_[2] - Rrs.n0_[2] + 1);
+    int sx(sy * (Rrs.n1_[1] - Rrs.n0_[1] + 1));
+    const dcomplex* R = &Rrs(0, 0, 0);
+    dcomplex cumsum;
+    if(TX <= MAX_LOW_T && TY <= MAX_LOW_T && TZ <= MAX_LOW_T) {
+      cumsum = hermite_sum_table[TX][TY][TZ](ex, ey, ez, R, sx, sy);
+    } else {
+      cumsum = 0.0;
+      for(int tx = 0; tx <= TX; tx++)
+	for(int ty = 0; ty <= TY; ty++)
+	  for(int tz = 0; tz <= TZ; tz++)
+	    cumsum += ex[tx] * ey[ty] * ez[tz] * R[tx * sx + ty * sy + tz];
+    }
+    return buf.lambda * cumsum;
+  }
+  // ==== Head-Gordon-Pople kernel ====
+  // -- index of cartesian (x,y,z) in the list of all (x,y,z) with x+y+z<=L. --
+  inline int CartIdx(int x, int y, int z) {
+    int n(x + y + z);
+    return n*(n+1)*(n+2)/6 + (n-x)*(n-x+1)/2 + z;
+  }
+  inline int NumCart(int L) { return (L+1)*(L+2)*(L+3)/6; }
+  inline int CartDir(int x, int y, int z) {
+    /* direction used to lower (x,y,z) in recursions */
+    return (x > 0 ? 0 : (y > 0 ? 1 : 2));
+  }
+  void CalcHGP(ShellPair& ij, ShellPair& kl,
+	       dcomplex xi, dcomplex yi, dcomplex zi, int mi,
+	       dcomplex xj, dcomplex yj, dcomplex zj, int mj,
+	       dcomplex xk, dcomplex yk, dcomplex zk, int mk,
+	       dcomplex xl, dcomplex yl, dcomplex zl, int ml, ERI_buf& buf) {
+    /*
+      Compute (ab|cd) for all cartesian a,b,c,d with |a|<=mi, |b|<=mj,
+      |c|<=mk, |d|<=ml by Obara-Saika vertical recursion for [e0|f0]^(m)
+      and Head-Gordon-Pople horizontal recursion. The result is stored in
+      buf.hrr_ket in the order (a, b, c, d) with CartIdx for each index.
+      buf.lambda must be set.
+    */
+    int Le(mi + mj), Lf(mk + ml), M(Le + Lf);
+    int ne(NumCart(Le)), nf(NumCart(Lf));
+    dcomplex p(ij.zetaP), q(kl.zetaP);
+    dcomplex P[3] = {ij.wPx, ij.wPy, ij.wPz};
+    dcomplex Q[3] = {kl.wPx, kl.wPy, kl.wPz};
+    dcomplex A[3] = {xi, yi, zi}, B[3] = {xj, yj, zj};
+    dcomplex C[3] = {xk, yk, zk}, D[3] = {xl, yl, zl};
+    dcomplex rho(p * q / (p + q));
+    dcomplex PA[3], WP[3], QC[3], WQ[3];
+    for(int i = 0; i < 3; i++) {
+      dcomplex W((p * P[i] + q * Q[i]) / (p + q));
+      PA[i] = P[i] - A[i]; WP[i] = W - P[i];
+      QC[i] = Q[i] - C[i]; WQ[i] = W - Q[i];
+    }
+
+    // -- [00|00]^(m) --
+    buf.Gms.resize(M + 1);
+    dcomplex T(rho * dist2(P[0]-Q[0], P[1]-Q[1], P[2]-Q[2]));
+    double delta(0.0000000000001);
+    dcomplex mult;
+    CalcBoys(M, T, buf, &buf.Fjs(0));
+    if(real(T)+delta > 0.0) 
+      mult = buf.lambda * exp(ij.arg + kl.arg);
+    else 
+      mult = buf.lambda * exp(ij.arg + kl.arg - T);
+    for(int m = 0; m <= M; m++)
+      buf.Gms[m] = mult * buf.Fjs(m);
+
+    // -- vertical recursion. V(e, f, m) --
+    vector<dcomplex>& V(buf.vrr);
+    V.resize(ne * nf * (M + 1));
+#define VRR(e, f, m) V[((e) * nf + (f)) * (M + 1) + (m)]
+    for(int m = 0; m <= M; m++)
+      VRR(0, 0, m) = buf.Gms[m];
+    for(int n = 1; n <= Le; n++)
+    for(int x = n; x >= 0; x--)
+    for(int y = n - x; y >= 0; y--) {
+      int z(n - x - y);
+      int e[3] = {x, y, z};
+      int i(CartDir(x, y, z));
+      e[i]--;
+      int ie(CartIdx(x, y, z)), ie1(CartIdx(e[0], e[1], e[2]));
+      int ie2(-1);
+      if(e[i] > 0) {
+	e[i]--; ie2 = CartIdx(e[0], e[1], e[2]); e[i]++;
+      }
+      for(int m = 0; m <= M - n; m++) {
+	dcomplex v(PA[i] * VRR(ie1, 0, m) + WP[i] * VRR(ie1, 0, m+1));
+	if(ie2 >= 0)
+	  v += (double)e[i] / (2.0 * p) * (VRR(ie2, 0, m) - rho / p * VRR(ie2, 0, m+1));
+	VRR(ie, 0, m) = v;
+      }
+    }
+    for(int nfn = 1; nfn <= Lf; nfn++)
+    for(int fx = nfn; fx >= 0; fx--)
+    for(int fy = nfn - fx; fy >= 0; fy--) {
+      int fz(nfn - fx - fy);
+      int f[3] = {fx, fy, fz};
+      int i(CartDir(fx, fy, fz));
+      f[i]--;
+      int jf(CartIdx(fx, fy, fz)), jf1(CartIdx(f[0], f[1], f[2]));
+      int jf2(-1);
+      if(f[i] > 0) {
+	f[i]--; jf2 = CartIdx(f[0], f[1], f[2]); f[i]++;
+      }
+      for(int n = 0; n <= Le; n++)
+      for(int x = n; x >= 0; x--)
+      for(int y = n - x; y >= 0; y--) {
+	int e[3] = {x, y, n - x - y};
+	int ie(CartIdx(e[0], e[1], e[2]));
+	int ie1(-1);
+	if(e[i] > 0) {
+	  e[i]--; ie1 = CartIdx(e[0], e[1], e[2]); e[i]++;
+	}
+	for(int m = 0; m <= M - n - nfn; m++) {
+	  dcomplex v(QC[i] * VRR(ie, jf1, m) + WQ[i] * VRR(ie, jf1, m+1));
+	  if(jf2 >= 0)
+	    v += (double)f[i] / (2.0 * q) * (VRR(ie, jf2, m) - rho / q * VRR(ie, jf2, m+1));
+	  if(ie1 >= 0)
+	    v += (double)e[i] / (2.0 * (p + q)) * VRR(ie1, jf1, m+1);
+	  VRR(ie, jf, m) = v;
+	}
+      }
+    }
+
+    // -- horizontal recursion for bra. Hb(a, b, f) --
+    int nb(NumCart(mj));
+    vector<dcomplex>& Hb(buf.hrr_bra);
+    Hb.resize(ne * nb * nf);
+#define HRR_B(a, b, f) Hb[((a) * nb + (b)) * nf + (f)]
+    for(int ie = 0; ie < ne; ie++)
+      for(int jf = 0; jf < nf; jf++)
+	HRR_B(ie, 0, jf) = VRR(ie, jf, 0);
+    for(int nbn = 1; nbn <= mj; nbn++)
+    for(int bx = nbn; bx >= 0; bx--)
+    for(int by = nbn - bx; by >= 0; by--) {
+      int b[3] = {bx, by, nbn - bx - by};
+      int i(CartDir(b[0], b[1], b[2]));
+      int ib(CartIdx(b[0], b[1], b[2]));
+      b[i]--;
+      int ib1(CartIdx(b[0], b[1], b[2]));
+      dcomplex AB(A[i] - B[i]);
+      for(int n = 0; n <= Le - nbn; n++)
+      for(int x = n; x >= 0; x--)
+      for(int y = n - x; y >= 0; y--) {
+	int a[3] = {x, y, n - x - y};
+	int ia(CartIdx(a[0], a[1], a[2]));
+	a[i]++;
+	int ia1(CartIdx(a[0], a[1], a[2]));
+	for(int jf = 0; jf < nf; jf++)
+	  HRR_B(ia, ib, jf) = HRR_B(ia1, ib1, jf) + AB * HRR_B(ia, ib1, jf);
+      }
+    }
+
+    // -- horizontal recursion for ket. Hk(a, b, c, d) --
+    int na(NumCart(mi)), nd(NumCart(ml));
+    vector<dcomplex>& Hk(buf.hrr_ket);
+    Hk.resize(na * nb * nf * nd);
+#define HRR_K(ab, c, d) Hk[((ab) * nf + (c)) * nd + (d)]
+    for(int ia = 0; ia < na; ia++)
+      for(int ib = 0; ib < nb; ib++)
+	for(int jf = 0; jf < nf; jf++)
+	  HRR_K(ia * nb + ib, jf, 0) = HRR_B(ia, ib, jf);
+    for(int ndn = 1; ndn <= ml; ndn++)
+    for(int dx = ndn; dx >= 0; dx--)
+    for(int dy = ndn - dx; dy >= 0; dy--) {
+      int d[3] = {dx, dy, ndn - dx - dy};
+      int i(CartDir(d[0], d[1], d[2]));
+      int id(CartIdx(d[0], d[1], d[2]));
+      d[i]--;
+      int id1(CartIdx(d[0], d[1], d[2]));
+      dcomplex CD(C[i] - D[i]);
+      for(int n = 0; n <= Lf - ndn; n++)
+      for(int x = n; x >= 0; x--)
+      for(int y = n - x; y >= 0; y--) {
+	int c[3] = {x, y, n - x - y};
+	int ic(CartIdx(c[0], c[1], c[2]));
+	c[i]++;
+	int ic1(CartIdx(c[0], c[1], c[2]));
+	for(int iab = 0; iab < na * nb; iab++)
+	  HRR_K(iab, ic, id) = HRR_K(iab, ic1, id1) + CD * HRR_K(iab, ic, id1);
+      }
+    }
+#undef VRR
+#undef HRR_B
+#undef HRR_K
+  }
+  inline dcomplex HGPValue(ERI_buf& buf, int mi, int mj, int mk, int ml,
+			   int nxi, int nyi, int nzi, int nxj, int nyj, int nzj,
+			   int nxk, int nyk, int nzk, int nxl, int nyl, int nzl) {
+    /* (ij|kl) computed in CalcHGP */
+    int nb(NumCart(mj)), nf(NumCart(mk + ml)), nd(NumCart(ml));
+    int iab(CartIdx(nxi, nyi, nzi) * nb + CartIdx(nxj, nyj, nzj));
+    return buf.hrr_ket[(iab * nf + CartIdx(nxk, nyk, nzk)) * nd + CartIdx(nxl, nyl, nzl)];
+  }
+  // ==== Rys quadrature kernel ====
+  // -- Chebyshev algorithm on raw moments F_k(T) loses accuracy as the number --
+  // -- of roots grows. Up to (gg|gg) it agrees with HGP within 1e-10 and     --
+  // -- sub quartets needing more roots are computed by HGP.                  --
+  static const int MAX_RYS_ROOT = 9;
+  inline int RysNumRoot(int mm) { return mm / 2 + 1; }
+  typedef Matrix<dcomplex, Dynamic, Dynamic, 0, MAX_RYS_ROOT, MAX_RYS_ROOT> RysMatrix;
+  void RysRootsWeights(int n, const dcomplex* mom, dcomplex* us, dcomplex* ws) {
+    /*
+      Roots us and weights ws of n point Gauss quadrature for the (complex)
+      weight whose u^k moments are mom[k] (k=0,...,2n-1). For Rys quadrature
+      mom[k]=F_k(T) and u=t^2. Recurrence coefficients are obtained by the
+      Chebyshev algorithm and roots are eigen values of the complex symmetric
+      Jacobi matrix.
+    */
+    if(n > MAX_RYS_ROOT) {
+      THROW_ERROR("too many Rys roots");
+    }
+    if(n == 1) {
+      us[0] = mom[1] / mom[0];
+      ws[0] = mom[0];
+      return;
+    }
+    vector<dcomplex> a(n), b(n);
+    vector<dcomplex> sig_m(2*n, 0.0), sig0(mom, mom+2*n), sig1(2*n, 0.0);
+    a[0] = mom[1] / mom[0];
+    b[0] = mom[0];
+    for(int k = 1; k < n; k++) {
+      for(int l = k; l < 2*n-k; l++)
+	sig1[l] = sig0[l+1] - a[k-1] * sig0[l] - b[k-1] * sig_m[l];
+      a[k] = sig1[k+1] / sig1[k] - sig0[k] / sig0[k-1];
+      b[k] = sig1[k] / sig0[k-1];
+      sig_m.swap(sig0);
+      sig0.swap(sig1);
+    }
+
+    RysMatrix J(RysMatrix::Zero(n, n));
+    for(int k = 0; k < n; k++)
+      J(k, k) = a[k];
+    for(int k = 1; k < n; k++) {
+      dcomplex sb(sqrt(b[k]));
+      J(k-1, k) = sb; J(k, k-1) = sb;
+    }
+
+    // -- J is tridiagonal, hence already Hessenberg. J = U T U^H. --
+    ComplexSchur<RysMatrix> schur(n);
+    schur.computeFromHessenberg(J, RysMatrix::Identity(n, n), true);
+    const RysMatrix& T(schur.matrixT());
+    const RysMatrix& U(schur.matrixU());
+    for(int i = 0; i < n; i++) {
+      // -- eigen vector x of T by back substitution, v = U x --
+      dcomplex x[MAX_RYS_ROOT];
+      x[i] = 1.0;
+      for(int r = i-1; r >= 0; r--) {
+	dcomplex acc(0.0);
+	for(int c = r+1; c <= i; c++)
+	  acc += T(r, c) * x[c];
+	dcomplex d(T(r, r) - T(i, i));
+	if(abs(d) < DBL_EPSILON * abs(T(i, i)))
+	  d = DBL_EPSILON * abs(T(i, i));
+	x[r] = -acc / d;
+      }
+      // -- complex symmetric normalization v^T v = 1 --
+      dcomplex v0(0.0), vv(0.0);
+      for(int r = 0; r < n; r++) {
+	dcomplex vr(0.0);
+	for(int c = 0; c <= i; c++)
+	  vr += U(r, c) * x[c];
+	if(r == 0)
+	  v0 = vr;
+	vv += vr * vr;
+      }
+      us[i] = T(i, i);
+      ws[i] = mom[0] * v0 * v0 / vv;
+    }
+  }
+  void CalcRys(ShellPair& ij, ShellPair& kl,
+	       dcomplex xi, dcomplex yi, dcomplex zi, int mi,
+	       dcomplex xj, dcomplex yj, dcomplex zj, int mj,
+	       dcomplex xk, dcomplex yk, dcomplex zk, int mk,
+	       dcomplex xl, dcomplex yl, dcomplex zl, int ml, ERI_buf& buf) {
+    /*
+      Compute 2D integrals I_x(a,b,c,d) (and y, z) at each Rys root for
+      0<=a<=mi, ..., 0<=d<=ml. Weights and prefactor are included in I_x.
+      The result is stored in buf.rys_I in the order (root, dir, a, b, c, d).
+      buf.lambda must be set.
+    */
+    int Le(mi + mj), Lf(mk + ml);
+    int nroot(RysNumRoot(Le + Lf));
+    dcomplex p(ij.zetaP), q(kl.zetaP);
+    dcomplex P[3] = {ij.wPx, ij.wPy, ij.wPz};
+    dcomplex Q[3] = {kl.wPx, kl.wPy, kl.wPz};
+    dcomplex A[3] = {xi, yi, zi}, B[3] = {xj, yj, zj};
+    dcomplex C[3] = {xk, yk, zk}, D[3] = {xl, yl, zl};
+    dcomplex rho(p * q / (p + q));
+
+    // -- roots and weights --
+    buf.rys_mom.resize(2 * nroot);
+    buf.rys_u.resize(nroot);
+    buf.rys_w.resize(nroot);
+    dcomplex T(rho * dist2(P[0]-Q[0], P[1]-Q[1], P[2]-Q[2]));
+    double delta(0.0000000000001);
+    dcomplex mult;
+    CalcBoys(2*nroot-1, T, buf, &buf.rys_mom[0]);
+    if(real(T)+delta > 0.0) 
+      mult = buf.lambda * exp(ij.arg + kl.arg);
+    else 
+      mult = buf.lambda * exp(ij.arg + kl.arg - T);
+    RysRootsWeights(nroot, &buf.rys_mom[0], &buf.rys_u[0], &buf.rys_w[0]);
+
+    // -- 2D integrals --
+    int n1(Lf + 1);
+    int nb(mj + 1), nc(mk + 1), nd(ml + 1);
+    int nI((mi + 1) * nb * nc * nd);
+    buf.rys_2d.resize((max(Le, ml) + 1) * n1);
+    buf.rys_I.resize(nroot * 3 * nI);
+#define G2(n, m) buf.rys_2d[(n) * n1 + (m)]
+    for(int r = 0; r < nroot; r++) {
+      dcomplex u(buf.rys_u[r]);
+      dcomplex B00(u / (2.0 * (p + q)));
+      dcomplex B10(1.0 / (2.0 * p) - q * u / (2.0 * p * (p + q)));
+      dcomplex B01(1.0 / (2.0 * q) - p * u / (2.0 * q * (p + q)));
+      for(int dir = 0; dir < 3; dir++) {
+	dcomplex PQ(P[dir] - Q[dir]);
+	dcomplex C00(P[dir] - A[dir] - q / (p + q) * PQ * u);
+	dcomplex D00(Q[dir] - C[dir] + p / (p + q) * PQ * u);
+	G2(0, 0) = (dir == 0 ? mult * buf.rys_w[r] : dcomplex(1.0));
+	for(int n = 0; n < Le; n++)
+	  G2(n+1, 0) = C00 * G2(n, 0) + (n > 0 ? double(n) * B10 * G2(n-1, 0) : 0.0);
+	for(int m = 0; m < Lf; m++)
+	  for(int n = 0; n <= Le; n++) {
+	    dcomplex v(D00 * G2(n, m));
+	    if(m > 0) v += double(m) * B01 * G2(n, m-1);
+	    if(n > 0) v += double(n) * B00 * G2(n-1, m);
+	    G2(n, m+1) = v;
+	  }
+
+	// -- horizontal recursion. H(a, b, m) then I(a, b, c, d) --
+	dcomplex AB(A[dir] - B[dir]), CD(C[dir] - D[dir]);
+	vector<dcomplex>& H(buf.rys_hrr);
+	H.resize((Le + 1) * nb * n1);
+#define H3(a, b, m) H[((a) * nb + (b)) * n1 + (m)]
+	for(int a = 0; a <= Le; a++)
+	  for(int m = 0; m <= Lf; m++)
+	    H3(a, 0, m) = G2(a, m);
+	for(int b = 0; b < mj; b++)
+	  for(int a = 0; a < Le - b; a++)
+	    for(int m = 0; m <= Lf; m++)
+	      H3(a, b+1, m) = H3(a+1, b, m) + AB * H3(a, b, m);
+	dcomplex* I = &buf.rys_I[(r * 3 + dir) * nI];
+	for(int a = 0; a <= mi; a++)
+	  for(int b = 0; b <= mj; b++) {
+	    dcomplex* K = &buf.rys_2d[0];  // reuse G2 as work space
+	    for(int m = 0; m <= Lf; m++)
+	      K[m * nd] = H3(a, b, m);
+	    for(int d = 0; d < ml; d++)
+	      for(int c = 0; c < Lf - d; c++)
+		K[c * nd + d + 1] = K[(c + 1) * nd + d] + CD * K[c * nd + d];
+	    for(int c = 0; c <= mk; c++)
+	      for(int d = 0; d <= ml; d++)
+		I[((a * nb + b) * nc + c) * nd + d] = K[c * nd + d];
+	  }
+#undef H3
+      }
+    }
+#undef G2
+  }
+  inline dcomplex RysValue(ERI_buf& buf, int mi, int mj, int mk, int ml,
+			   int nxi, int nyi, int nzi, int nxj, int nyj, int nzj,
+			   int nxk, int nyk, int nzk, int nxl, int nyl, int nzl) {
+    /* (ij|kl) computed in CalcRys */
+    int nb(mj + 1), nc(mk + 1), nd(ml + 1);
+    int nI((mi + 1) * nb * nc * nd);
+    int ix(((nxi * nb + nxj) * nc + nxk) * nd + nxl);
+    int iy(((nyi * nb + nyj) * nc + nyk) * nd + nyl);
+    int iz(((nzi * nb + nzj) * nc + nzk) * nd + nzl);
+    dcomplex v(0.0);
+    int nroot(buf.rys_u.size());
+    for(int r = 0; r < nroot; r++) {
+      dcomplex* I = &buf.rys_I[r * 3 * nI];
+      v += I[ix] * I[nI + iy] * I[2 * nI + iz];
+    }
+    return v;
+  }
+
+  // ==== Kernel switch ====
+  void CalcAtomQuartet(SubIt isub, int iat, SubIt jsub, int jat,
+		       SubIt ksub, int kat, SubIt lsub, int lat,
+		       ShellPair& pij, ShellPair& pkl, int mm,
+		       ERI_buf& buf, ERIMethod method) {
+    /* prepare buf for PrimValue on primitives at atom (iat, jat, kat, lat) */
+    if(method.kernel == 1)
+      CalcHGP(pij, pkl,
+	      isub->x(iat), isub->y(iat), isub->z(iat), isub->maxn,
+	      jsub->x(jat), jsub->y(jat), jsub->z(jat), jsub->maxn,
+	      ksub->x(kat), ksub->y(kat), ksub->z(kat), ksub->maxn,
+	      lsub->x(lat), lsub->y(lat), lsub->z(lat), lsub->maxn, buf);
+    else if(method.kernel == 2)
+      CalcRys(pij, pkl,
+	      isub->x(iat), isub->y(iat), isub->z(iat), isub->maxn,
+	      jsub->x(jat), jsub->y(jat), jsub->z(jat), jsub->maxn,
+	      ksub->x(kat), ksub->y(kat), ksub->z(kat), ksub->maxn,
+	      lsub->x(lat), lsub->y(lat), lsub->z(lat), lsub->maxn, buf);
+    else
+      CalcCoef(pij, pkl, mm, buf, method);
+  }
+  inline dcomplex PrimValue(SubIt isub, int ipn, SubIt jsub, int jpn,
+			    SubIt ksub, int kpn, SubIt lsub, int lpn,
+			    ShellPair& pij, ShellPair& pkl,
+			    ERI_buf& buf, ERIMethod method) {
+    if(method.kernel == 1)
+      return HGPValue(buf, isub->maxn, jsub->maxn, ksub->maxn, lsub->maxn,
+		      isub->nx(ipn), isub->ny(ipn), isub->nz(ipn),
+		      jsub->nx(jpn), jsub->ny(jpn), jsub->nz(jpn),
+		      ksub->nx(kpn), ksub->ny(kpn), ksub->nz(kpn),
+		      lsub->nx(lpn), lsub->ny(lpn), lsub->nz(lpn));
+    if(method.kernel == 2)
+      return RysValue(buf, isub->maxn, jsub->maxn, ksub->maxn, lsub->maxn,
+		      isub->nx(ipn), isub->ny(ipn), isub->nz(ipn),
+		      jsub->nx(jpn), jsub->ny(jpn), jsub->nz(jpn),
+		      ksub->nx(kpn), ksub->ny(kpn), ksub->nz(kpn),
+		      lsub->nx(lpn), lsub->ny(lpn), lsub->nz(lpn));
+    if(UseLowKernel(isub->maxn, jsub->maxn, ksub->maxn, lsub->maxn))
+      return CalcPrimOneLow(isub->nx(ipn), isub->ny(ipn), isub->nz(ipn),
+			    jsub->nx(jpn), jsub->ny(jpn), jsub->nz(jpn),
+			    ksub->nx(kpn), ksub->ny(kpn), ksub->nz(kpn),
+			    lsub->nx(lpn), lsub->ny(lpn), lsub->nz(lpn), pij, pkl, buf);
+    return CalcPrimOne(isub->nx(ipn), isub->ny(ipn), isub->nz(ipn),
+		       jsub->nx(jpn), jsub->ny(jpn), jsub->nz(jpn),
+		       ksub->nx(kpn), ksub->ny(kpn), ksub->nz(kpn),
+		       lsub->nx(lpn), lsub->ny(lpn), lsub->nz(lpn), pij, pkl, buf);
+  }
   dcomplex OneERI(dcomplex xi, dcomplex yi, dcomplex zi,
 		  int nxi, int nyi, int nzi, dcomplex zetai,
 		  dcomplex xj, dcomplex yj, dcomplex zj,
@@ -405,13 +1060,50 @@ namespace cbasis {
   }
 
   // ==== Primitive ====
+  void AddBoysArgs(SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
+		   ShellPairSet& ij, int iz, int jz, ShellPairSet& kl, int kz, int lz,
+		   ERI_buf& buf, ERIMethod method) {
+    /*
+      Append T of the atom quartets of primitive quartet (iz jz|kz lz) to
+      buf.T_batch and their position in it to buf.q_batch, so that F_m(T)
+      of all primitive quartets of a contraction quartet is computed by one
+      CalcBoysBatch. With symmetry, atom quartets whose values are 0 or
+      obtained from other ones get -1.
+    */
+    int nati(isub->size_at()), npni(isub->size_pn());
+    int natj(jsub->size_at()), npnj(jsub->size_pn());
+    int natk(ksub->size_at()), npnk(ksub->size_pn());
+    int natl(lsub->size_at()), npnl(lsub->size_pn());
+    for(int iat = 0; iat < nati; iat++) 
+    for(int jat = 0; jat < natj; jat++)       
+    for(int kat = 0; kat < natk; kat++) 
+    for(int lat = 0; lat < natl; lat++) {
+      bool find_non0(method.symmetry == 0);
+      for(int ipn = 0; ipn < npni && !find_non0; ipn++) 
+      for(int jpn = 0; jpn < npnj && !find_non0; jpn++) 
+      for(int kpn = 0; kpn < npnk && !find_non0; kpn++) 
+      for(int lpn = 0; lpn < npnl && !find_non0; lpn++) {
+	int ip = isub->ip_iat_ipn(iat, ipn); int jp = jsub->ip_iat_ipn(jat, jpn);
+	int kp = ksub->ip_iat_ipn(kat, kpn); int lp = lsub->ip_iat_ipn(lat, lpn);
+	int mark_I[10]; bool is_zero, is_youngest;
+	CheckEqERI(isub->sym_group(), isub, jsub, ksub, lsub, ip, jp, kp, lp,
+		   nati*npni, natj*npnj, natk*npnk, mark_I, &is_zero, &is_youngest);
+	if(!is_zero && is_youngest)
+	  find_non0 = true;
+      }
+      if(find_non0) {
+	buf.q_batch.push_back(buf.T_batch.size());
+	buf.T_batch.push_back(BoysArg(ij(iz, jz, iat, jat), kl(kz, lz, kat, lat)));
+      } else {
+	buf.q_batch.push_back(-1);
+      }
+    }
+  }
   // -- very simple --
   void CalcPrimERI0(SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
-		    dcomplex zetai, dcomplex zetaj, dcomplex zetak, dcomplex zetal,
-		    A4dc& prim, ERIMethod method) {
-
-    static ERI_buf buf(1000);
-    dcomplex zetaP = zetai + zetaj; dcomplex zetaPp = zetak + zetal;
+		    ShellPairSet& ij, int iz, int jz, ShellPairSet& kl, int kz, int lz,
+		    int q0, A4dc& prim, ERI_buf& buf, ERIMethod method) {
+    /* F_m(T) of atom quartet iaq is buf.F_batch at buf.q_batch[q0+iaq]. */
 
     int nati, natj, natk, natl;
     nati = isub->size_at(); natj = jsub->size_at();
@@ -423,20 +1115,22 @@ namespace cbasis {
 
     prim.SetRange(0, nati*npni-1, 0, natj*npnj-1, 0, natk*npnk-1, 0, natl*npnl-1);
 
-    int mi, mj, mk, ml;
-    mi = isub->maxn; mj = jsub->maxn; mk = ksub->maxn; ml = lsub->maxn;
+    int mm(isub->maxn + jsub->maxn + ksub->maxn + lsub->maxn);
+    dcomplex zetaP(ij(iz, jz, 0, 0).zetaP), zetaPp(kl(kz, lz, 0, 0).zetaP);
     buf.lambda = 2.0*pow(M_PI, 2.5)/(zetaP * zetaPp * sqrt(zetaP + zetaPp));    
 
     prim.SetValue(0.0);
 
+    int mb(BoysOrder(mm, method)), iaq(q0);
     for(int iat = 0; iat < nati; iat++) 
     for(int jat = 0; jat < natj; jat++)       
     for(int kat = 0; kat < natk; kat++) 
-    for(int lat = 0; lat < natl; lat++) {
-      CalcCoef(isub->x(iat), isub->y(iat), isub->z(iat), mi, zetai,
-	       jsub->x(jat), jsub->y(jat), jsub->z(jat), mj, zetaj, 
-	       ksub->x(kat), ksub->y(kat), ksub->z(kat), mk, zetak, 
-	       lsub->x(lat), lsub->y(lat), lsub->z(lat), ml, zetal, buf, method);
+    for(int lat = 0; lat < natl; lat++, iaq++) {
+      ShellPair& pij(ij(iz, jz, iat, jat));
+      ShellPair& pkl(kl(kz, lz, kat, lat));
+      buf.Fjs_pre = &buf.F_batch[buf.q_batch[iaq] * (mb+1)];
+      CalcAtomQuartet(isub, iat, jsub, jat, ksub, kat, lsub, lat,
+		      pij, pkl, mm, buf, method);
       
       for(int ipn = 0; ipn < npni; ipn++) 
       for(int jpn = 0; jpn < npnj; jpn++) 
@@ -444,23 +1138,19 @@ namespace cbasis {
       for(int lpn = 0; lpn < npnl; lpn++) {
 	int ip = isub->ip_iat_ipn(iat, ipn); int jp = jsub->ip_iat_ipn(jat, jpn);
 	int kp = ksub->ip_iat_ipn(kat, kpn); int lp = lsub->ip_iat_ipn(lat, lpn);
-	dcomplex v;
-	v = CalcPrimOne(isub->nx(ipn), isub->ny(ipn), isub->nz(ipn),
-			jsub->nx(jpn), jsub->ny(jpn), jsub->nz(jpn),
-			ksub->nx(kpn), ksub->ny(kpn), ksub->nz(kpn),
-			lsub->nx(lpn), lsub->ny(lpn), lsub->nz(lpn), buf);
-	prim(ip, jp, kp, lp) = v;
+	prim(ip, jp, kp, lp) = PrimValue(isub, ipn, jsub, jpn, ksub, kpn, lsub, lpn,
+					 pij, pkl, buf, method);
       }
     }
+    buf.Fjs_pre = NULL;
   }
   // -- Symmetry considerration --
   void CalcPrimERI1(SymmetryGroup sym,
 		    SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
-		    dcomplex zetai, dcomplex zetaj, dcomplex zetak, dcomplex zetal,
-		    A4dc& prim, ERIMethod method) {
+		    ShellPairSet& ij, int iz, int jz, ShellPairSet& kl, int kz, int lz,
+		    int q0, A4dc& prim, ERI_buf& buf, ERIMethod method) {
+    /* atom quartets with buf.q_batch[q0+iaq] < 0 have no value to compute. */
 
-    static ERI_buf buf(1000);
-    dcomplex zetaP = zetai + zetaj; dcomplex zetaPp = zetak + zetal;
     int nati(isub->size_at()), npni(isub->size_pn());
     int natj(jsub->size_at()), npnj(jsub->size_pn());
     int natk(ksub->size_at()), npnk(ksub->size_pn());
@@ -468,41 +1158,28 @@ namespace cbasis {
 
     prim.SetRange(0, nati*npni-1, 0, natj*npnj-1, 0, natk*npnk-1, 0, natl*npnl-1);
 
-    int mi, mj, mk, ml;
-    mi = isub->maxn; mj = jsub->maxn; mk = ksub->maxn; ml = lsub->maxn;
+    int mm(isub->maxn + jsub->maxn + ksub->maxn + lsub->maxn);
+    dcomplex zetaP(ij(iz, jz, 0, 0).zetaP), zetaPp(kl(kz, lz, 0, 0).zetaP);
     buf.lambda = 2.0*pow(M_PI, 2.5)/(zetaP * zetaPp * sqrt(zetaP + zetaPp));    
 
     int numI(sym->order());
 
     prim.SetValue(0.0);
 
+    int mb(BoysOrder(mm, method)), iaq(q0);
     for(int iat = 0; iat < nati; iat++) 
     for(int jat = 0; jat < natj; jat++)       
     for(int kat = 0; kat < natk; kat++) 
-    for(int lat = 0; lat < natl; lat++) {
-
-      // -- check 0 or non 0 --
-      bool find_non0(false);
-      for(int ipn = 0; ipn < npni; ipn++) 
-      for(int jpn = 0; jpn < npnj; jpn++) 
-      for(int kpn = 0; kpn < npnk; kpn++) 
-      for(int lpn = 0; lpn < npnl; lpn++) {
-	int ip = isub->ip_iat_ipn(iat, ipn); int jp = jsub->ip_iat_ipn(jat, jpn);
-	int kp = ksub->ip_iat_ipn(kat, kpn); int lp = lsub->ip_iat_ipn(lat, lpn);
-	int mark_I[10]; bool is_zero, is_youngest;
-	CheckEqERI(isub->sym_group(), isub, jsub, ksub, lsub, ip, jp, kp, lp,
-		   nati*npni, natj*npnj, natk*npnk, mark_I, &is_zero, &is_youngest);
-	if(!is_zero && is_youngest)
-	  find_non0 = true;
-      }
+    for(int lat = 0; lat < natl; lat++, iaq++) {
 
       // -- compute if found non0 --
-      if(find_non0) {
+      if(buf.q_batch[iaq] >= 0) {
       
-	CalcCoef(isub->x(iat), isub->y(iat), isub->z(iat), mi, zetai,
-		 jsub->x(jat), jsub->y(jat), jsub->z(jat), mj, zetaj, 
-		 ksub->x(kat), ksub->y(kat), ksub->z(kat), mk, zetak, 
-		 lsub->x(lat), lsub->y(lat), lsub->z(lat), ml, zetal, buf, method);
+	ShellPair& pij(ij(iz, jz, iat, jat));
+	ShellPair& pkl(kl(kz, lz, kat, lat));
+	buf.Fjs_pre = &buf.F_batch[buf.q_batch[iaq] * (mb+1)];
+	CalcAtomQuartet(isub, iat, jsub, jat, ksub, kat, lsub, lat,
+			pij, pkl, mm, buf, method);
 
 	for(int ipn = 0; ipn < npni; ipn++) 
 	for(int jpn = 0; jpn < npnj; jpn++) 
@@ -515,11 +1192,8 @@ namespace cbasis {
 	  CheckEqERI(isub->sym_group(), isub, jsub, ksub, lsub, ip, jp, kp, lp,
 		     nati*npni, natj*npnj, natk*npnk, mark_I, &is_zero, &is_youngest);
 	  if(!is_zero && is_youngest) {
-	    dcomplex v;
-	    v = CalcPrimOne(isub->nx(ipn), isub->ny(ipn), isub->nz(ipn),
-			    jsub->nx(jpn), jsub->ny(jpn), jsub->nz(jpn),
-			    ksub->nx(kpn), ksub->ny(kpn), ksub->nz(kpn),
-			    lsub->nx(lpn), lsub->ny(lpn), lsub->nz(lpn), buf);
+	    dcomplex v(PrimValue(isub, ipn, jsub, jpn, ksub, kpn, lsub, lpn,
+				 pij, pkl, buf, method));
 	    for(int I = 0; I < numI; I++) {
 	      if(mark_I[I] != 0) {
 		int ipt = isub->ip_jg_kp(I, ip);
@@ -533,6 +1207,7 @@ namespace cbasis {
 	}
       }
     }
+    buf.Fjs_pre = NULL;
 
   }
   // -- Simple --
@@ -638,15 +1313,15 @@ namespace cbasis {
 
   // -- interface --
   void CalcPrimERI(SymmetryGroup sym, SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
-		    dcomplex zetai, dcomplex zetaj, dcomplex zetak, dcomplex zetal,
-		    A4dc& prim, ERIMethod method) {
+		   ShellPairSet& ij, int iz, int jz, ShellPairSet& kl, int kz, int lz,
+		   int q0, A4dc& prim, ERI_buf& buf, ERIMethod method) {
     
     if(method.symmetry == 0) {
-      CalcPrimERI0(isub, jsub, ksub, lsub, zetai, zetaj, zetak, zetal,
-		   prim, method);
+      CalcPrimERI0(isub, jsub, ksub, lsub, ij, iz, jz, kl, kz, lz,
+		   q0, prim, buf, method);
     } else {
-      CalcPrimERI1(sym, isub, jsub, ksub, lsub, zetai, zetaj, zetak, zetal,
-		   prim, method);
+      CalcPrimERI1(sym, isub, jsub, ksub, lsub, ij, iz, jz, kl, kz, lz,
+		   q0, prim, buf, method);
     }
   }
 
@@ -691,8 +1366,227 @@ namespace cbasis {
   }
 
   // ==== calc for Sub  ====
+  // -- scratch arrays used for one sub shell quartet. --
+  // -- each thread in CalcERI owns one of them.       --
+  struct ERI_ws {
+    ERI_buf buf;
+    A4dc prim;
+    A4dc coef_at; // coefficient of one reduction quartet in primitive quartets
+    MatrixXcd coef_rds;  // (reduction quartet, primitive quartet)
+    MatrixXcd prim_cont; // (primitive quartet, contraction quartet in batch)
+    MatrixXcd eri_batch; // (reduction quartet, contraction quartet in batch)
+    A4dc eri_cont; // (ij|kl) for each reduction of one contraction quartet
+    B2EInt blk;  // one sub quartet block used in CalcERI1
+    ShellPairSet ij, kl; // bra and ket shell pairs
+    long num_computed, num_skipped;
+    ERI_ws(int num_prim) :
+      buf(1000), prim(num_prim, "prim"), coef_at(num_prim, "coef_at"),
+      eri_cont(1000, "eri_cont"), blk(new B2EIntMem),
+      num_computed(0), num_skipped(0) {}
+  };
+  void CalcCoefRds(SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub, ERI_ws& ws) {
+    /*
+      ws.coef_rds(R, P) for reduction quartet R = (ir,jr,kr,lr) and
+      primitive quartet P in the layout of ws.prim.
+    */
+    int nir(isub->rds.size()), njr(jsub->rds.size());
+    int nkr(ksub->rds.size()), nlr(lsub->rds.size());
+    int np(isub->size_at() * isub->size_pn() * jsub->size_at() * jsub->size_pn() *
+	   ksub->size_at() * ksub->size_pn() * lsub->size_at() * lsub->size_pn());
+    ws.coef_rds.resize(nir*njr*nkr*nlr, np);
+    int R(0);
+    for(int ir = 0; ir < nir; ++ir)
+    for(int jr = 0; jr < njr; ++jr)
+    for(int kr = 0; kr < nkr; ++kr)
+    for(int lr = 0; lr < nlr; ++lr) {
+      TransCoef_rds(isub, jsub, ksub, lsub, isub->rds[ir], jsub->rds[jr],
+		    ksub->rds[kr], lsub->rds[lr], ws.coef_at);
+      ws.coef_rds.row(R) = Map<VectorXcd>(ws.coef_at.data_, np);
+      R++;
+    }
+  }
+  void CalcPrimCont(SymmetryGroup sym, SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
+		    int icont, int jcont, int kcont, int lcont,
+		    ERI_ws& ws, ERIMethod method, int col) {
+    /*
+      Put sum of contraction coefficients times primitive ERI for one
+      contraction quartet to ws.prim_cont.col(col).
+      ws.ij/ws.kl must be built for (isub,jsub)/(ksub,lsub).
+    */
+    int nczi(isub->size_cz(icont)), nczj(jsub->size_cz(jcont));
+    int nczk(ksub->size_cz(kcont)), nczl(lsub->size_cz(lcont));
+    int np(ws.prim_cont.rows());
+    int mm(isub->maxn + jsub->maxn + ksub->maxn + lsub->maxn);
+    int naq(isub->size_at() * jsub->size_at() * ksub->size_at() * lsub->size_at());
+    if(method.kernel == 2 && RysNumRoot(mm) > MAX_RYS_ROOT)
+      method.kernel = 1;
+
+    // -- F_m(T) of all primitive and atom quartets in one batch --
+    ws.buf.T_batch.clear();
+    ws.buf.q_batch.clear();
+    for(int icz = 0; icz < nczi; icz++)
+    for(int jcz = 0; jcz < nczj; jcz++)
+    for(int kcz = 0; kcz < nczk; kcz++)
+    for(int lcz = 0; lcz < nczl; lcz++) 
+      AddBoysArgs(isub, jsub, ksub, lsub,
+		  ws.ij, ws.ij.iz(icont, icz), ws.ij.jz(jcont, jcz),
+		  ws.kl, ws.kl.iz(kcont, kcz), ws.kl.jz(lcont, lcz),
+		  ws.buf, method);
+    CalcBoysBatch(ws.buf.T_batch.size(), BoysOrder(mm, method), ws.buf);
+    
+    ws.prim_cont.col(col).setZero();
+    int q0(0);
+    for(int icz = 0; icz < nczi; icz++)
+    for(int jcz = 0; jcz < nczj; jcz++)
+    for(int kcz = 0; kcz < nczk; kcz++)
+    for(int lcz = 0; lcz < nczl; lcz++, q0 += naq) {
+      dcomplex c(isub->cz_icont_icz[icont][icz].first *
+		 jsub->cz_icont_icz[jcont][jcz].first *
+		 ksub->cz_icont_icz[kcont][kcz].first *
+		 lsub->cz_icont_icz[lcont][lcz].first);
+      CalcPrimERI(sym, isub, jsub, ksub, lsub,
+		  ws.ij, ws.ij.iz(icont, icz), ws.ij.jz(jcont, jcz),
+		  ws.kl, ws.kl.iz(kcont, kcz), ws.kl.jz(lcont, lcz),
+		  q0, ws.prim, ws.buf, method);
+      ws.prim_cont.col(col) += c * Map<VectorXcd>(ws.prim.data_, np);
+    }
+  }
+  inline dcomplex CoefICont(SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
+			    int ir, int jr, int kr, int lr,
+			    int icont, int jcont, int kcont, int lcont) {
+    return (isub->rds[ir].coef_icont(icont) * jsub->rds[jr].coef_icont(jcont) *
+	    ksub->rds[kr].coef_icont(kcont) * lsub->rds[lr].coef_icont(lcont));
+  }
+  void CalcContERI(SymmetryGroup sym, SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
+		   int icont, int jcont, int kcont, int lcont,
+		   ERI_ws& ws, ERIMethod method) {
+    /*
+      Compute ws.eri_cont(ir,jr,kr,lr) for one contraction quartet.
+      ws.coef_rds must be prepared by CalcCoefRds and ws.ij/ws.kl
+      must be built for (isub,jsub)/(ksub,lsub).
+    */
+    int nir(isub->rds.size()), njr(jsub->rds.size());
+    int nkr(ksub->rds.size()), nlr(lsub->rds.size());
+    ws.prim_cont.resize(ws.coef_rds.cols(), 1);
+    CalcPrimCont(sym, isub, jsub, ksub, lsub, icont, jcont, kcont, lcont,
+		 ws, method, 0);
+    ws.eri_batch.noalias() = ws.coef_rds * ws.prim_cont;
+    ws.eri_cont.SetRange(0, nir-1, 0, njr-1, 0, nkr-1, 0, nlr-1);
+    int R(0);
+    for(int ir = 0; ir < nir; ++ir)
+    for(int jr = 0; jr < njr; ++jr)
+    for(int kr = 0; kr < nkr; ++kr)
+    for(int lr = 0; lr < nlr; ++lr) {
+      ws.eri_cont(ir, jr, kr, lr) =
+	CoefICont(isub, jsub, ksub, lsub, ir, jr, kr, lr, icont, jcont, kcont, lcont) *
+	ws.eri_batch(R, 0);
+      R++;
+    }
+  }
+
+  // -- Schwarz screening --
+  struct SchwarzScreen {
+    /*
+      Estimate |(ij|kl)| <= Q(ij) Q(kl), Q(ij) = sqrt|(ij|ij)|, tabulated
+      for each sub shell pair and contraction pair (maximum over
+      Reductions). For complex scaled basis the inequality is not strict,
+      so it is used as an estimate controlled by ERIMethod::schwarz_thresh.
+    */
+    double thresh;
+    SubIt i0, j0, k0, l0;
+    int nj, nl;
+    vector<MatrixXd> q_ij, q_kl;
+    // -- density weight for direct J/K. used only if i,j,k,l are all in the --
+    // -- basis of D, whose subs start at d0.                                --
+    bool use_dens;
+    SubIt d0;
+    int nd;
+    vector<MatrixXd> d_ij; // max |D| for each sub pair and contraction pair
+    SchwarzScreen(): thresh(0.0), nj(0), nl(0), use_dens(false), nd(0) {}
+    bool Skip(SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
+	      int icont, int jcont, int kcont, int lcont) const {
+      const MatrixXd& qij(q_ij[distance(i0, isub) * nj + distance(j0, jsub)]);
+      const MatrixXd& qkl(q_kl[distance(k0, ksub) * nl + distance(l0, lsub)]);
+      double w(1.0);
+      if(use_dens) {
+	// -- J and K of the permutation images use D of any two of i,j,k,l --
+	w = max(max(Dens(isub, jsub, icont, jcont), Dens(ksub, lsub, kcont, lcont)),
+		max(max(Dens(isub, ksub, icont, kcont), Dens(isub, lsub, icont, lcont)),
+		    max(Dens(jsub, ksub, jcont, kcont), Dens(jsub, lsub, jcont, lcont))));
+      }
+      return qij(icont, jcont) * qkl(kcont, lcont) * w < thresh;
+    }
+    double Dens(SubIt asub, SubIt bsub, int acont, int bcont) const {
+      return d_ij[distance(d0, asub) * nd + distance(d0, bsub)](acont, bcont);
+    }
+  };
+  void CalcSchwarz(SymGTOs gi, SymGTOs gj, ERI_ws& ws, ERIMethod method,
+		   vector<MatrixXd>& q) {
+    q.clear();
+    for(SubIt isub = gi->subs().begin(); isub != gi->subs().end(); ++isub) 
+    for(SubIt jsub = gj->subs().begin(); jsub != gj->subs().end(); ++jsub) {
+      MatrixXd qq(MatrixXd::Zero(isub->size_cont(), jsub->size_cont()));
+      CalcCoefRds(isub, jsub, isub, jsub, ws);
+      ws.ij.Build(isub, jsub);
+      ws.kl.Build(isub, jsub);
+      for(int icont = 0; icont < isub->size_cont(); icont++)
+      for(int jcont = 0; jcont < jsub->size_cont(); jcont++) {
+	CalcContERI(gi->sym_group(), isub, jsub, isub, jsub,
+		    icont, jcont, icont, jcont, ws, method);
+	for(int ir = 0; ir < (int)isub->rds.size(); ++ir)
+	for(int jr = 0; jr < (int)jsub->rds.size(); ++jr)
+	  qq(icont, jcont) = max(qq(icont, jcont),
+				 sqrt(abs(ws.eri_cont(ir, jr, ir, jr))));
+      }
+      q.push_back(qq);
+    }
+  }
+  void SetUpDensScreen(SymGTOs g, const BMat& D, SchwarzScreen& screen) {
+    /* D is in basis g. disabled unless the Schwarz table is built for g,g,g,g. */
+    screen.d_ij.clear();
+    screen.d0 = g->subs().begin();
+    screen.nd = g->size_subs();
+    screen.use_dens = (screen.i0 == screen.d0 && screen.j0 == screen.d0 &&
+		       screen.k0 == screen.d0 && screen.l0 == screen.d0);
+    if(not screen.use_dens)
+      return;
+    for(SubIt isub = g->subs().begin(); isub != g->subs().end(); ++isub) 
+    for(SubIt jsub = g->subs().begin(); jsub != g->subs().end(); ++jsub) {
+      MatrixXd dd(MatrixXd::Zero(isub->size_cont(), jsub->size_cont()));
+      for(RdsIt irds = isub->rds.begin(); irds != isub->rds.end(); ++irds)
+      for(RdsIt jrds = jsub->rds.begin(); jrds != jsub->rds.end(); ++jrds) {
+	if(irds->irrep != jrds->irrep || not D.has_block(irds->irrep, jrds->irrep))
+	  continue;
+	const MatrixXcd& DD(D(irds->irrep, jrds->irrep));
+	for(int icont = 0; icont < isub->size_cont(); icont++)
+	for(int jcont = 0; jcont < jsub->size_cont(); jcont++)
+	  dd(icont, jcont) = max(dd(icont, jcont),
+				 abs(DD(irds->offset + icont, jrds->offset + jcont)));
+      }
+      screen.d_ij.push_back(dd);
+    }
+  }
+  void SetUpSchwarz(SymGTOs gi, SymGTOs gj, SymGTOs gk, SymGTOs gl,
+		    ERI_ws& ws, ERIMethod method, SchwarzScreen& screen) {
+    screen.thresh = method.schwarz_thresh;
+    screen.i0 = gi->subs().begin(); screen.j0 = gj->subs().begin();
+    screen.k0 = gk->subs().begin(); screen.l0 = gl->subs().begin();
+    screen.nj = gj->size_subs(); screen.nl = gl->size_subs();
+    CalcSchwarz(gi, gj, ws, method, screen.q_ij);
+    if(gi == gk && gj == gl)
+      screen.q_kl = screen.q_ij;
+    else
+      CalcSchwarz(gk, gl, ws, method, screen.q_kl);
+  }
+  
   void CalcERI0(SymmetryGroup sym, SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
-		A4dc& prim, ERIMethod method, B2EInt eri) {
+		ERI_ws& ws, ERIMethod method, B2EInt eri,
+		const SchwarzScreen* screen) {
+    /*
+      Contracted primitive blocks of contraction quartets are collected
+      as columns of ws.prim_cont, and the primitive to reduction
+      transform is done for the batch as one matrix product.
+    */
 
     if(not ExistNon0(isub, jsub, ksub, lsub))
       return;
@@ -701,91 +1595,405 @@ namespace cbasis {
     int nkr(ksub->rds.size()), nlr(lsub->rds.size());
     int nicont(isub->size_cont()), njcont(jsub->size_cont());
     int nkcont(ksub->size_cont()), nlcont(lsub->size_cont());
-    static A4dc coef_rds(1000, "coef_rds");
-    static A4dc coef_cont(1000, "coef_cont");
-    static A44dc eri_rds(1000, "eri_rds");
-    eri_rds.SetRange(0, isub->size_at() * isub->size_pn()-1,
-		     0, jsub->size_at() * jsub->size_pn()-1,
-		     0, ksub->size_at() * ksub->size_pn()-1,
-		     0, lsub->size_at() * lsub->size_pn()-1);
+    CalcCoefRds(isub, jsub, ksub, lsub, ws);
+    ws.ij.Build(isub, jsub);
+    ws.kl.Build(ksub, lsub);
+
+    int np(ws.coef_rds.cols());
+    int max_batch(max(1, min(64, (1<<20) / max(np, 1))));
+    ws.prim_cont.resize(np, max_batch);
+    vector<int> conts(4 * max_batch);
+    int num_batch(0);
     
     for(int icont = 0; icont < nicont; icont++)
     for(int jcont = 0; jcont < njcont; jcont++)
     for(int kcont = 0; kcont < nkcont; kcont++)
     for(int lcont = 0; lcont < nlcont; lcont++)  {
-      int nczi(isub->size_cz(icont)), nczj(jsub->size_cz(jcont));
-      int nczk(ksub->size_cz(kcont)), nczl(lsub->size_cz(lcont));
-
-      for(int ir = 0; ir < nir; ++ir)
-      for(int jr = 0; jr < njr; ++jr)
-      for(int kr = 0; kr < nkr; ++kr)
-      for(int lr = 0; lr < nlr; ++lr) {
-	eri_rds(ir, jr, kr, lr).SetRange(0,nczi-1, 0,nczj-1, 0,nczk-1, 0,nczl-1);
-	TransCoef_rds(isub, jsub, ksub, lsub, isub->rds[ir], jsub->rds[jr],
-		      ksub->rds[kr], lsub->rds[lr], coef_rds);
-      }
-      coef_cont.SetRange(0,nczi-1, 0,nczj-1, 0,nczk-1, 0,nczl-1);
-      
-      for(int icz = 0; icz < nczi; icz++)
-      for(int jcz = 0; jcz < nczi; jcz++)
-      for(int kcz = 0; kcz < nczi; kcz++)
-      for(int lcz = 0; lcz < nczi; lcz++) {
-	pair<dcomplex, dcomplex>& czi(isub->cz_icont_icz[icont][icz]);
-	pair<dcomplex, dcomplex>& czj(jsub->cz_icont_icz[jcont][jcz]);
-	pair<dcomplex, dcomplex>& czk(ksub->cz_icont_icz[kcont][kcz]);
-	pair<dcomplex, dcomplex>& czl(lsub->cz_icont_icz[lcont][lcz]);
-	coef_cont(icz, jcz, kcz, lcz) = czi.first * czj.first * czk.first * czl.first;
-	CalcPrimERI(sym, isub, jsub, ksub, lsub, czi.second, czj.second, 
-		    czk.second, czl.second, prim, method);
+
+      bool last(icont == nicont-1 && jcont == njcont-1 &&
+		kcont == nkcont-1 && lcont == nlcont-1);
+      if(screen != NULL &&
+	 screen->Skip(isub, jsub, ksub, lsub, icont, jcont, kcont, lcont)) {
+	ws.num_skipped++;
+      } else {
+	ws.num_computed++;
+	CalcPrimCont(sym, isub, jsub, ksub, lsub, icont, jcont, kcont, lcont,
+		     ws, method, num_batch);
+	conts[4*num_batch+0] = icont; conts[4*num_batch+1] = jcont;
+	conts[4*num_batch+2] = kcont; conts[4*num_batch+3] = lcont;
+	num_batch++;
+      }
+      if(num_batch == 0 || (num_batch < max_batch && not last))
+	continue;
+
+      // -- transform the batch to reductions --
+      ws.eri_batch.noalias() = ws.coef_rds * ws.prim_cont.leftCols(num_batch);
+      for(int b = 0; b < num_batch; b++) {
+	int ic(conts[4*b+0]), jc(conts[4*b+1]), kc(conts[4*b+2]), lc(conts[4*b+3]);
+	int R(0);
 	for(int ir = 0; ir < nir; ++ir)
 	for(int jr = 0; jr < njr; ++jr)
 	for(int kr = 0; kr < nkr; ++kr)
-	for(int lr = 0; lr < nlr; ++lr) {	
-	  eri_rds(ir,jr,kr,lr)(icz,jcz,kcz,lcz) = MultArrayTDot(prim, coef_rds);
+	for(int lr = 0; lr < nlr; ++lr) {
+	  Reduction& irds(isub->rds[ir]), jrds(jsub->rds[jr]);
+	  Reduction& krds(ksub->rds[kr]), lrds(lsub->rds[lr]);
+	  int i = irds.offset + ic; int irr = irds.irrep;
+	  int j = jrds.offset + jc; int jrr = jrds.irrep;
+	  int k = krds.offset + kc; int krr = krds.irrep;
+	  int l = lrds.offset + lc; int lrr = lrds.irrep;
+	  eri->Set(irr,jrr,krr,lrr, i,j,k,l,
+		   CoefICont(isub, jsub, ksub, lsub, ir, jr, kr, lr, ic, jc, kc, lc) *
+		   ws.eri_batch(R, b));
+	  R++;
 	}
       }
-
-      for(int ir = 0; ir < nir; ++ir)
-      for(int jr = 0; jr < njr; ++jr)
-      for(int kr = 0; kr < nkr; ++kr)
-      for(int lr = 0; lr < nlr; ++lr) {
-	Reduction& irds(isub->rds[ir]), jrds(jsub->rds[jr]);
-	Reduction& krds(ksub->rds[kr]), lrds(lsub->rds[lr]);
-	int i = irds.offset + icont; int irr = irds.irrep;
-	int j = jrds.offset + jcont; int jrr = jrds.irrep;
-	int k = krds.offset + kcont; int krr = krds.irrep;
-	int l = lrds.offset + lcont; int lrr = lrds.irrep;
-	eri->Set(irr,jrr,krr,lrr, i,j,k,l, 
-		 irds.coef_icont(icont) *
-		 jrds.coef_icont(jcont) *
-		 krds.coef_icont(kcont) *
-		 lrds.coef_icont(lcont) *
-		 MultArrayTDot(coef_cont, eri_rds(ir,jr,kr,lr)));
-      }
+      num_batch = 0;
     }
   }
+  int NumERI0(SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub) {
+    /* number of values CalcERI0 stores for the given sub quartet. */
+    if(not ExistNon0(isub, jsub, ksub, lsub))
+      return 0;
+    return (isub->size_cont() * jsub->size_cont() *
+	    ksub->size_cont() * lsub->size_cont() *
+	    isub->size_rds() * jsub->size_rds() *
+	    ksub->size_rds() * lsub->size_rds());
+  }
   // -- permutation symmetry --
+  bool IndexGeq(int ib, int i, int jb, int j) {
+    return (ib > jb || (ib == jb && i >= j));
+  }
+  bool PairGeq(int ib, int i, int jb, int j, int kb, int k, int lb, int l) {
+    if(ib != kb) return ib > kb;
+    if(i  != k)  return i  > k;
+    return IndexGeq(jb, j, lb, l);
+  }
+  bool CanonicalSubs(SymGTOs& g, SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub) {
+    /* A>=B, C>=D and (AB)>=(CD) for sub shell positions A,B,C,D in g. */
+    int a(distance(g->subs().begin(), isub)), b(distance(g->subs().begin(), jsub));
+    int c(distance(g->subs().begin(), ksub)), d(distance(g->subs().begin(), lsub));
+    return (a >= b && c >= d && (a > c || (a == c && b >= d)));
+  }
   void CalcERI1(SymGTOs& gi, SymGTOs& gj,SymGTOs& gk,SymGTOs& gl,
 		SubIt isub, SubIt jsub, SubIt ksub, SubIt lsub,
-		A4dc& prim, ERIMethod method, B2EInt eri) {
-    THROW_ERROR("not impl");
+		ERI_ws& ws, ERIMethod method, B2EInt eri,
+		const SchwarzScreen* screen) {
+    /*
+      gi, gj, gk and gl must be the same SymGTOs. Only canonical sub
+      quartets are computed and one representative of each class
+      {(ij|kl),(ji|kl),(ij|lk),(kl|ij),...} is stored with type
+      ERI_TYPE_PERM8, so that B2EInt::Get returns all of them.
+    */
+    if(not CanonicalSubs(gi, isub, jsub, ksub, lsub))
+      return;
+    
+    bool ab(isub == jsub), cd(ksub == lsub), abcd(isub == ksub && jsub == lsub);
+    B2EInt blk(ws.blk);
+    blk->Init(NumERI0(isub, jsub, ksub, lsub));
+    CalcERI0(gi->sym_group(), isub, jsub, ksub, lsub, ws, method, blk, screen);
+
+    int ib,jb,kb,lb,i,j,k,l,t;
+    dcomplex v;
+    blk->Reset();
+    while(blk->Get(&ib,&jb,&kb,&lb,&i,&j,&k,&l, &t, &v)) {
+      if(ab && not IndexGeq(ib, i, jb, j))
+	continue;
+      if(cd && not IndexGeq(kb, k, lb, l))
+	continue;
+      if(abcd && not PairGeq(ib, i, jb, j, kb, k, lb, l))
+	continue;
+      eri->Set(ib,jb,kb,lb, i,j,k,l, ERI_TYPE_PERM8, v);
+    }
+  }
+  // -- small basis --
+  bool HasIrrep(SubIt sub, Irrep irrep) {
+    for(RdsIt it = sub->rds.begin(); it != sub->rds.end(); ++it)
+      if(it->irrep == irrep)
+	return true;
+    return false;
   }
-  void CalcERI_ijkk(SymGTOs& g0, SymGTOs& g1,SymGTOs& g2,
-		    SubIt isub, SubIt jsub, SubIt ksub,
-		    A4dc& prim, ERIMethod method, B2EInt eri) {
-    throw runtime_error("not impl");
+  void CalcERI_ijkk(SymGTOs gi, SymGTOs gj, SymGTOs gk, SymGTOs gl, bool is_J,
+		    const VectorXcd& c0, Irrep ir0, dcomplex coef,
+		    ERIMethod method, BMat& res, ERIStat* stat) {
+    /*
+      is_J : res_ij += coef (ij|kl) c0_k c0_l   (gk and gl are small basis)
+      !is_J: res_il += coef (ij|kl) c0_j c0_k   (gj and gk are small basis)
+      For each contraction pair of the large basis, contracted primitive
+      blocks are summed over the small basis contractions with c0 before
+      the reduction transform, so (ij|kl) is never stored. Sub quartets
+      whose small basis subs have no Reduction in ir0 are skipped.
+    */
+    if(not gi->setupq) gi->SetUp();
+    if(not gj->setupq) gj->SetUp();
+    if(not gk->setupq) gk->SetUp();
+    if(not gl->setupq) gl->SetUp();
+    ERIStat stat0;
+    if(stat == NULL)
+      stat = &stat0;
+    *stat = ERIStat();
+    
+    int num_prim(gi->max_num_prim() * gj->max_num_prim() *
+		 gk->max_num_prim() * gl->max_num_prim());
+    ERI_ws ws(num_prim);
+    SchwarzScreen screen_body;
+    SchwarzScreen* screen(NULL);
+    if(method.schwarz_thresh > 0.0) {
+      SetUpSchwarz(gi, gj, gk, gl, ws, method, screen_body);
+      screen = &screen_body;
+    }
+    SymmetryGroup sym(gi->sym_group());
+    MatrixXcd M, T;
+    
+    for(SubIt isub = gi->subs().begin(); isub != gi->subs().end(); ++isub) 
+    for(SubIt jsub = gj->subs().begin(); jsub != gj->subs().end(); ++jsub)
+    for(SubIt ksub = gk->subs().begin(); ksub != gk->subs().end(); ++ksub)
+    for(SubIt lsub = gl->subs().begin(); lsub != gl->subs().end(); ++lsub) {
+      
+      // -- a, b: large basis slot. s, t: small basis slot --
+      SubIt asub(isub), bsub(is_J ? jsub : lsub);
+      SubIt ssub(is_J ? ksub : jsub), tsub(is_J ? lsub : ksub);
+      if(not HasIrrep(ssub, ir0) || not HasIrrep(tsub, ir0))
+	continue;
+      if(not ExistNon0(isub, jsub, ksub, lsub))
+	continue;
+      CalcCoefRds(isub, jsub, ksub, lsub, ws);
+      ws.ij.Build(isub, jsub);
+      ws.kl.Build(ksub, lsub);
+      int njr(jsub->size_rds());
+      int nkr(ksub->size_rds()), nlr(lsub->size_rds());
+      int nsr(ssub->size_rds()), ntr(tsub->size_rds());
+      int np(ws.coef_rds.cols());
+      ws.prim_cont.resize(np, 1);
+      M.resize(np, nsr * ntr);
+
+      for(int ac = 0; ac < asub->size_cont(); ac++)
+      for(int bc = 0; bc < bsub->size_cont(); bc++) {
+	M.setZero();
+	for(int sc = 0; sc < ssub->size_cont(); sc++)
+	for(int tc = 0; tc < tsub->size_cont(); tc++) {
+	  int icont(ac), jcont(is_J ? bc : sc), kcont(is_J ? sc : tc), lcont(is_J ? tc : bc);
+	  if(screen != NULL &&
+	     screen->Skip(isub, jsub, ksub, lsub, icont, jcont, kcont, lcont)) {
+	    ws.num_skipped++;
+	    continue;
+	  }
+	  ws.num_computed++;
+	  CalcPrimCont(sym, isub, jsub, ksub, lsub, icont, jcont, kcont, lcont,
+		       ws, method, 0);
+	  for(int sr = 0; sr < nsr; sr++)
+	  for(int tr = 0; tr < ntr; tr++) {
+	    Reduction& srds(ssub->rds[sr]), trds(tsub->rds[tr]);
+	    if(srds.irrep != ir0 || trds.irrep != ir0)
+	      continue;
+	    dcomplex w(c0(srds.offset + sc) * c0(trds.offset + tc) *
+		       srds.coef_icont(sc) * trds.coef_icont(tc));
+	    M.col(sr * ntr + tr) += w * ws.prim_cont.col(0);
+	  }
+	}
+	T.noalias() = ws.coef_rds * M;
+	
+	for(int ar = 0; ar < asub->size_rds(); ar++)
+	for(int br = 0; br < bsub->size_rds(); br++) {
+	  Reduction& ards(asub->rds[ar]), brds(bsub->rds[br]);
+	  if(ards.irrep != brds.irrep || not res.has_block(ards.irrep, brds.irrep))
+	    continue;
+	  dcomplex cumsum(0.0);
+	  for(int sr = 0; sr < nsr; sr++)
+	  for(int tr = 0; tr < ntr; tr++) {
+	    int ir(ar), jr(is_J ? br : sr), kr(is_J ? sr : tr), lr(is_J ? tr : br);
+	    cumsum += T(((ir * njr + jr) * nkr + kr) * nlr + lr, sr * ntr + tr);
+	  }
+	  res(ards.irrep, brds.irrep)(ards.offset + ac, brds.offset + bc) +=
+	    coef * ards.coef_icont(ac) * brds.coef_icont(bc) * cumsum;
+	}
+      }
+    }
+    stat->num_computed = ws.num_computed;
+    stat->num_skipped  = ws.num_skipped;
   }
 
 
   // ==== Interface ====
-  B2EInt CalcERI_Complex(SymGTOs i, ERIMethod method) {
-    return CalcERI(i, i, i, i, method);
+  ERIStat::ERIStat(): num_computed(0), num_skipped(0) {}
+  B2EInt CalcERI_Complex(SymGTOs i, ERIMethod method, ERIStat* stat) {
+    return CalcERI(i, i, i, i, method, stat);
   }
-  B2EInt CalcERI_Hermite(SymGTOs i, ERIMethod method) {
+  B2EInt CalcERI_Hermite(SymGTOs i, ERIMethod method, ERIStat* stat) {
     SymGTOs ci = i->Conj();
-    return CalcERI(ci, i, ci, i, method);
+    return CalcERI(ci, i, ci, i, method, stat);
+  }
+  void AddJ_Small(SymGTOs gi, SymGTOs gj, SymGTOs g0,
+		  const VectorXcd& c0, Irrep ir0, dcomplex coef,
+		  ERIMethod method, BMat& J, ERIStat* stat) {
+    CalcERI_ijkk(gi, gj, g0, g0, true, c0, ir0, coef, method, J, stat);
+  }
+  void AddK_Small(SymGTOs gi, SymGTOs g0, SymGTOs gl,
+		  const VectorXcd& c0, Irrep ir0, dcomplex coef,
+		  ERIMethod method, BMat& K, ERIStat* stat) {
+    CalcERI_ijkk(gi, g0, g0, gl, false, c0, ir0, coef, method, K, stat);
+  }
+  struct SubQuartet {
+    SubIt isub, jsub, ksub, lsub;
+    SubQuartet(SubIt i, SubIt j, SubIt k, SubIt l) :
+      isub(i), jsub(j), ksub(k), lsub(l) {}
+  };
+  static const int kERIFlush = 1 << 16; // entries buffered per thread
+  void FlushERI(B2EInt buf, B2EInt eri) {
+    /* move buf to eri. one thread at a time. */
+    string err_msg;
+#pragma omp critical(eri_flush)
+    {
+      try {
+	eri->Append(vector<IB2EInt*>(1, buf.get()), 1);
+      } catch(exception& e) {
+	err_msg = e.what();
+      }
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+    buf->Init(kERIFlush);
+  }
+  void CalcERI_Threads(SymGTOs gi, SymGTOs gj, SymGTOs gk, SymGTOs gl,
+		       vector<SubQuartet>& qs, int num_prim, bool use_perm,
+		       const SchwarzScreen* screen, ERIMethod method, B2EInt eri,
+		       ERIStat* stat) {
+    /*
+      Distribute sub shell quartets over method.num_threads threads.
+      Each thread computes its quartets into its own workspace and its own
+      B2EIntMem of about kERIFlush entries. When the buffer is full it is
+      appended to eri inside a critical section while the other threads
+      keep computing, so at most num_threads buffers exist besides eri.
+      The order of the integrals in eri therefore depends on scheduling.
+    */
+    int num_q(qs.size());
+    int num_th(method.num_threads);
+    vector<ERI_ws*> ws_list(num_th);
+    vector<B2EInt> buf_list(num_th);
+    for(int ith = 0; ith < num_th; ith++) {
+      ws_list[ith] = new ERI_ws(num_prim);
+      buf_list[ith] = B2EInt(new B2EIntMem(kERIFlush));
+    }
+    string err_msg;
+
+#pragma omp parallel for schedule(dynamic) num_threads(num_th)
+    for(int iq = 0; iq < num_q; iq++) {
+      int ith(0);
+#ifdef _OPENMP
+      ith = omp_get_thread_num();
+#endif
+      SubQuartet& q(qs[iq]);
+      B2EInt buf(buf_list[ith]);
+      try {
+	if(use_perm)
+	  CalcERI1(gi, gj, gk, gl, q.isub, q.jsub, q.ksub, q.lsub,
+		   *ws_list[ith], method, buf, screen);
+	else
+	  CalcERI0(gi->sym_group(), q.isub, q.jsub, q.ksub, q.lsub,
+		   *ws_list[ith], method, buf, screen);
+	if(buf->size() >= kERIFlush)
+	  FlushERI(buf, eri);
+      } catch(exception& e) {
+#pragma omp critical(eri_err)
+	err_msg = e.what();
+      }
+    }
+
+    for(int ith = 0; ith < num_th; ith++) {
+      stat->num_computed += ws_list[ith]->num_computed;
+      stat->num_skipped  += ws_list[ith]->num_skipped;
+      delete ws_list[ith];
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+    for(int ith = 0; ith < num_th; ith++)
+      if(buf_list[ith]->size() > 0)
+	FlushERI(buf_list[ith], eri);
+  }
+  vector<int> NumBasisIrrep(SymGTOs gi, SymGTOs gj, SymGTOs gk, SymGTOs gl) {
+    /* number of basis for each irrep used by block stores. */
+    SymmetryGroup sym(gi->sym_group());
+    vector<int> num_basis;
+    for(Irrep irrep = 0; irrep < sym->order(); irrep++) {
+      int n(gi->size_basis_isym(irrep));
+      if(gj->size_basis_isym(irrep) != n || gk->size_basis_isym(irrep) != n ||
+	 gl->size_basis_isym(irrep) != n) {
+	THROW_ERROR("block store needs the same number of basis for i,j,k,l");
+      }
+      num_basis.push_back(n);
+    }
+    return num_basis;
+  }
+  B2EInt NewERIStore(SymGTOs gi, SymGTOs gj, SymGTOs gk, SymGTOs gl,
+		     ERIMethod method, bool use_perm) {
+    /* empty store for result of CalcERI selected by method.storage */
+    if(method.storage == 1) {
+      return B2EInt(new B2EIntSparse(gi->sym_group(), NumBasisIrrep(gi, gj, gk, gl),
+				     use_perm));
+    } else if(method.storage == 3) {
+      return B2EInt(new B2EIntReduced(gi->sym_group(), NumBasisIrrep(gi, gj, gk, gl),
+				      use_perm, method.reduced_tol));
+    } else if(method.storage == 2) {
+      return B2EInt(new B2EIntPaged((size_t)method.mem_budget * 1024 * 1024));
+    } else if(method.storage == 4) {
+      return B2EInt(new B2EIntBlock(NumBasisIrrep(gi, gj, gk, gl)));
+    } else if(method.storage != 0) {
+      THROW_ERROR("unsupported storage");
+    }
+    
+    B2EInt eri(new B2EIntMem);
+    if(use_perm) {
+      int npair(gi->size_basis() * (gi->size_basis() + 1) / 2);
+      eri->Init(npair * (npair + 1) / 2);
+    } else
+      eri->Init(gi->size_basis() * gj->size_basis() * gk->size_basis() * gl->size_basis());
+    return eri;
   }
-  B2EInt CalcERI(SymGTOs gi, SymGTOs gj, SymGTOs gk, SymGTOs gl, ERIMethod method) {
+  void CalcERI_Store(SymGTOs gi, SymGTOs gj, SymGTOs gk, SymGTOs gl, ERIMethod method,
+		     bool use_perm, B2EInt eri, ERIStat* stat) {
+    /* compute ERI into eri. SymGTOs must be set up. */
+    int num_prim(gi->max_num_prim() * gj->max_num_prim() *
+		 gk->max_num_prim() * gl->max_num_prim());
+    ERIStat stat0;
+    if(stat == NULL)
+      stat = &stat0;
+    *stat = ERIStat();
+    
+    ERI_ws ws(num_prim);
+    SchwarzScreen screen_body;
+    SchwarzScreen* screen(NULL);
+    if(method.schwarz_thresh > 0.0) {
+      SetUpSchwarz(gi, gj, gk, gl, ws, method, screen_body);
+      screen = &screen_body;
+    }
+
+    if(method.num_threads > 1) {
+      vector<SubQuartet> qs;
+      for(SubIt isub = gi->subs().begin(); isub != gi->subs().end(); ++isub) 
+	for(SubIt jsub = gj->subs().begin(); jsub != gj->subs().end(); ++jsub)
+	  for(SubIt ksub = gk->subs().begin(); ksub != gk->subs().end(); ++ksub)
+	    for(SubIt lsub = gl->subs().begin(); lsub != gl->subs().end(); ++lsub)
+	      if(not use_perm || CanonicalSubs(gi, isub, jsub, ksub, lsub))
+		qs.push_back(SubQuartet(isub, jsub, ksub, lsub));
+      CalcERI_Threads(gi, gj, gk, gl, qs, num_prim, use_perm, screen, method, eri, stat);
+      return;
+    }
+
+    for(SubIt isub = gi->subs().begin(); isub != gi->subs().end(); ++isub) 
+      for(SubIt jsub = gj->subs().begin(); jsub != gj->subs().end(); ++jsub)
+	for(SubIt ksub = gk->subs().begin(); ksub != gk->subs().end(); ++ksub)
+	  for(SubIt lsub = gl->subs().begin(); lsub != gl->subs().end(); ++lsub)
+	      if(use_perm) 
+		CalcERI1(gi, gj, gk, gl, isub, jsub, ksub, lsub, ws, method, eri, screen);
+	      else
+		CalcERI0(gi->sym_group(),isub, jsub, ksub, lsub, ws, method, eri, screen);
+    stat->num_computed = ws.num_computed;
+    stat->num_skipped  = ws.num_skipped;
+
+  }
+  B2EInt CalcERI(SymGTOs gi, SymGTOs gj, SymGTOs gk, SymGTOs gl, ERIMethod method,
+		ERIStat* stat) {
 
     if(not gi->setupq)
       gi->SetUp();
@@ -799,22 +2007,400 @@ namespace cbasis {
     if(not gl->setupq)
       gl->SetUp();
     
-    B2EInt eri(new B2EIntMem);
-    eri->Init(gi->size_basis() * gj->size_basis() * gk->size_basis() * gl->size_basis());
-    A4dc prim(gi->max_num_prim() * gj->max_num_prim() *
-	      gk->max_num_prim() * gl->max_num_prim(), "prim");
+    // -- permutation symmetry is available only for (ii|ii) type --
+    bool use_perm(method.perm == 1 && gi == gj && gj == gk && gk == gl);
+
+    B2EInt eri(NewERIStore(gi, gj, gk, gl, method, use_perm));
+    CalcERI_Store(gi, gj, gk, gl, method, use_perm, eri, stat);
+    if(method.storage == 3)
+      static_cast<B2EIntReduced*>(eri.get())->Compress();
+    return eri;
+
+  }
+  B2EInt CalcERI_File(SymGTOs g, ERIMethod method, string fn, ERIStat* stat) {
+
+    if(not g->setupq)
+      g->SetUp();
+    bool use_perm(method.perm == 1);
     
-    for(SubIt isub = gi->subs().begin(); isub != gi->subs().end(); ++isub) 
-      for(SubIt jsub = gj->subs().begin(); jsub != gj->subs().end(); ++jsub)
-	for(SubIt ksub = gk->subs().begin(); ksub != gk->subs().end(); ++ksub)
-	  for(SubIt lsub = gl->subs().begin(); lsub != gl->subs().end(); ++lsub)
-	      if(method.perm == 0) 
-		CalcERI0(gi->sym_group(),isub, jsub, ksub, lsub, prim, method, eri);
-	      else
-		CalcERI1(gi, gj, gk, gl, isub, jsub, ksub, lsub, prim, method, eri);
+    B2EIntStreamWriter* writer(new B2EIntStreamWriter(g->sym_group(),
+						      NumBasisIrrep(g, g, g, g),
+						      use_perm, fn));
+    B2EInt eri(writer);
+    CalcERI_Store(g, g, g, g, method, use_perm, eri, stat);
+    writer->Close();
+    return ERIRead(fn);
+    
+  }
+  B2EInt CalcERI_Diag(SymGTOs g, ERIMethod method, ERIStat* stat) {
+
+    if(not g->setupq)
+      g->SetUp();
+
+    int num(0);
+    for(SubIt isub = g->subs().begin(); isub != g->subs().end(); ++isub) 
+      for(SubIt jsub = g->subs().begin(); jsub != g->subs().end(); ++jsub)
+	num += NumERI0(isub, jsub, isub, jsub);
+    B2EInt eri(new B2EIntMem(max(num, 1)));
+    int num_prim(g->max_num_prim() * g->max_num_prim() *
+		 g->max_num_prim() * g->max_num_prim());
+    ERI_ws ws(num_prim);
+    for(SubIt isub = g->subs().begin(); isub != g->subs().end(); ++isub) 
+      for(SubIt jsub = g->subs().begin(); jsub != g->subs().end(); ++jsub)
+	CalcERI0(g->sym_group(), isub, jsub, isub, jsub, ws, method, eri, NULL);
+    if(stat != NULL) {
+      stat->num_computed = ws.num_computed;
+      stat->num_skipped  = ws.num_skipped;
+    }
+    return eri;
+    
+  }
+  B2EInt CalcERI_Cols(SymGTOs g, int ksub, int lsub, ERIMethod method, ERIStat* stat) {
 
+    if(not g->setupq)
+      g->SetUp();
+    if(ksub < 0 || ksub >= g->size_subs() || lsub < 0 || lsub >= g->size_subs()) {
+      THROW_ERROR("sub index out of range");
+    }
+
+    SubIt ks(g->subs().begin() + ksub);
+    SubIt ls(g->subs().begin() + lsub);
+    int num(0);
+    for(SubIt isub = g->subs().begin(); isub != g->subs().end(); ++isub) 
+      for(SubIt jsub = g->subs().begin(); jsub != g->subs().end(); ++jsub)
+	num += NumERI0(isub, jsub, ks, ls);
+    B2EInt eri(new B2EIntMem(max(num, 1)));
+    int num_prim(g->max_num_prim() * g->max_num_prim() *
+		 g->max_num_prim() * g->max_num_prim());
+    ERI_ws ws(num_prim);
+    for(SubIt isub = g->subs().begin(); isub != g->subs().end(); ++isub) 
+      for(SubIt jsub = g->subs().begin(); jsub != g->subs().end(); ++jsub)
+	CalcERI0(g->sym_group(), isub, jsub, ks, ls, ws, method, eri, NULL);
+    if(stat != NULL) {
+      stat->num_computed = ws.num_computed;
+      stat->num_skipped  = ws.num_skipped;
+    }
     return eri;
+    
+  }
+  void AddJK_Chunk(const ERIChunk& c, const BMat& D, dcomplex coef_J, dcomplex coef_K,
+		   BMat& F) {
+    int y[64];
+    for(int e = 0; e < c.num; e++) {
+      int nimg(c.Images(e, y));
+      dcomplex v(c.value(e));
+      for(int g = 0; g < nimg; g++) {
+	const int* x(&y[8*g]);
+	int ib(x[0]), jb(x[1]), kb(x[2]), lb(x[3]), i(x[4]), j(x[5]), k(x[6]), l(x[7]);
+	if(ib == jb && kb == lb && D.has_block(kb, lb) && F.has_block(ib, jb))
+	  F(ib, jb)(i, j) += coef_J * D(kb, lb)(k, l) * v;
+	if(ib == lb && jb == kb && D.has_block(jb, kb) && F.has_block(ib, lb))
+	  F(ib, lb)(i, l) += coef_K * D(jb, kb)(j, k) * v;
+      }
+    }
+  }
+  void AddJK_Dens(B2EInt blk, const BMat& D, dcomplex coef_J, dcomplex coef_K,
+		   BMat& F) {
+    AddJK_Dens(blk, D, coef_J, coef_K, vector<double>(), 0.0, F);
+  }
+  vector<double> ChunkMaxAbs(B2EInt eri) {
+    int num_chunk(eri->num_chunk());
+    vector<double> res(num_chunk, 0.0);
+    string err_msg;
+#pragma omp parallel if(num_chunk > 1)
+    {
+      ERIChunk c;
+#pragma omp for schedule(dynamic)
+      for(int n = 0; n < num_chunk; n++) {
+	try {
+	  eri->GetChunk(n, &c);
+	} catch(exception& e) {
+#pragma omp critical(jk_err)
+	  err_msg = e.what();
+	  continue;
+	}
+	for(int e = 0; e < c.num; e++)
+	  res[n] = max(res[n], abs(c.value(e)));
+      }
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+    return res;
+  }
+  void AddJK_Dens(B2EInt blk, const BMat& D, dcomplex coef_J, dcomplex coef_K,
+		  const vector<double>& chunk_max, double thresh, BMat& F) {
+    /*
+      Chunks of blk are distributed over threads when there are more than
+      one. Each thread adds to its own zero copy of F, summed up at end.
+      Chunk n is skipped if chunk_max[n] max|D| < thresh, so that small
+      density change in incremental Fock build reads only large ERI.
+    */
+    int num_chunk(blk->num_chunk());
+    vector<char> skip(num_chunk, 0);
+    if(thresh > 0.0 && (int)chunk_max.size() == num_chunk) {
+      double dmax(0.0);
+      for(BMat::const_iterator it = D.begin(); it != D.end(); ++it)
+	if(it->second.size() > 0)
+	  dmax = max(dmax, it->second.cwiseAbs().maxCoeff());
+      for(int n = 0; n < num_chunk; n++)
+	skip[n] = (chunk_max[n] * dmax < thresh);
+    }
+    if(num_chunk <= 1) {
+      ERIChunk c;
+      for(int n = 0; n < num_chunk; n++) {
+	if(skip[n])
+	  continue;
+	blk->GetChunk(n, &c);
+	AddJK_Chunk(c, D, coef_J, coef_K, F);
+      }
+      return;
+    }
+    
+    string err_msg;
+#pragma omp parallel
+    {
+      BMat G;
+      for(BMat::const_iterator it = F.begin(); it != F.end(); ++it)
+	G[it->first] = MatrixXcd::Zero(it->second.rows(), it->second.cols());
+      ERIChunk c;
+#pragma omp for schedule(dynamic)
+      for(int n = 0; n < num_chunk; n++) {
+	if(skip[n])
+	  continue;
+	try {
+	  blk->GetChunk(n, &c);
+	} catch(exception& e) {
+#pragma omp critical(jk_err)
+	  err_msg = e.what();
+	  continue;
+	}
+	AddJK_Chunk(c, D, coef_J, coef_K, G);
+      }
+#pragma omp critical(jk_sum)
+      for(BMat::iterator it = G.begin(); it != G.end(); ++it)
+	F[it->first] += it->second;
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+  }
+  struct JK_Scatter {
+    /*
+      Blocks of D, J, K indexed by irrep (NULL if none), so that the scatter
+      needs no map lookup. For ERI_TYPE_PERM8 entry (pq|rs), p=(ib,i) etc.,
+      the sum over its distinct images is w times the sum over all 8
+      images with w = (number of images)/8. With symmetric D the latter is
+        J_pq, J_qp += 2 D_rs v     J_rs, J_sr += 2 D_pq v
+        K_ps, K_sp += D_qr v       K_qs, K_sq += D_pr v
+        K_pr, K_rp += D_qs v       K_qr, K_rq += D_ps v
+    */
+    vector<const MatrixXcd*> D;
+    vector<MatrixXcd*> J, K;
+    JK_Scatter(int n): D(n, NULL), J(n, NULL), K(n, NULL) {}
+    void Add(vector<MatrixXcd*>& X, int a_ir, int a, int b_ir, int b,
+	     int c_ir, int c, int d_ir, int d, dcomplex v) {
+      /* X(a,b) += D(c,d) v */
+      int n(D.size());
+      if(a_ir == b_ir && c_ir == d_ir && a_ir < n && c_ir < n &&
+	 X[a_ir] != NULL && D[c_ir] != NULL)
+	(*X[a_ir])(a, b) += (*D[c_ir])(c, d) * v;
+    }
+    void AddChunk(const ERIChunk& c) {
+      int y[64];
+      for(int e = 0; e < c.num; e++) {
+	int pi(c.ib[e]), qi(c.jb[e]), ri(c.kb[e]), si(c.lb[e]);
+	int p(c.i[e]),   q(c.j[e]),   r(c.k[e]),   s(c.l[e]);
+	dcomplex v(c.value(e));
+	if(c.t[e] != ERI_TYPE_PERM8) {
+	  this->Add(J, pi, p, qi, q, ri, r, si, s, v);
+	  this->Add(K, pi, p, si, s, qi, q, ri, r, v);
+	  continue;
+	}
+	dcomplex w(c.Images(e, y) / 8.0 * v);
+	this->Add(J, pi, p, qi, q, ri, r, si, s, 2.0*w);
+	this->Add(J, qi, q, pi, p, ri, r, si, s, 2.0*w);
+	this->Add(J, ri, r, si, s, pi, p, qi, q, 2.0*w);
+	this->Add(J, si, s, ri, r, pi, p, qi, q, 2.0*w);
+	this->Add(K, pi, p, si, s, qi, q, ri, r, w);
+	this->Add(K, si, s, pi, p, qi, q, ri, r, w);
+	this->Add(K, qi, q, si, s, pi, p, ri, r, w);
+	this->Add(K, si, s, qi, q, pi, p, ri, r, w);
+	this->Add(K, pi, p, ri, r, qi, q, si, s, w);
+	this->Add(K, ri, r, pi, p, qi, q, si, s, w);
+	this->Add(K, qi, q, ri, r, pi, p, si, s, w);
+	this->Add(K, ri, r, qi, q, pi, p, si, s, w);
+      }
+    }
+  };
+  void CalcJK_Dens(B2EInt eri, const BMat& D, BMat& J, BMat& K) {
+    /*
+      Chunks of eri are distributed over threads as AddJK_Dens. Each
+      thread scatters to its own J and K, summed up at end.
+    */
+    int nir(0);
+    for(BMat::const_iterator it = D.begin(); it != D.end(); ++it) {
+      if(it->first.first != it->first.second) {
+	THROW_ERROR("D must have diagonal irrep blocks only");
+      }
+      nir = max(nir, it->first.first + 1);
+    }
+    J = BMat(); K = BMat();
+    for(BMat::const_iterator it = D.begin(); it != D.end(); ++it) {
+      int n(it->second.rows());
+      J[it->first] = MatrixXcd::Zero(n, n);
+      K[it->first] = MatrixXcd::Zero(n, n);
+    }
 
+    int num_chunk(eri->num_chunk());
+    string err_msg;
+#pragma omp parallel if(num_chunk > 1)
+    {
+      BMat Jt(J), Kt(K);
+      JK_Scatter sc(nir);
+      for(BMat::const_iterator it = D.begin(); it != D.end(); ++it) {
+	int ir(it->first.first);
+	sc.D[ir] = &it->second;
+	sc.J[ir] = &Jt[it->first];
+	sc.K[ir] = &Kt[it->first];
+      }
+      ERIChunk c;
+#pragma omp for schedule(dynamic)
+      for(int n = 0; n < num_chunk; n++) {
+	try {
+	  eri->GetChunk(n, &c);
+	} catch(exception& e) {
+#pragma omp critical(jk_err)
+	  err_msg = e.what();
+	  continue;
+	}
+	sc.AddChunk(c);
+      }
+#pragma omp critical(jk_sum)
+      for(BMat::iterator it = J.begin(); it != J.end(); ++it) {
+	it->second += Jt[it->first];
+	K[it->first] += Kt[it->first];
+      }
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+  }
+  Schwarz NewSchwarz(SymGTOs g, ERIMethod method) {
+
+    if(method.schwarz_thresh <= 0.0)
+      return Schwarz();
+    if(not g->setupq)
+      g->SetUp();
+    int num_prim(g->max_num_prim() * g->max_num_prim() *
+		 g->max_num_prim() * g->max_num_prim());
+    ERI_ws ws(num_prim);
+    Schwarz schwarz(new SchwarzScreen);
+    SetUpSchwarz(g, g, g, g, ws, method, *schwarz);
+    return schwarz;
+
+  }
+  void AddJK_Direct(SymGTOs g, const BMat& D, dcomplex coef_J, dcomplex coef_K,
+		    ERIMethod method, BMat& F, ERIStat* stat) {
+    AddJK_Direct(g, NewSchwarz(g, method), D, coef_J, coef_K, method, F, stat);
+  }
+  void AddJK_Direct(SymGTOs g, Schwarz schwarz, const BMat& D,
+		    dcomplex coef_J, dcomplex coef_K,
+		    ERIMethod method, BMat& F, ERIStat* stat) {
+    /*
+      Canonical sub quartets are distributed over method.num_threads
+      threads. Each thread computes a quartet by CalcERI1 into its own
+      workspace and scatters the ERI_TYPE_PERM8 entries to its own J and K
+      as CalcJK_Dens, summed up at end.
+    */
+
+    if(not g->setupq)
+      g->SetUp();
+
+    int num_prim(g->max_num_prim() * g->max_num_prim() *
+		 g->max_num_prim() * g->max_num_prim());
+    ERIStat stat0;
+    if(stat == NULL)
+      stat = &stat0;
+    *stat = ERIStat();
+
+    int nir(0);
+    BMat J, K;
+    for(BMat::const_iterator it = D.begin(); it != D.end(); ++it) {
+      if(it->first.first != it->first.second) {
+	THROW_ERROR("D must have diagonal irrep blocks only");
+      }
+      nir = max(nir, it->first.first + 1);
+      int n(it->second.rows());
+      J[it->first] = MatrixXcd::Zero(n, n);
+      K[it->first] = MatrixXcd::Zero(n, n);
+    }
+
+    SchwarzScreen screen_body;
+    SchwarzScreen* screen(NULL);
+    if(schwarz) {
+      screen_body = *schwarz;
+      SetUpDensScreen(g, D, screen_body);
+      screen = &screen_body;
+    }
+
+    vector<SubQuartet> qs;
+    for(SubIt isub = g->subs().begin(); isub != g->subs().end(); ++isub) 
+      for(SubIt jsub = g->subs().begin(); jsub != g->subs().end(); ++jsub)
+	for(SubIt ksub = g->subs().begin(); ksub != g->subs().end(); ++ksub)
+	  for(SubIt lsub = g->subs().begin(); lsub != g->subs().end(); ++lsub)
+	    if(CanonicalSubs(g, isub, jsub, ksub, lsub))
+	      qs.push_back(SubQuartet(isub, jsub, ksub, lsub));
+    int num_q(qs.size());
+    int num_th(max(1, method.num_threads));
+    string err_msg;
+
+#pragma omp parallel num_threads(num_th) if(num_th > 1)
+    {
+      ERI_ws ws(num_prim);
+      B2EInt buf(new B2EIntMem);
+      BMat Jt(J), Kt(K);
+      JK_Scatter sc(nir);
+      for(BMat::const_iterator it = D.begin(); it != D.end(); ++it) {
+	int ir(it->first.first);
+	sc.D[ir] = &it->second;
+	sc.J[ir] = &Jt[it->first];
+	sc.K[ir] = &Kt[it->first];
+      }
+      ERIChunk c;
+#pragma omp for schedule(dynamic)
+      for(int iq = 0; iq < num_q; iq++) {
+	SubQuartet& q(qs[iq]);
+	try {
+	  buf->Init(NumERI0(q.isub, q.jsub, q.ksub, q.lsub));
+	  CalcERI1(g, g, g, g, q.isub, q.jsub, q.ksub, q.lsub, ws, method, buf, screen);
+	  for(int n = 0; n < buf->num_chunk(); n++) {
+	    buf->GetChunk(n, &c);
+	    sc.AddChunk(c);
+	  }
+	} catch(exception& e) {
+#pragma omp critical(jk_err)
+	  err_msg = e.what();
+	}
+      }
+#pragma omp critical(jk_sum)
+      {
+	for(BMat::iterator it = J.begin(); it != J.end(); ++it) {
+	  it->second += Jt[it->first];
+	  K[it->first] += Kt[it->first];
+	}
+	stat->num_computed += ws.num_computed;
+	stat->num_skipped  += ws.num_skipped;
+      }
+    }
+    if(err_msg != "") {
+      THROW_ERROR(err_msg);
+    }
+
+    for(BMat::iterator it = J.begin(); it != J.end(); ++it) {
+      if(F.has_block(it->first.first, it->first.second))
+	F[it->first] += coef_J * it->second + coef_K * K[it->first];
+    }
   }
   /*
   B2EInt CalcERI_0122(SymGTOs g0, SymGTOs g1, SymGTOs g2) {
@@ -18,9 +18,63 @@ namespace cbasis {
 			 
 
   // ==== SymGTOs ====
-  B2EInt CalcERI_Complex(SymGTOs i, ERIMethod m);
-  B2EInt CalcERI_Hermite(SymGTOs i, ERIMethod m);
-  B2EInt CalcERI(SymGTOs i, SymGTOs j, SymGTOs k, SymGTOs l, ERIMethod method);  
+  // -- number of contraction quartets computed/skipped by screening --
+  struct ERIStat {
+    long num_computed;
+    long num_skipped;
+    ERIStat();
+  };
+  B2EInt CalcERI_Complex(SymGTOs i, ERIMethod m, ERIStat* stat=NULL);
+  B2EInt CalcERI_Hermite(SymGTOs i, ERIMethod m, ERIStat* stat=NULL);
+  B2EInt CalcERI(SymGTOs i, SymGTOs j, SymGTOs k, SymGTOs l, ERIMethod method,
+		 ERIStat* stat=NULL);
+  // -- (ii|ii) written to block file fn while computing (B2EIntStreamWriter). --
+  // -- returns the file mapped to memory. method.storage is not used.        --
+  B2EInt CalcERI_File(SymGTOs i, ERIMethod method, std::string fn, ERIStat* stat=NULL);
+
+  // -- (ij|ij) type sub quartets of g (diagonal of ERI supermatrix). --
+  // -- other values in the same sub quartets are also included.     --
+  B2EInt CalcERI_Diag(SymGTOs g, ERIMethod method, ERIStat* stat=NULL);
+  // -- (ij|kl) for all ij and kl in sub pair (ksub, lsub) of g. --
+  // -- columns of ERI supermatrix.                               --
+  B2EInt CalcERI_Cols(SymGTOs g, int ksub, int lsub, ERIMethod method,
+		      ERIStat* stat=NULL);
+
+  // -- F += coef_J J[D] + coef_K K[D]                        --
+  // -- J[D]_ij = (ij|kl) D_kl,  K[D]_il = (ij|kl) D_jk        --
+  void AddJK_Dens(B2EInt eri, const BMat& D, dcomplex coef_J, dcomplex coef_K,
+		  BMat& F);
+  // -- max |(ij|kl)| of each chunk of eri                                  --
+  std::vector<double> ChunkMaxAbs(B2EInt eri);
+  // -- AddJK_Dens skipping chunks n with chunk_max[n] max|D| < thresh       --
+  void AddJK_Dens(B2EInt eri, const BMat& D, dcomplex coef_J, dcomplex coef_K,
+		  const std::vector<double>& chunk_max, double thresh, BMat& F);
+  // -- J = J[D] and K = K[D] for all irreps in one pass over eri.   --
+  // -- D must be symmetric with diagonal irrep blocks (I,I) only.   --
+  // -- J and K are set to zero blocks of same size as D.            --
+  void CalcJK_Dens(B2EInt eri, const BMat& D, BMat& J, BMat& K);
+  // -- J/K for orbital c0 (irrep ir0) of small basis g0 without storing ERI. --
+  // -- same as AddJ(CalcERI(gi, gj, g0, g0), c0, ...) and                    --
+  // --         AddK(CalcERI(gi, g0, g0, gl), c0, ...)                         --
+  void AddJ_Small(SymGTOs gi, SymGTOs gj, SymGTOs g0,
+		  const Eigen::VectorXcd& c0, Irrep ir0, dcomplex coef,
+		  ERIMethod method, BMat& J, ERIStat* stat=NULL);
+  void AddK_Small(SymGTOs gi, SymGTOs g0, SymGTOs gl,
+		  const Eigen::VectorXcd& c0, Irrep ir0, dcomplex coef,
+		  ERIMethod method, BMat& K, ERIStat* stat=NULL);
+  // -- integral direct version of AddJK_Dens. D must be symmetric with diagonal --
+  // -- irrep blocks only as CalcJK_Dens. Only canonical sub quartets are        --
+  // -- computed and scattered to all of their permutation images.              --
+  void AddJK_Direct(SymGTOs g, const BMat& D, dcomplex coef_J, dcomplex coef_K,
+		    ERIMethod method, BMat& F, ERIStat* stat=NULL);
+  // -- Schwarz table of g computed once and passed to AddJK_Direct in each     --
+  // -- SCF iteration. null if method.schwarz_thresh is not positive.           --
+  struct SchwarzScreen;
+  typedef boost::shared_ptr<SchwarzScreen> Schwarz;
+  Schwarz NewSchwarz(SymGTOs g, ERIMethod method);
+  void AddJK_Direct(SymGTOs g, Schwarz schwarz, const BMat& D,
+		    dcomplex coef_J, dcomplex coef_K,
+		    ERIMethod method, BMat& F, ERIStat* stat=NULL);
 	       
 }
 
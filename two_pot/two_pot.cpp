@@ -335,6 +335,15 @@ void PrintIn() {
   cout << "ERIMethod_use_symmetry: " << eri_method.symmetry << endl;
   cout << "ERIMethod_use_memo: " << eri_method.coef_R_memo << endl;
   cout << "ERIMethod_use_perm: " << eri_method.perm << endl;  
+  cout << "ERIMethod_num_threads: " << eri_method.num_threads << endl;
+  cout << "ERIMethod_schwarz_thresh: " << eri_method.schwarz_thresh << endl;
+  cout << "ERIMethod_kernel: " << eri_method.kernel << endl;
+  cout << "ERIMethod_direct: " << eri_method.direct << endl;
+  cout << "ERIMethod_incremental: " << eri_method.incremental << endl;
+  cout << "ERIMethod_diis: " << eri_method.diis << endl;
+  cout << "ERIMethod_storage: " << eri_method.storage << endl;
+  cout << "ERIMethod_mem_budget: " << eri_method.mem_budget << endl;
+  cout << "ERIMethod_reduced_tol: " << eri_method.reduced_tol << endl;
   cout << "Ne: " << ne << endl;
   cout << "E0: " << E0 << endl;
   cout << "Z: " << Z << endl;
@@ -399,9 +408,11 @@ void CalcMat() {
 void CalcMatSTEX() {
   PrintTimeStamp("MatSTEX_1", NULL);
   //  ERIMethod method;
-  B2EInt eri_J_11 = CalcERI(basis1, basis1, basis0, basis0, eri_method);
-  B2EInt eri_K_11 = CalcERI(basis1, basis0, basis0, basis1, eri_method);
-  AddJ(eri_J_11, c0, irrep0, 1.0, V1); AddK(eri_K_11, c0, irrep0, 1.0, V1);
+  ERIStat stat_J, stat_K;
+  AddJ_Small(basis1, basis1, basis0, c0, irrep0, 1.0, eri_method, V1, &stat_J);
+  AddK_Small(basis1, basis0, basis1, c0, irrep0, 1.0, eri_method, V1, &stat_K);
+  cout << "ERI_num_computed: " << stat_J.num_computed + stat_K.num_computed << endl;
+  cout << "ERI_num_skipped: "  << stat_J.num_skipped  + stat_K.num_skipped  << endl;
 
   PrintTimeStamp("MatSTEX_01", NULL);
   vector<int> Ls; Ls += 1,3;
@@ -409,12 +420,10 @@ void CalcMatSTEX() {
     cout << "L = " << L << endl;
     SymGTOs psi0   = basis_psi0_L[L];
     SymGTOs c_psi0 = basis_c_psi0_L[L];
-    B2EInt eri_JC = CalcERI(psi0,   basis1, basis0, basis0, eri_method);
-    B2EInt eri_JH = CalcERI(c_psi0, basis1, basis0, basis0, eri_method);
-    B2EInt eri_KC = CalcERI(psi0,   basis0, basis0, basis1, eri_method);
-    B2EInt eri_KH = CalcERI(c_psi0, basis0, basis0, basis1, eri_method);
-    AddJ(eri_JC, c0, irrep0, 1.0, V0L1[L]);  AddK(eri_KC, c0, irrep0, 1.0, V0L1[L]);
-    AddJ(eri_JH, c0, irrep0, 1.0, HV0L1[L]); AddK(eri_KH, c0, irrep0, 1.0, HV0L1[L]);
+    AddJ_Small(psi0,   basis1, basis0, c0, irrep0, 1.0, eri_method, V0L1[L]);
+    AddK_Small(psi0,   basis0, basis1, c0, irrep0, 1.0, eri_method, V0L1[L]);
+    AddJ_Small(c_psi0, basis1, basis0, c0, irrep0, 1.0, eri_method, HV0L1[L]);
+    AddK_Small(c_psi0, basis0, basis1, c0, irrep0, 1.0, eri_method, HV0L1[L]);
   }
 }
 void CalcDriv(int iw) {